@@ -0,0 +1,183 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+#include <SS2DHeadless.h>
+
+#include "MenuWorld.h"
+
+////////////////////////////////////////////////////////////////////////
+// "-store" runs the same world with SS2DUseShapeStore() off and on:
+//
+//  - A check. Loose shapes and groups with moving children (some with
+//    an AABB tree, some with a cached layer) bounce around for a while.
+//    Every group's bounds are traced each tick and have to come out the
+//    same both ways. Groups only refit when their children tell them
+//    they've moved so this fails if the store's move doesn't.
+//  - A benchmark. The update time for the bigger version of that world,
+//    and for MenuWorld, store off and on.
+//
+// Run() is false if the traces differ.
+////////////////////////////////////////////////////////////////////////
+
+class StoreCheck
+{
+public:
+	StoreCheck(size_t ticks) : m_ticks(ticks) {}
+
+	bool Run() {
+		size_t wrong = Check(300);
+		wprintf(L"store: %zu of the group bounds differ with the store on\n", wrong);
+
+		Bench(L"Shapes", 20000, 200, 16);
+		BenchMenu();
+
+		wprintf(L"%ls\n", wrong ? L"store: FAILED" : L"store: ok");
+		return wrong == 0;
+	}
+
+protected:
+	// Loose shapes plus groups of moving children. Laid out from a fixed seed so
+	// the store off and on runs start the same.
+	class StoreWorld : public SS2DWorld
+	{
+	public:
+		StoreWorld(bool store, int shapes, int groups, int children) :
+			m_shapeCount(shapes), m_groupCount(groups), m_childCount(children)
+		{
+			SS2DUseShapeStore(store);
+		}
+
+		const std::vector<RectF>& GetTrace() const { return m_trace; }
+
+		bool SS2DInit() override {
+			std::mt19937 rng(1234);
+			auto randf = [&](float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); };
+			auto randdir = [&]() { return std::uniform_int_distribution<int>(0, 359)(rng); };
+
+			FLOAT cx = (FLOAT)SS2DGetScreenSize().cx;
+			FLOAT cy = (FLOAT)SS2DGetScreenSize().cy;
+			auto br = NewResourceBrush(RGB(255, 255, 255));
+
+			for (int i = 0; i < m_shapeCount; i++) {
+				if (i % 2) {
+					NewMovingRectangle(randf(0, cx - 40), randf(0, cy - 40), randf(5, 40), randf(5, 40), randf(1, 10), randdir(), br);
+				}
+				else {
+					FLOAT radius = randf(5, 20);
+					NewMovingCircle(randf(radius, cx - radius), randf(radius, cy - radius), radius, randf(1, 10), randdir(), br);
+				}
+			}
+
+			for (int i = 0; i < m_groupCount; i++) {
+				auto g = NewMovingGroup(randf(200, cx - 400), randf(200, cy - 400), randf(1, 5), randdir());
+				for (int c = 0; c < m_childCount; c++) {
+					FLOAT speed = (c % 4) ? 0.0f : randf(0.1f, 0.5f);	// mostly stationary, as bricks would be
+					g->NewMovingRectangle(randf(0, 150), randf(0, 150), randf(5, 30), randf(5, 30), speed, randdir(), br);
+				}
+				g->SetUseTree(i % 2 == 0);
+				g->SetCacheLayer(i % 3 == 0);
+				m_groups.push_back(g);
+			}
+			return true;
+		}
+
+		void SS2DDeInit() override {
+			m_groups.clear();
+		}
+
+		bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) override {
+			m_boundsHits.clear();
+			SS2DClassifyBounds(SS2DGetScreenSize(), m_boundsHits);
+			for (auto& hit : m_boundsHits) {
+				switch (hit.second) {
+				case Shape::moveResult::hitboundsleft:
+				case Shape::moveResult::hitboundsright:
+					hit.first->BounceX();
+					break;
+				case Shape::moveResult::hitboundstop:
+				case Shape::moveResult::hitboundsbottom:
+					hit.first->BounceY();
+					break;
+				default:
+					break;
+				}
+			}
+
+			SS2DWorld::SS2DUpdate(tick, ptMouse, events);
+
+			for (auto g : m_groups) {
+				RectF r;
+				g->UpdateBounds();
+				g->GetBoundingBox(&r, g->GetPos());
+				m_trace.push_back(r);
+			}
+			return true;
+		}
+
+	protected:
+		int m_shapeCount;
+		int m_groupCount;
+		int m_childCount;
+		std::vector<MovingGroup*> m_groups;
+		std::vector<std::pair<Shape*, Shape::moveResult>> m_boundsHits;
+		std::vector<RectF> m_trace;
+	};
+
+	size_t Check(size_t ticks) {
+		StoreWorld off(false, 200, 20, 12);
+		StoreWorld on(true, 200, 20, 12);
+		SS2DHeadless(off).Run(ticks);
+		SS2DHeadless(on).Run(ticks);
+
+		const std::vector<RectF>& a = off.GetTrace();
+		const std::vector<RectF>& b = on.GetTrace();
+		if (a.size() != b.size()) {
+			return (std::max)(a.size(), b.size());
+		}
+
+		size_t wrong = 0;
+		for (size_t i = 0; i < a.size(); i++) {
+			if ((fabs(a[i].left - b[i].left) > 0.01f) || (fabs(a[i].top - b[i].top) > 0.01f) ||
+				(fabs(a[i].right - b[i].right) > 0.01f) || (fabs(a[i].bottom - b[i].bottom) > 0.01f)) {
+				wrong++;
+			}
+		}
+		return wrong;
+	}
+
+	void Bench(const wchar_t* name, int shapes, int groups, int children) {
+		double ms[2];
+		for (int store = 0; store < 2; store++) {
+			StoreWorld world(store != 0, shapes, groups, children);
+			SS2DHeadless headless(world);
+			SS2DHeadless::Timings t = headless.Run(m_ticks);
+			ms[store] = t.PerTickMS(t.m_updateMS);
+		}
+		Print(name, ms);
+	}
+
+	void BenchMenu() {
+		Notifier notifier;	// nobody listening
+		double ms[2];
+		for (int store = 0; store < 2; store++) {
+			MenuWorld menu(notifier);
+			menu.SS2DUseShapeStore(store != 0);
+			SS2DHeadless headless(menu);
+			SS2DHeadless::Timings t = headless.Run(m_ticks);
+			ms[store] = t.PerTickMS(t.m_updateMS);
+		}
+		Print(L"Menu", ms);
+	}
+
+	static void Print(const wchar_t* name, const double ms[2]) {
+		wprintf(L"%-10ls update  store off %.3fms  store on %.3fms  (%.2fx)\n", name, ms[0], ms[1], (ms[1] > 0) ? ms[0] / ms[1] : 0.0);
+	}
+
+protected:
+	size_t m_ticks;
+};
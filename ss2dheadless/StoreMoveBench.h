@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <SS2DShapeStore.h>
+
+////////////////////////////////////////////////////////////////////////
+// "-storemove" checks and times SS2DShapeStore::MoveActive():
+//
+//  - A check. Stores of awkward sizes (not multiples of 4 or 8) are
+//    filled the same way and moved with MoveActive() and with
+//    MoveActiveScalar(), entries being stopped, started and turned as
+//    they go. Positions and both sets of bounds have to match exactly.
+//  - A benchmark. Both moves over 10k, 100k and 1M entries.
+//
+// Which SIMD path MoveActive() takes depends on the build: SSE2 with
+// the Makefile's flags on x64, AVX2 with CXXFLAGS="-O2 -g -mavx2".
+// Run() is false if the check fails.
+////////////////////////////////////////////////////////////////////////
+
+class StoreMoveBench
+{
+public:
+	StoreMoveBench() {}
+
+	bool Run() {
+		wprintf(L"storemove: MoveActive() is %ls\n", Path());
+
+		size_t wrong = 0;
+		const size_t sizes[] = { 1, 3, 4, 7, 8, 13, 64, 1001, 10007 };
+		for (size_t n : sizes) {
+			wrong += Check(n);
+		}
+		wprintf(L"storemove: %zu entries differ from the scalar move\n", wrong);
+
+		const size_t benchSizes[] = { 10000, 100000, 1000000 };
+		for (size_t n : benchSizes) {
+			Bench(n);
+		}
+
+		wprintf(L"%ls\n", wrong ? L"storemove: FAILED" : L"storemove: ok");
+		return wrong == 0;
+	}
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	static const wchar_t* Path() {
+#if defined(SS2D_STORE_AVX2)
+		return L"AVX2";
+#elif defined(SS2D_STORE_SSE2)
+		return L"SSE2";
+#else
+		return L"scalar";
+#endif
+	}
+
+	// n entries from a fixed seed. About one in eight inactive.
+	static void Fill(SS2DShapeStore& store, std::vector<SS2DShapeStore::Handle>& handles, size_t n) {
+		std::mt19937 rng(5678);
+		std::uniform_real_distribution<float> pos(0.0f, 1920.0f), step(-15.0f, 15.0f), extent(1.0f, 60.0f);
+		store.Clear();
+		store.Reserve(n);
+		handles.clear();
+		for (size_t i = 0; i < n; i++) {
+			SS2DShapeStore::Handle h = store.Add(pos(rng), pos(rng), step(rng), step(rng), (rng() % 8) != 0);
+			float w = extent(rng);
+			float h2 = extent(rng);
+			if (i % 2) {
+				store.SetExtent(h, 0.0f, 0.0f, w - 1.0f, h2 - 1.0f);	// rectangle
+			}
+			else {
+				store.SetExtent(h, -w, -w, w - 1.0f, w - 1.0f);	// circle
+			}
+			handles.push_back(h);
+		}
+	}
+
+	static size_t Check(size_t n) {
+		SS2DShapeStore simd, scalar;
+		std::vector<SS2DShapeStore::Handle> handles, handlesScalar;
+		Fill(simd, handles, n);
+		Fill(scalar, handlesScalar, n);
+
+		std::mt19937 rng(91011);
+		std::uniform_real_distribution<float> step(-15.0f, 15.0f);
+		for (int pass = 0; pass < 100; pass++) {
+			simd.MoveActive();
+			scalar.MoveActiveScalar();
+
+			// Stop, start and turn a few, as bounces and hits would
+			for (int k = 0; k < 3; k++) {
+				size_t i = rng() % n;
+				bool active = (rng() % 2) != 0;
+				float dx = step(rng), dy = step(rng);
+				simd.SetActive(handles[i], active);
+				scalar.SetActive(handlesScalar[i], active);
+				simd.SetStep(handles[i], dx, dy);
+				scalar.SetStep(handlesScalar[i], dx, dy);
+			}
+		}
+
+		size_t wrong = 0;
+		for (size_t i = 0; i < n; i++) {
+			float a[4], b[4], na[4], nb[4];
+			simd.GetBounds(handles[i], &a[0], &a[1], &a[2], &a[3]);
+			scalar.GetBounds(handlesScalar[i], &b[0], &b[1], &b[2], &b[3]);
+			simd.GetNextBounds(handles[i], &na[0], &na[1], &na[2], &na[3]);
+			scalar.GetNextBounds(handlesScalar[i], &nb[0], &nb[1], &nb[2], &nb[3]);
+
+			bool same = (simd.X(handles[i]) == scalar.X(handlesScalar[i])) && (simd.Y(handles[i]) == scalar.Y(handlesScalar[i]));
+			for (int e = 0; e < 4; e++) {
+				same = same && (a[e] == b[e]) && (na[e] == nb[e]);
+			}
+			if (!same) {
+				wrong++;
+			}
+		}
+		return wrong;
+	}
+
+	static void Bench(size_t n) {
+		SS2DShapeStore store;
+		std::vector<SS2DShapeStore::Handle> handles;
+		size_t passes = (std::max)((size_t)10, (size_t)20000000 / n);	// 20M entry moves or so
+
+		Fill(store, handles, n);
+		Clock::time_point start = Clock::now();
+		for (size_t p = 0; p < passes; p++) {
+			store.MoveActive();
+		}
+		double msSimd = Elapsed(start) / passes;
+
+		Fill(store, handles, n);
+		start = Clock::now();
+		for (size_t p = 0; p < passes; p++) {
+			store.MoveActiveScalar();
+		}
+		double msScalar = Elapsed(start) / passes;
+
+		wprintf(L"%8zu entries  scalar %.3fms (%.2fns each)  %ls %.3fms (%.2fns each)  (%.2fx)\n",
+			n, msScalar, msScalar * 1e6 / n, Path(), msSimd, msSimd * 1e6 / n, (msSimd > 0) ? msScalar / msSimd : 0.0);
+	}
+
+	static double Elapsed(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+};
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+#include <random>
+
+#include <MovingShapes.h>
+
+////////////////////////////////////////////////////////////////////////
+// "-sweep" checks MovingCircle's swept ball/rectangle tests
+// (SweepRectSides() and SweepRectCorners()) against stepping the ball
+// along its step, over a corpus of random balls, steps and radii around
+// one rectangle:
+//
+//  - Against fine stepping (64 samples a pixel) with the same rules.
+//    The sweep has to agree on hit or miss, side or corner, and where.
+//  - Against the old stepping WillBounceOffRectSides() replaced by the
+//    sweep. Where they differ it's counted under why.
+//
+// Then the cases the sweep changed on purpose, each checked directly.
+// Run() is false if anything didn't come out as it should.
+////////////////////////////////////////////////////////////////////////
+
+class SweepCorpus
+{
+public:
+	SweepCorpus(size_t samples = 100000) : m_samples(samples), m_failed(0) {
+		m_rect.left = 300.0f;	// as a 100 x 40 brick's GetBoundingBox()
+		m_rect.top = 200.0f;
+		m_rect.right = 399.0f;
+		m_rect.bottom = 239.0f;
+	}
+
+	bool Run() {
+		m_failed = 0;
+		RunCorpus();
+		RunCases();
+		wprintf(L"%ls\n", m_failed ? L"sweep: FAILED" : L"sweep: ok");
+		return m_failed == 0;
+	}
+
+protected:
+	typedef MovingCircle::SweepHit SweepHit;
+
+	static const int SamplesPerPixel = 64;
+
+	class Stats {
+	public:
+		Stats() : m_hits(0), m_misses(0), m_grazes(0), m_wrong(0) {}
+
+		size_t m_hits;		// both hit, in the same place
+		size_t m_misses;	// both missed
+		size_t m_grazes;	// the sweep clipped a zone for less than a sample
+		size_t m_wrong;
+	};
+
+	class OldStats {
+	public:
+		OldStats() : m_same(0), m_headingOut(0), m_tunnelled(0), m_stepped(0) {}
+
+		size_t m_same;
+		size_t m_headingOut;	// old bounced in a band it was leaving
+		size_t m_tunnelled;		// old gave up as the end wasn't near the rectangle
+		size_t m_stepped;		// old's whole pixel steps put it somewhere else (or missed a graze)
+	};
+
+	void RunCorpus() {
+		std::mt19937 rng(2024);	// the same corpus every run
+		std::uniform_real_distribution<float> x(m_rect.left - 60.0f, m_rect.right + 60.0f);
+		std::uniform_real_distribution<float> y(m_rect.top - 60.0f, m_rect.bottom + 60.0f);
+		std::uniform_real_distribution<float> angle(0.0f, (float)(2 * M_PI));
+		const FLOAT radii[] = { 3.0f, 6.0f, 10.0f };
+		const FLOAT lengths[] = { 0.5f, 2.0f, 5.0f, 15.0f, 40.0f };
+
+		Stats sides, corners;
+		OldStats old;
+		for (size_t n = 0; n < m_samples; n++) {
+			Point2F pos(x(rng), y(rng));
+			if ((pos.x > m_rect.left) && (pos.x < m_rect.right) && (pos.y > m_rect.top) && (pos.y < m_rect.bottom)) {
+				continue;	// starting inside isn't something either handles
+			}
+			FLOAT a = angle(rng);
+			FLOAT len = lengths[n % 5];
+			FLOAT radius = radii[(n / 5) % 3];
+			Point2F step(len * cosf(a), len * sinf(a));
+
+			CheckSides(pos, step, radius, sides);
+			CheckCorners(pos, step, radius, corners);
+			CompareOldSides(pos, step, radius, old);
+		}
+
+		wprintf(L"sides   vs stepped: %zu hit  %zu missed  %zu grazed  %zu wrong\n", sides.m_hits, sides.m_misses, sides.m_grazes, sides.m_wrong);
+		wprintf(L"corners vs stepped: %zu hit  %zu missed  %zu grazed  %zu wrong\n", corners.m_hits, corners.m_misses, corners.m_grazes, corners.m_wrong);
+		wprintf(L"sides   vs old:     %zu the same  %zu heading out  %zu tunnelled  %zu whole pixel steps\n",
+			old.m_same, old.m_headingOut, old.m_tunnelled, old.m_stepped);
+		m_failed += sides.m_wrong + corners.m_wrong;
+	}
+
+	void CheckSides(const Point2F& pos, const Point2F& step, FLOAT radius, Stats& stats) {
+		SweepHit hit;
+		bool swept = MovingCircle::SweepRectSides(pos, step, radius, m_rect, &hit);
+		FLOAT t;
+		bool x;
+		bool stepped = SteppedSides(pos, step, radius, SamplesPerPixel, &t, &x);
+
+		if (!swept && !stepped) {
+			stats.m_misses++;
+		}
+		else if (swept && stepped && SameTime(hit.t, t, step) && (((hit.normal.x != 0.0f) == x) || InBothBands(pos, step, radius, t))) {
+			stats.m_hits++;	// a different side only where the ball's in both bands at once
+		}
+		else if (swept && !stepped && SteppedSides(pos, step, radius, SamplesPerPixel * 64, &t, &x)) {
+			stats.m_grazes++;
+		}
+		else {
+			stats.m_wrong++;
+			Report(L"side", pos, step, radius, swept, hit.t, stepped, t);
+		}
+	}
+
+	void CheckCorners(const Point2F& pos, const Point2F& step, FLOAT radius, Stats& stats) {
+		SweepHit hit;
+		bool swept = MovingCircle::SweepRectCorners(pos, step, radius, m_rect, &hit);
+		FLOAT t;
+		Point2F corner;
+		bool stepped = SteppedCorners(pos, step, radius, SamplesPerPixel, &t, &corner);
+
+		if (!swept && !stepped) {
+			stats.m_misses++;
+		}
+		else if (swept && stepped && SameTime(hit.t, t, step) && (hit.contact.x == corner.x) && (hit.contact.y == corner.y)) {
+			stats.m_hits++;
+		}
+		else if (swept && !stepped && SteppedCorners(pos, step, radius, SamplesPerPixel * 64, &t, &corner)) {
+			stats.m_grazes++;
+		}
+		else {
+			stats.m_wrong++;
+			Report(L"corner", pos, step, radius, swept, hit.t, stepped, t);
+		}
+	}
+
+	void CompareOldSides(const Point2F& pos, const Point2F& step, FLOAT radius, OldStats& stats) {
+		SweepHit hit;
+		bool swept = MovingCircle::SweepRectSides(pos, step, radius, m_rect, &hit);
+		Point2F at;
+		bool x;
+		bool old = OldSides(m_rect, pos, step, radius, &at, &x);
+
+		FLOAT len = Length(step);
+		if (swept == old) {
+			if (!swept || (fabsf(Along(pos, step, at) - hit.t * len) <= 1.0f + 1e-3f)) {
+				stats.m_same++;
+				return;
+			}
+		}
+
+		if (old && HeadingOut(step, at, x)) {
+			stats.m_headingOut++;
+		}
+		else if (!old && !NearEnd(m_rect, pos, step, radius)) {
+			stats.m_tunnelled++;
+		}
+		else {
+			stats.m_stepped++;
+		}
+	}
+
+	// The cases the sweep handles differently from the old stepping on purpose
+	void RunCases() {
+		SweepHit hit;
+		Point2F at;
+		bool x;
+		FLOAT radius = 6.0f;
+
+		// Sitting in the left band heading away from the rectangle. Old bounced it back in.
+		Point2F pos(m_rect.left - 3.0f, m_rect.top + 20.0f);
+		Point2F step(-3.0f, 0.0f);
+		bool swept = MovingCircle::SweepRectSides(pos, step, radius, m_rect, &hit);
+		bool old = OldSides(m_rect, pos, step, radius, &at, &x);
+		Check(L"leaving a side band isn't a hit", !swept && old);
+
+		// And heading in from the same place is, straight away
+		step = Point2F(3.0f, 0.0f);
+		swept = MovingCircle::SweepRectSides(pos, step, radius, m_rect, &hit);
+		Check(L"entering a side band is a hit at t = 0", swept && (hit.t == 0.0f) && (hit.normal.x == -1.0f));
+
+		// Straight through a 4 pixel brick in one step. Old only looked near the end and missed it.
+		RectF thin = m_rect;
+		thin.bottom = thin.top + 3.0f;
+		pos = Point2F(m_rect.left + 50.0f, thin.top - 10.0f);
+		step = Point2F(0.0f, 30.0f);
+		swept = MovingCircle::SweepRectSides(pos, step, radius, thin, &hit);
+		old = OldSides(thin, pos, step, radius, &at, &x);
+		FLOAT expect = (thin.top - radius - pos.y) / step.y;
+		Check(L"no tunnelling through a thin brick", swept && !old && (hit.normal.y == -1.0f) && (fabsf(hit.t - expect) < 1e-5f));
+
+		// Already within radius of the top left corner (c <= 0) and heading for it
+		pos = Point2F(m_rect.left - 3.0f, m_rect.top - 3.0f);
+		step = Point2F(2.0f, 1.0f);
+		swept = MovingCircle::SweepRectCorners(pos, step, radius, m_rect, &hit);
+		Check(L"inside a corner's radius is a hit at t = 0",
+			swept && (hit.t == 0.0f) && (hit.contact.x == m_rect.left) && (hit.contact.y == m_rect.top) && (hit.normal.x < 0.0f) && (hit.normal.y < 0.0f));
+
+		// The same place heading away isn't
+		step = Point2F(-2.0f, -1.0f);
+		swept = MovingCircle::SweepRectCorners(pos, step, radius, m_rect, &hit);
+		Check(L"leaving a corner's radius isn't a hit", !swept);
+	}
+
+	void Check(const wchar_t* what, bool ok) {
+		wprintf(L"  %-48ls %ls\n", what, ok ? L"ok" : L"FAILED");
+		if (!ok) {
+			m_failed++;
+		}
+	}
+
+	void Report(const wchar_t* what, const Point2F& pos, const Point2F& step, FLOAT radius, bool swept, FLOAT tSwept, bool stepped, FLOAT tStepped) {
+		if (m_failed < 10) {
+			wprintf(L"  %ls: pos (%.3f, %.3f) step (%.3f, %.3f) radius %.0f  swept %d t %.5f  stepped %d t %.5f\n",
+				what, pos.x, pos.y, step.x, step.y, radius, swept, swept ? tSwept : 0.0f, stepped, stepped ? tStepped : 0.0f);
+		}
+	}
+
+	// The stepped sample lands at or up to one sample after where the sweep says contact starts
+	static bool SameTime(FLOAT tSwept, FLOAT tStepped, const Point2F& step) {
+		FLOAT len = Length(step);
+		FLOAT slack = 1.0f / Samples(len, SamplesPerPixel) + 1e-4f;
+		return (tStepped >= tSwept - slack) && (tStepped <= tSwept + slack);
+	}
+
+	static int Samples(FLOAT len, int perPixel) {
+		return (std::max)(1, (int)ceilf(len * perPixel));
+	}
+
+	// Sides with the sweep's rules (the radius wide bands, only heading in, left/right first) at n samples a pixel
+	bool SteppedSides(const Point2F& pos, const Point2F& step, FLOAT radius, int perPixel, FLOAT* t, bool* x) const {
+		int n = Samples(Length(step), perPixel);
+		for (int i = 0; i <= n; i++) {
+			FLOAT tt = (FLOAT)i / n;
+			Point2F p(pos.x + step.x * tt, pos.y + step.y * tt);
+			if (InBandX(p, step, radius) || InBandY(p, step, radius)) {
+				*t = tt;
+				*x = InBandX(p, step, radius);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Corners: the centre within radius of one it's heading for
+	bool SteppedCorners(const Point2F& pos, const Point2F& step, FLOAT radius, int perPixel, FLOAT* t, Point2F* contact) const {
+		const Point2F corners[4] = {
+			Point2F(m_rect.left, m_rect.top), Point2F(m_rect.right, m_rect.top), Point2F(m_rect.left, m_rect.bottom), Point2F(m_rect.right, m_rect.bottom)
+		};
+		int n = Samples(Length(step), perPixel);
+		for (int i = 0; i <= n; i++) {
+			FLOAT tt = (FLOAT)i / n;
+			Point2F p(pos.x + step.x * tt, pos.y + step.y * tt);
+			for (const Point2F& corner : corners) {
+				bool towards = (pos.x - corner.x) * step.x + (pos.y - corner.y) * step.y < 0.0f;
+				if (towards && (p.DistanceToSq(corner) <= radius * radius)) {
+					*t = tt;
+					*contact = corner;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool InBandX(const Point2F& p, const Point2F& step, FLOAT radius) const {
+		if ((p.y < m_rect.top) || (p.y > m_rect.bottom)) {
+			return false;
+		}
+		return ((step.x > 0.0f) && (p.x >= m_rect.left - radius) && (p.x <= m_rect.left)) ||
+			((step.x < 0.0f) && (p.x >= m_rect.right) && (p.x <= m_rect.right + radius));
+	}
+
+	bool InBandY(const Point2F& p, const Point2F& step, FLOAT radius) const {
+		if ((p.x < m_rect.left) || (p.x > m_rect.right)) {
+			return false;
+		}
+		return ((step.y > 0.0f) && (p.y >= m_rect.top - radius) && (p.y <= m_rect.top)) ||
+			((step.y < 0.0f) && (p.y >= m_rect.bottom) && (p.y <= m_rect.bottom + radius));
+	}
+
+	bool InBothBands(const Point2F& pos, const Point2F& step, FLOAT radius, FLOAT t) const {
+		Point2F p(pos.x + step.x * t, pos.y + step.y * t);
+		return InBandX(p, step, radius) && InBandY(p, step, radius);
+	}
+
+	// WillBounceOffRectSides() as it was before the sweep. Nothing unless the end of the
+	// step is near the rectangle, then whole pixel steps along it into either band.
+	static bool OldSides(const RectF& r, const Point2F& pos, const Point2F& step, FLOAT radius, Point2F* at, bool* x) {
+		if (!NearEnd(r, pos, step, radius)) {
+			return false;
+		}
+
+		FLOAT endlen = Length(step);
+		FLOAT len = 0.0f;
+		while (len < endlen) {
+			len += 1.0f;
+			Point2F p(pos.x + step.x * len / endlen, pos.y + step.y * len / endlen);
+			if (OldHitX(r, p, radius)) {
+				*at = p;
+				*x = true;
+				return true;
+			}
+			if (OldHitY(r, p, radius)) {
+				*at = p;
+				*x = false;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool NearEnd(const RectF& r, const Point2F& pos, const Point2F& step, FLOAT radius) {
+		Point2F end(pos.x + step.x, pos.y + step.y);
+		return !((end.x + radius < r.left) || (end.x - radius > r.right) ||
+			(end.y + radius < r.top) || (end.y - radius > r.bottom));
+	}
+
+	static bool OldHitX(const RectF& r, const Point2F& p, FLOAT radius) {
+		return (p.y >= r.top) && (p.y <= r.bottom) &&
+			(((p.x >= r.right) && (p.x - radius <= r.right)) || ((p.x <= r.left) && (p.x + radius >= r.left)));
+	}
+
+	static bool OldHitY(const RectF& r, const Point2F& p, FLOAT radius) {
+		return (p.x >= r.left) && (p.x <= r.right) &&
+			(((p.y >= r.bottom) && (p.y - radius <= r.bottom)) || ((p.y <= r.top) && (p.y + radius >= r.top)));
+	}
+
+	// The old hit was in a band on a side the ball was moving away from (or along)
+	bool HeadingOut(const Point2F& step, const Point2F& at, bool x) const {
+		if (x) {
+			return (at.x <= m_rect.left) ? (step.x <= 0.0f) : (step.x >= 0.0f);
+		}
+		return (at.y <= m_rect.top) ? (step.y <= 0.0f) : (step.y >= 0.0f);
+	}
+
+	static FLOAT Length(const Point2F& step) {
+		return sqrtf(step.x * step.x + step.y * step.y);
+	}
+
+	// How far along the step p is
+	static FLOAT Along(const Point2F& pos, const Point2F& step, const Point2F& p) {
+		FLOAT len = Length(step);
+		return ((p.x - pos.x) * step.x + (p.y - pos.y) * step.y) / len;
+	}
+
+protected:
+	size_t m_samples;
+	RectF m_rect;
+	size_t m_failed;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <MovingShapes.h>
+
+////////////////////////////////////////////////////////////////////////
+// "-tree" times MovingGroup with its children in an AABB tree
+// (SetUseTree()) against the flat scan of every child, for walls of
+// 100, 1k and 10k bricks:
+//
+//  - Hit tests. A ball at random places over the wall, HitTestShapes().
+//    Both groups have to find the same bricks, and HitTestShape() has to
+//    pick the same one of them (the first child hit).
+//  - Knocking out a quarter of the bricks, one at a time, with the
+//    group refitting its bounds after each as a game would.
+//
+// Run() is false if the hit tests disagree.
+////////////////////////////////////////////////////////////////////////
+
+class TreeBench
+{
+public:
+	TreeBench() {}
+
+	bool Run() {
+		size_t wrong = 0;
+		const int sides[] = { 10, 32, 100 };
+		for (int side : sides) {
+			wrong += Bench(side, side);
+		}
+		wprintf(L"%ls\n", wrong ? L"tree: FAILED" : L"tree: ok");
+		return wrong == 0;
+	}
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	static const int BrickWidth = 40;
+	static const int BrickHeight = 20;
+	static const int Queries = 20000;
+
+	class Result {
+	public:
+		Result() : m_hitMS(0), m_removeMS(0), m_found(0) {}
+
+		double m_hitMS;		// all the queries
+		double m_removeMS;	// all the removals
+		size_t m_found;
+		std::vector<std::vector<LPARAM>> m_hits;	// brick numbers hit, per query
+		std::vector<LPARAM> m_first;				// HitTestShape()'s brick, -1 for none
+	};
+
+	static Result Time(int rows, int cols, bool useTree) {
+		Result res;
+		MovingGroup* group = new MovingGroup(0, 0, 0, 0);
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++) {
+				group->NewMovingRectangle((FLOAT)(c * (BrickWidth + 2)), (FLOAT)(r * (BrickHeight + 2)),
+					(FLOAT)BrickWidth, (FLOAT)BrickHeight, 0.0f, 0, NULL, (LPARAM)(r * cols + c));
+			}
+		}
+		group->SetUseTree(useTree);
+		group->UpdateBounds();
+
+		std::mt19937 rng(1213);
+		std::uniform_real_distribution<float> x(0.0f, (FLOAT)(cols * (BrickWidth + 2))), y(0.0f, (FLOAT)(rows * (BrickHeight + 2)));
+		MovingCircle ball(0, 0, 8, 0, 0, NULL);
+		std::vector<Point2F> places;
+		for (int q = 0; q < Queries; q++) {
+			places.push_back(Point2F(x(rng), y(rng)));
+		}
+		std::vector<Shape*> hits;
+		res.m_hits.resize(Queries);
+
+		Clock::time_point start = Clock::now();
+		for (int q = 0; q < Queries; q++) {
+			ball.SetPos(places[q]);
+			hits.clear();
+			group->HitTestShapes(&ball, hits);
+			for (auto h : hits) {
+				res.m_hits[q].push_back(h->GetUserData());
+			}
+		}
+		res.m_hitMS = Elapsed(start);
+
+		for (int q = 0; q < Queries; q++) {
+			ball.SetPos(places[q]);
+			Shape* first = group->HitTestShape(&ball);
+			res.m_first.push_back(first ? first->GetUserData() : -1);
+		}
+
+		for (auto& h : res.m_hits) {
+			std::sort(h.begin(), h.end());	// the tree finds them in its own order
+			res.m_found += h.size();
+		}
+
+		std::vector<Shape*> victims;
+		for (auto c : group->GetChildren()) {
+			if ((rng() % 4) == 0) {
+				victims.push_back(c);
+			}
+		}
+		start = Clock::now();
+		for (auto c : victims) {
+			group->RemoveChild(c, true);
+			group->UpdateBounds();
+		}
+		res.m_removeMS = Elapsed(start);
+
+		Shape::Destroy(group);
+		return res;
+	}
+
+	static size_t Bench(int rows, int cols) {
+		Result flat = Time(rows, cols, false);
+		Result tree = Time(rows, cols, true);
+
+		size_t wrong = 0;
+		for (size_t q = 0; q < flat.m_hits.size(); q++) {
+			if ((flat.m_hits[q] != tree.m_hits[q]) || (flat.m_first[q] != tree.m_first[q])) {
+				wrong++;
+			}
+		}
+
+		wprintf(L"%6d bricks  hit test  flat %.2fus  tree %.2fus (%.1fx)  remove  flat %.2fus  tree %.2fus (%.1fx)  %zu hits, %zu differ\n",
+			rows * cols,
+			flat.m_hitMS * 1000.0 / Queries, tree.m_hitMS * 1000.0 / Queries, (tree.m_hitMS > 0) ? flat.m_hitMS / tree.m_hitMS : 0.0,
+			flat.m_removeMS * 1000.0 / (rows * cols / 4), tree.m_removeMS * 1000.0 / (rows * cols / 4), (tree.m_removeMS > 0) ? flat.m_removeMS / tree.m_removeMS : 0.0,
+			flat.m_found, wrong);
+		return wrong;
+	}
+
+	static double Elapsed(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// wrap32lib's Event for the headless build. The same interface, made
+// from a condition variable rather than a Win32 event handle.
+////////////////////////////////////////////////////////////////////////
+
+#include <wrap32lib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+class Event
+{
+public:
+	Event(BOOL bAutoReset = TRUE) : m_bAutoReset(bAutoReset != FALSE), m_bSet(false) {}
+
+	void Set() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bSet = true;
+		if (m_bAutoReset) {
+			m_cv.notify_one();
+		}
+		else {
+			m_cv.notify_all();
+		}
+	}
+
+	void Reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bSet = false;
+	}
+
+	bool Wait(UINT dwMS = INFINITE) {	// true if event was seen, false if it timed out
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (dwMS == INFINITE) {
+			m_cv.wait(lock, [this]() { return m_bSet; });
+		}
+		else if (!m_cv.wait_for(lock, std::chrono::milliseconds(dwMS), [this]() { return m_bSet; })) {
+			return false;
+		}
+		if (m_bAutoReset) {
+			m_bSet = false;
+		}
+		return true;
+	}
+
+protected:
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bAutoReset;
+	bool m_bSet;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// wrap32lib's Thread for the headless build. The same interface, run
+// on a std::thread. EventThread (and its timer queue) isn't here as
+// nothing on the headless path uses it.
+////////////////////////////////////////////////////////////////////////
+
+#include <wrap32lib.h>
+
+#include <atomic>
+#include <thread>
+
+#include "Event.h"
+
+class Thread
+{
+public:
+	Thread() : m_evStop(FALSE), m_running(false) {}
+	~Thread(void) {
+		if (Running()) fwprintf(stderr, L"Thread: Error: Call Stop() in derived destructor\n");
+		WaitForStopped();	// a std::thread can't go while it's joinable
+	}
+
+	BOOL Start() {
+		if (Running())		return FALSE;	// already running
+
+		WaitForStopped();	// the last run's finished but not joined
+		m_evStop.Reset();
+		m_running = true;
+		m_t = std::thread(&Thread::ThreadWrapper, this);
+		return TRUE;
+	}
+
+	virtual void Stop(bool bWait = true) {	// Pass false for a quick return and you can call WaitForStopped() later
+		m_evStop.Set();
+		if (bWait)
+			WaitForStopped();
+	}
+
+	void WaitForStopped() {
+		if (m_t.joinable()) {
+			m_t.join();
+		}
+	}
+
+	bool Running()		{	return m_running;			}
+	BOOL Allocated()	{	return m_running;			}
+	bool ShouldStop()	{	return m_evStop.Wait(0);	}
+
+protected:
+	bool WaitForStop(DWORD dwMS = INFINITE)	{	return m_evStop.Wait(dwMS);	}
+
+	void ThreadWrapper() {
+		ThreadProc();
+		m_running = false;
+	}
+
+	virtual void ThreadProc() = 0;	// override this - check for m_evStop and quit if it gets set
+
+protected:
+	std::thread m_t;
+	Event m_evStop;
+	std::atomic<bool> m_running;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// The headless build has no windows. d2dtypes.h wants utils.h's
+// w32Point, w32Size and w32Rect from Window.h and Notifier.h wants a
+// Window to send to, which is never there.
+////////////////////////////////////////////////////////////////////////
+
+#include <utils.h>
+#include <AppMessage.h>
+
+class Window
+{
+public:
+	operator HWND() const {	return NULL;	}
+};
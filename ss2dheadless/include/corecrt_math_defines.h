@@ -0,0 +1,5 @@
+#pragma once
+
+// glibc's math.h has these already (with _GNU_SOURCE, which g++ defines)
+
+#include <math.h>
@@ -0,0 +1,193 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// Direct2D's types and interfaces as the engine uses them, so the
+// headless path builds with g++. There's no implementation: the factory
+// never makes anything, so no render target exists and drawing goes to
+// SS2DNullBackend or SS2DSoftwareBackend. Signatures follow the SDK's
+// (reference overloads included) for what's called.
+////////////////////////////////////////////////////////////////////////
+
+#include <windows.h>
+#include <dwrite.h>
+
+struct D2D1_POINT_2F { FLOAT x, y; };
+struct D2D1_POINT_2U { UINT32 x, y; };
+struct D2D1_SIZE_F { FLOAT width, height; };
+struct D2D1_SIZE_U { UINT32 width, height; };
+struct D2D1_RECT_F { FLOAT left, top, right, bottom; };
+struct D2D1_RECT_U { UINT32 left, top, right, bottom; };
+struct D2D1_COLOR_F { FLOAT r, g, b, a; };
+struct D2D1_ELLIPSE { D2D1_POINT_2F point; FLOAT radiusX, radiusY; };
+struct D2D1_MATRIX_3X2_F { FLOAT _11, _12, _21, _22, _31, _32; };
+typedef D2D1_COLOR_F D2D_COLOR_F;
+typedef D2D1_RECT_F D2D_RECT_F;
+
+enum D2D1_FILL_MODE { D2D1_FILL_MODE_ALTERNATE, D2D1_FILL_MODE_WINDING };
+enum D2D1_ANTIALIAS_MODE { D2D1_ANTIALIAS_MODE_PER_PRIMITIVE, D2D1_ANTIALIAS_MODE_ALIASED };
+enum D2D1_BITMAP_INTERPOLATION_MODE { D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR };
+enum D2D1_ALPHA_MODE { D2D1_ALPHA_MODE_UNKNOWN, D2D1_ALPHA_MODE_PREMULTIPLIED, D2D1_ALPHA_MODE_STRAIGHT, D2D1_ALPHA_MODE_IGNORE };
+enum D2D1_FACTORY_TYPE { D2D1_FACTORY_TYPE_SINGLE_THREADED, D2D1_FACTORY_TYPE_MULTI_THREADED };
+enum D2D1_DRAW_TEXT_OPTIONS { D2D1_DRAW_TEXT_OPTIONS_NONE = 0 };
+enum D2D1_PRESENT_OPTIONS { D2D1_PRESENT_OPTIONS_NONE = 0, D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS = 1, D2D1_PRESENT_OPTIONS_IMMEDIATELY = 2 };
+enum DXGI_FORMAT { DXGI_FORMAT_UNKNOWN = 0, DXGI_FORMAT_B8G8R8A8_UNORM = 87 };
+
+struct D2D1_PIXEL_FORMAT { DXGI_FORMAT format; D2D1_ALPHA_MODE alphaMode; };
+struct D2D1_BITMAP_PROPERTIES { D2D1_PIXEL_FORMAT pixelFormat; FLOAT dpiX, dpiY; };
+
+#define D2DERR_RECREATE_TARGET	((HRESULT)0x8899000CL)
+
+struct IWICBitmapSource;
+
+struct ID2D1Factory;
+
+struct ID2D1Resource : public IUnknown
+{
+	virtual void GetFactory(ID2D1Factory** factory) = 0;
+};
+
+struct ID2D1Brush : public ID2D1Resource
+{
+	virtual void SetOpacity(FLOAT opacity) = 0;
+	virtual FLOAT GetOpacity() = 0;
+};
+
+struct ID2D1SolidColorBrush : public ID2D1Brush
+{
+	virtual void SetColor(const D2D1_COLOR_F* color) = 0;
+	virtual D2D1_COLOR_F GetColor() = 0;
+
+	void SetColor(const D2D1_COLOR_F& color) { SetColor(&color); }
+};
+
+struct ID2D1Bitmap : public ID2D1Resource
+{
+	virtual D2D1_SIZE_F GetSize() = 0;
+	virtual HRESULT CopyFromMemory(const D2D1_RECT_U* dstRect, const void* srcData, UINT32 pitch) = 0;
+};
+
+struct ID2D1Geometry : public ID2D1Resource {};
+struct ID2D1RectangleGeometry : public ID2D1Geometry {};
+struct ID2D1EllipseGeometry : public ID2D1Geometry {};
+struct ID2D1GeometryGroup : public ID2D1Geometry {};
+
+struct ID2D1BitmapRenderTarget;
+
+struct ID2D1RenderTarget : public ID2D1Resource
+{
+	virtual HRESULT CreateBitmap(D2D1_SIZE_U size, const void* srcData, UINT32 pitch, const D2D1_BITMAP_PROPERTIES* props, ID2D1Bitmap** bitmap) = 0;
+	virtual HRESULT CreateBitmapFromWicBitmap(IWICBitmapSource* source, const D2D1_BITMAP_PROPERTIES* props, ID2D1Bitmap** bitmap) = 0;
+	virtual HRESULT CreateSolidColorBrush(const D2D1_COLOR_F* color, const void* props, ID2D1SolidColorBrush** brush) = 0;
+	virtual HRESULT CreateCompatibleRenderTarget(const D2D1_SIZE_F* size, const D2D1_SIZE_U* pixelSize, const D2D1_PIXEL_FORMAT* format, UINT32 options, ID2D1BitmapRenderTarget** target) = 0;
+	virtual void DrawLine(D2D1_POINT_2F p0, D2D1_POINT_2F p1, ID2D1Brush* brush, FLOAT width = 1.0f, void* style = NULL) = 0;
+	virtual void DrawRectangle(const D2D1_RECT_F* rect, ID2D1Brush* brush, FLOAT width = 1.0f, void* style = NULL) = 0;
+	virtual void FillRectangle(const D2D1_RECT_F* rect, ID2D1Brush* brush) = 0;
+	virtual void DrawEllipse(const D2D1_ELLIPSE* ellipse, ID2D1Brush* brush, FLOAT width = 1.0f, void* style = NULL) = 0;
+	virtual void FillEllipse(const D2D1_ELLIPSE* ellipse, ID2D1Brush* brush) = 0;
+	virtual void FillGeometry(ID2D1Geometry* geometry, ID2D1Brush* brush, ID2D1Brush* opacityBrush = NULL) = 0;
+	virtual void DrawBitmap(ID2D1Bitmap* bitmap, const D2D1_RECT_F* dst = NULL, FLOAT opacity = 1.0f, D2D1_BITMAP_INTERPOLATION_MODE mode = D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, const D2D1_RECT_F* src = NULL) = 0;
+	virtual void DrawText(const WCHAR* string, UINT32 length, IDWriteTextFormat* format, const D2D1_RECT_F* rect, ID2D1Brush* brush, D2D1_DRAW_TEXT_OPTIONS options = D2D1_DRAW_TEXT_OPTIONS_NONE, DWRITE_MEASURING_MODE mode = DWRITE_MEASURING_MODE_NATURAL) = 0;
+	virtual void DrawTextLayout(D2D1_POINT_2F origin, IDWriteTextLayout* layout, ID2D1Brush* brush, D2D1_DRAW_TEXT_OPTIONS options = D2D1_DRAW_TEXT_OPTIONS_NONE) = 0;
+	virtual void DrawGlyphRun(D2D1_POINT_2F origin, const DWRITE_GLYPH_RUN* run, ID2D1Brush* brush, DWRITE_MEASURING_MODE mode = DWRITE_MEASURING_MODE_NATURAL) = 0;
+	virtual void SetTransform(const D2D1_MATRIX_3X2_F* transform) = 0;
+	virtual void GetTransform(D2D1_MATRIX_3X2_F* transform) = 0;
+	virtual void SetAntialiasMode(D2D1_ANTIALIAS_MODE mode) = 0;
+	virtual D2D1_ANTIALIAS_MODE GetAntialiasMode() = 0;
+	virtual void PushAxisAlignedClip(const D2D1_RECT_F* rect, D2D1_ANTIALIAS_MODE mode) = 0;
+	virtual void PopAxisAlignedClip() = 0;
+	virtual void Clear(const D2D1_COLOR_F* color = NULL) = 0;
+	virtual void BeginDraw() = 0;
+	virtual HRESULT EndDraw(UINT64* tag1 = NULL, UINT64* tag2 = NULL) = 0;
+	virtual D2D1_SIZE_F GetSize() = 0;
+	virtual void GetDpi(FLOAT* dpiX, FLOAT* dpiY) = 0;
+
+	HRESULT CreateBitmap(D2D1_SIZE_U size, const void* srcData, UINT32 pitch, const D2D1_BITMAP_PROPERTIES& props, ID2D1Bitmap** bitmap) { return CreateBitmap(size, srcData, pitch, &props, bitmap); }
+	HRESULT CreateBitmapFromWicBitmap(IWICBitmapSource* source, ID2D1Bitmap** bitmap) { return CreateBitmapFromWicBitmap(source, NULL, bitmap); }
+	HRESULT CreateSolidColorBrush(const D2D1_COLOR_F& color, ID2D1SolidColorBrush** brush) { return CreateSolidColorBrush(&color, NULL, brush); }
+	HRESULT CreateCompatibleRenderTarget(D2D1_SIZE_F size, ID2D1BitmapRenderTarget** target) { return CreateCompatibleRenderTarget(&size, NULL, NULL, 0, target); }
+	void DrawRectangle(const D2D1_RECT_F& rect, ID2D1Brush* brush, FLOAT width = 1.0f, void* style = NULL) { DrawRectangle(&rect, brush, width, style); }
+	void FillRectangle(const D2D1_RECT_F& rect, ID2D1Brush* brush) { FillRectangle(&rect, brush); }
+	void DrawEllipse(const D2D1_ELLIPSE& ellipse, ID2D1Brush* brush, FLOAT width = 1.0f, void* style = NULL) { DrawEllipse(&ellipse, brush, width, style); }
+	void FillEllipse(const D2D1_ELLIPSE& ellipse, ID2D1Brush* brush) { FillEllipse(&ellipse, brush); }
+	void DrawBitmap(ID2D1Bitmap* bitmap, const D2D1_RECT_F& dst, FLOAT opacity = 1.0f, D2D1_BITMAP_INTERPOLATION_MODE mode = D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, const D2D1_RECT_F* src = NULL) { DrawBitmap(bitmap, &dst, opacity, mode, src); }
+	void DrawBitmap(ID2D1Bitmap* bitmap, const D2D1_RECT_F& dst, FLOAT opacity, D2D1_BITMAP_INTERPOLATION_MODE mode, const D2D1_RECT_F& src) { DrawBitmap(bitmap, &dst, opacity, mode, &src); }
+	void DrawText(const WCHAR* string, UINT32 length, IDWriteTextFormat* format, const D2D1_RECT_F& rect, ID2D1Brush* brush, D2D1_DRAW_TEXT_OPTIONS options = D2D1_DRAW_TEXT_OPTIONS_NONE, DWRITE_MEASURING_MODE mode = DWRITE_MEASURING_MODE_NATURAL) { DrawText(string, length, format, &rect, brush, options, mode); }
+	void SetTransform(const D2D1_MATRIX_3X2_F& transform) { SetTransform(&transform); }
+	void PushAxisAlignedClip(const D2D1_RECT_F& rect, D2D1_ANTIALIAS_MODE mode) { PushAxisAlignedClip(&rect, mode); }
+	void Clear(const D2D1_COLOR_F& color) { Clear(&color); }
+};
+#define DrawTextW DrawText	// as the SDK's UNICODE macro does
+
+struct ID2D1BitmapRenderTarget : public ID2D1RenderTarget
+{
+	virtual HRESULT GetBitmap(ID2D1Bitmap** bitmap) = 0;
+};
+
+struct ID2D1HwndRenderTarget : public ID2D1RenderTarget
+{
+	virtual HRESULT Resize(const D2D1_SIZE_U* pixelSize) = 0;
+
+	HRESULT Resize(const D2D1_SIZE_U& pixelSize) { return Resize(&pixelSize); }
+};
+
+struct ID2D1Factory : public IUnknown
+{
+	virtual HRESULT ReloadSystemMetrics() = 0;
+	virtual HRESULT CreateRectangleGeometry(const D2D1_RECT_F* rect, ID2D1RectangleGeometry** geometry) = 0;
+	virtual HRESULT CreateEllipseGeometry(const D2D1_ELLIPSE* ellipse, ID2D1EllipseGeometry** geometry) = 0;
+	virtual HRESULT CreateGeometryGroup(D2D1_FILL_MODE fillMode, ID2D1Geometry** geometries, UINT32 count, ID2D1GeometryGroup** group) = 0;
+
+	HRESULT CreateRectangleGeometry(const D2D1_RECT_F& rect, ID2D1RectangleGeometry** geometry) { return CreateRectangleGeometry(&rect, geometry); }
+	HRESULT CreateEllipseGeometry(const D2D1_ELLIPSE& ellipse, ID2D1EllipseGeometry** geometry) { return CreateEllipseGeometry(&ellipse, geometry); }
+};
+
+// There's no Direct2D here
+inline HRESULT D2D1CreateFactory(D2D1_FACTORY_TYPE, REFIID, const void*, void** factory) {
+	*factory = NULL;
+	return E_NOTIMPL;
+}
+template<class Factory> inline HRESULT D2D1CreateFactory(D2D1_FACTORY_TYPE type, Factory** factory) {
+	return D2D1CreateFactory(type, __uuidof(Factory), NULL, (void**)factory);
+}
+
+namespace D2D1
+{
+	class ColorF : public D2D1_COLOR_F
+	{
+	public:
+		enum Enum {
+			Black = 0x000000,
+			Blue = 0x0000FF,
+			DarkGray = 0xA9A9A9,
+			Gray = 0x808080,
+			Green = 0x008000,
+			Magenta = 0xFF00FF,
+			Red = 0xFF0000,
+			White = 0xFFFFFF,
+			Yellow = 0xFFFF00,
+		};
+
+		ColorF(UINT32 rgb, FLOAT alpha = 1.0f) {
+			r = ((rgb >> 16) & 0xff) / 255.0f;
+			g = ((rgb >> 8) & 0xff) / 255.0f;
+			b = (rgb & 0xff) / 255.0f;
+			a = alpha;
+		}
+		ColorF(Enum rgb, FLOAT alpha = 1.0f) : ColorF((UINT32)rgb, alpha) {}
+		ColorF(FLOAT red, FLOAT green, FLOAT blue, FLOAT alpha = 1.0f) {
+			r = red;
+			g = green;
+			b = blue;
+			a = alpha;
+		}
+	};
+
+	inline D2D1_POINT_2F Point2F(FLOAT x = 0.0f, FLOAT y = 0.0f) { return D2D1_POINT_2F{ x, y }; }
+	inline D2D1_SIZE_F SizeF(FLOAT width = 0.0f, FLOAT height = 0.0f) { return D2D1_SIZE_F{ width, height }; }
+	inline D2D1_SIZE_U SizeU(UINT32 width = 0, UINT32 height = 0) { return D2D1_SIZE_U{ width, height }; }
+	inline D2D1_RECT_F RectF(FLOAT left = 0.0f, FLOAT top = 0.0f, FLOAT right = 0.0f, FLOAT bottom = 0.0f) { return D2D1_RECT_F{ left, top, right, bottom }; }
+	inline D2D1_RECT_U RectU(UINT32 left = 0, UINT32 top = 0, UINT32 right = 0, UINT32 bottom = 0) { return D2D1_RECT_U{ left, top, right, bottom }; }
+	inline D2D1_PIXEL_FORMAT PixelFormat(DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN, D2D1_ALPHA_MODE alphaMode = D2D1_ALPHA_MODE_UNKNOWN) { return D2D1_PIXEL_FORMAT{ format, alphaMode }; }
+	inline D2D1_BITMAP_PROPERTIES BitmapProperties(const D2D1_PIXEL_FORMAT& format = PixelFormat(), FLOAT dpiX = 96.0f, FLOAT dpiY = 96.0f) { return D2D1_BITMAP_PROPERTIES{ format, dpiX, dpiY }; }
+	inline D2D1_ELLIPSE Ellipse(const D2D1_POINT_2F& center, FLOAT radiusX, FLOAT radiusY) { return D2D1_ELLIPSE{ center, radiusX, radiusY }; }
+}
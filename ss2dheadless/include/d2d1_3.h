@@ -0,0 +1,23 @@
+#pragma once
+
+// Direct2D 1.3's sprite batches, as SS2DD2DBackend uses them
+
+#include <d2d1.h>
+
+enum D2D1_SPRITE_OPTIONS { D2D1_SPRITE_OPTIONS_NONE = 0, D2D1_SPRITE_OPTIONS_CLAMP_TO_SOURCE_RECTANGLE = 1 };
+
+struct ID2D1SpriteBatch : public ID2D1Resource
+{
+	virtual HRESULT AddSprites(UINT32 count, const D2D1_RECT_F* dst, const D2D1_RECT_U* src = NULL, const D2D1_COLOR_F* colors = NULL, const D2D1_MATRIX_3X2_F* transforms = NULL,
+		UINT32 dstStride = sizeof(D2D1_RECT_F), UINT32 srcStride = sizeof(D2D1_RECT_U), UINT32 colorStride = sizeof(D2D1_COLOR_F), UINT32 transformStride = sizeof(D2D1_MATRIX_3X2_F)) = 0;
+	virtual void Clear() = 0;
+	virtual UINT32 GetSpriteCount() = 0;
+};
+
+struct ID2D1DeviceContext3 : public ID2D1RenderTarget
+{
+	virtual HRESULT CreateSpriteBatch(ID2D1SpriteBatch** batch) = 0;
+	virtual void DrawSpriteBatch(ID2D1SpriteBatch* batch, UINT32 start, UINT32 count, ID2D1Bitmap* bitmap, D2D1_BITMAP_INTERPOLATION_MODE mode = D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, D2D1_SPRITE_OPTIONS options = D2D1_SPRITE_OPTIONS_NONE) = 0;
+
+	void DrawSpriteBatch(ID2D1SpriteBatch* batch, ID2D1Bitmap* bitmap, D2D1_BITMAP_INTERPOLATION_MODE mode = D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, D2D1_SPRITE_OPTIONS options = D2D1_SPRITE_OPTIONS_NONE) { DrawSpriteBatch(batch, 0, batch->GetSpriteCount(), bitmap, mode, options); }
+};
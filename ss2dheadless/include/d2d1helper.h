@@ -0,0 +1,5 @@
+#pragma once
+
+// The SDK's helpers (D2D1::ColorF etc.) are in the d2d1.h shim
+
+#include <d2d1.h>
@@ -0,0 +1,99 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// DirectWrite's types and interfaces as the engine uses them, so the
+// headless path builds with g++. There's no implementation: no factory
+// is ever made so no text formats or layouts are and text isn't drawn.
+////////////////////////////////////////////////////////////////////////
+
+#include <windows.h>
+
+enum DWRITE_FACTORY_TYPE { DWRITE_FACTORY_TYPE_SHARED, DWRITE_FACTORY_TYPE_ISOLATED };
+enum DWRITE_FONT_WEIGHT { DWRITE_FONT_WEIGHT_LIGHT = 300, DWRITE_FONT_WEIGHT_REGULAR = 400, DWRITE_FONT_WEIGHT_BOLD = 700 };
+enum DWRITE_FONT_STYLE { DWRITE_FONT_STYLE_NORMAL, DWRITE_FONT_STYLE_OBLIQUE, DWRITE_FONT_STYLE_ITALIC };
+enum DWRITE_FONT_STRETCH { DWRITE_FONT_STRETCH_UNDEFINED, DWRITE_FONT_STRETCH_NORMAL = 5 };
+enum DWRITE_TEXT_ALIGNMENT { DWRITE_TEXT_ALIGNMENT_LEADING, DWRITE_TEXT_ALIGNMENT_TRAILING, DWRITE_TEXT_ALIGNMENT_CENTER, DWRITE_TEXT_ALIGNMENT_JUSTIFIED };
+enum DWRITE_PARAGRAPH_ALIGNMENT { DWRITE_PARAGRAPH_ALIGNMENT_NEAR, DWRITE_PARAGRAPH_ALIGNMENT_FAR, DWRITE_PARAGRAPH_ALIGNMENT_CENTER };
+enum DWRITE_WORD_WRAPPING { DWRITE_WORD_WRAPPING_WRAP, DWRITE_WORD_WRAPPING_NO_WRAP };
+enum DWRITE_MEASURING_MODE { DWRITE_MEASURING_MODE_NATURAL, DWRITE_MEASURING_MODE_GDI_CLASSIC, DWRITE_MEASURING_MODE_GDI_NATURAL };
+
+struct DWRITE_FONT_METRICS { UINT16 designUnitsPerEm, ascent, descent; INT16 lineGap; UINT16 capHeight, xHeight; INT16 underlinePosition; UINT16 underlineThickness; INT16 strikethroughPosition; UINT16 strikethroughThickness; };
+struct DWRITE_GLYPH_METRICS { INT32 leftSideBearing; UINT32 advanceWidth; INT32 rightSideBearing, topSideBearing; UINT32 advanceHeight; INT32 bottomSideBearing, verticalOriginY; };
+struct DWRITE_GLYPH_OFFSET { FLOAT advanceOffset, ascenderOffset; };
+struct DWRITE_LINE_METRICS { UINT32 length, trailingWhitespaceLength, newlineLength; FLOAT height, baseline; BOOL isTrimmed; };
+struct DWRITE_TEXT_METRICS { FLOAT left, top, width, widthIncludingTrailingWhitespace, height, layoutWidth, layoutHeight; UINT32 maxBidiReorderingDepth, lineCount; };
+
+struct IDWriteFontFace : public IUnknown
+{
+	virtual void GetMetrics(DWRITE_FONT_METRICS* metrics) = 0;
+	virtual HRESULT GetDesignGlyphMetrics(const UINT16* glyphIndices, UINT32 count, DWRITE_GLYPH_METRICS* metrics, BOOL isSideways = FALSE) = 0;
+	virtual HRESULT GetGlyphIndices(const UINT32* codePoints, UINT32 count, UINT16* glyphIndices) = 0;
+};
+
+struct DWRITE_GLYPH_RUN
+{
+	IDWriteFontFace* fontFace;
+	FLOAT fontEmSize;
+	UINT32 glyphCount;
+	const UINT16* glyphIndices;
+	const FLOAT* glyphAdvances;
+	const DWRITE_GLYPH_OFFSET* glyphOffsets;
+	BOOL isSideways;
+	UINT32 bidiLevel;
+};
+
+struct IDWriteFont : public IUnknown
+{
+	virtual HRESULT CreateFontFace(IDWriteFontFace** fontFace) = 0;
+};
+
+struct IDWriteFontFamily : public IUnknown
+{
+	virtual HRESULT GetFirstMatchingFont(DWRITE_FONT_WEIGHT weight, DWRITE_FONT_STRETCH stretch, DWRITE_FONT_STYLE style, IDWriteFont** matchingFont) = 0;
+};
+
+struct IDWriteFontCollection : public IUnknown
+{
+	virtual UINT32 GetFontFamilyCount() = 0;
+	virtual HRESULT GetFontFamily(UINT32 index, IDWriteFontFamily** fontFamily) = 0;
+	virtual HRESULT FindFamilyName(const WCHAR* familyName, UINT32* index, BOOL* exists) = 0;
+};
+
+struct IDWriteTextFormat : public IUnknown
+{
+	virtual HRESULT SetTextAlignment(DWRITE_TEXT_ALIGNMENT textAlignment) = 0;
+	virtual HRESULT SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT paragraphAlignment) = 0;
+	virtual HRESULT SetWordWrapping(DWRITE_WORD_WRAPPING wordWrapping) = 0;
+	virtual DWRITE_TEXT_ALIGNMENT GetTextAlignment() = 0;
+	virtual DWRITE_PARAGRAPH_ALIGNMENT GetParagraphAlignment() = 0;
+	virtual DWRITE_WORD_WRAPPING GetWordWrapping() = 0;
+	virtual HRESULT GetFontCollection(IDWriteFontCollection** fontCollection) = 0;
+	virtual UINT32 GetFontFamilyNameLength() = 0;
+	virtual HRESULT GetFontFamilyName(WCHAR* fontFamilyName, UINT32 nameSize) = 0;
+	virtual DWRITE_FONT_WEIGHT GetFontWeight() = 0;
+	virtual DWRITE_FONT_STYLE GetFontStyle() = 0;
+	virtual DWRITE_FONT_STRETCH GetFontStretch() = 0;
+	virtual FLOAT GetFontSize() = 0;
+};
+
+struct IDWriteTextLayout : public IDWriteTextFormat
+{
+	virtual HRESULT SetMaxWidth(FLOAT maxWidth) = 0;
+	virtual HRESULT SetMaxHeight(FLOAT maxHeight) = 0;
+	virtual HRESULT GetLineMetrics(DWRITE_LINE_METRICS* lineMetrics, UINT32 maxLineCount, UINT32* actualLineCount) = 0;
+	virtual HRESULT GetMetrics(DWRITE_TEXT_METRICS* textMetrics) = 0;
+};
+
+struct IDWriteFactory : public IUnknown
+{
+	virtual HRESULT GetSystemFontCollection(IDWriteFontCollection** fontCollection, BOOL checkForUpdates = FALSE) = 0;
+	virtual HRESULT CreateTextFormat(const WCHAR* fontFamilyName, IDWriteFontCollection* fontCollection, DWRITE_FONT_WEIGHT fontWeight, DWRITE_FONT_STYLE fontStyle,
+		DWRITE_FONT_STRETCH fontStretch, FLOAT fontSize, const WCHAR* localeName, IDWriteTextFormat** textFormat) = 0;
+	virtual HRESULT CreateTextLayout(const WCHAR* string, UINT32 stringLength, IDWriteTextFormat* textFormat, FLOAT maxWidth, FLOAT maxHeight, IDWriteTextLayout** textLayout) = 0;
+};
+
+// There's no DirectWrite here
+inline HRESULT DWriteCreateFactory(DWRITE_FACTORY_TYPE, REFIID, IUnknown** factory) {
+	*factory = NULL;
+	return E_NOTIMPL;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// d2dWindow.h has it in lower case
+
+#include "Thread.h"
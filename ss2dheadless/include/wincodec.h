@@ -0,0 +1,86 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// WIC's types and interfaces as the engine uses them, so the headless
+// path builds with g++. There's no implementation: without a factory
+// bitmaps aren't decoded.
+////////////////////////////////////////////////////////////////////////
+
+#include <windows.h>
+
+enum WICDecodeOptions { WICDecodeMetadataCacheOnDemand, WICDecodeMetadataCacheOnLoad };
+enum WICBitmapDitherType { WICBitmapDitherTypeNone };
+enum WICBitmapPaletteType { WICBitmapPaletteTypeCustom, WICBitmapPaletteTypeMedianCut };
+enum WICBitmapInterpolationMode { WICBitmapInterpolationModeNearestNeighbor, WICBitmapInterpolationModeLinear, WICBitmapInterpolationModeCubic };
+enum WICBitmapEncoderCacheOption { WICBitmapEncoderCacheInMemory, WICBitmapEncoderCacheTempFile, WICBitmapEncoderNoCache };
+
+typedef GUID WICPixelFormatGUID;
+typedef const GUID& REFWICPixelFormatGUID;
+
+inline const GUID GUID_WICPixelFormat32bppBGRA = { 0x6fddc324, 0x4e03, 0x4bfe, { 0xb1, 0x85, 0x3d, 0x77, 0x76, 0x8d, 0xc9, 0x0f } };
+inline const GUID GUID_WICPixelFormat32bppPBGRA = { 0x6fddc324, 0x4e03, 0x4bfe, { 0xb1, 0x85, 0x3d, 0x77, 0x76, 0x8d, 0xc9, 0x10 } };
+inline const GUID GUID_ContainerFormatPng = { 0x1b7cfaf4, 0x713f, 0x473c, { 0xbb, 0xcd, 0x61, 0x37, 0x42, 0x5f, 0xae, 0xaf } };
+inline const GUID CLSID_WICImagingFactory = { 0xcacaf262, 0x9370, 0x4615, { 0xa1, 0x3b, 0x9f, 0x55, 0x39, 0xda, 0x4c, 0x0a } };
+
+struct WICRect { INT X, Y, Width, Height; };
+
+struct IPropertyBag2;
+struct IWICPalette;
+
+struct IStream : public IUnknown {};
+
+struct IWICStream : public IStream
+{
+	virtual HRESULT InitializeFromFilename(LPCWSTR fileName, DWORD desiredAccess) = 0;
+	virtual HRESULT InitializeFromMemory(BYTE* buffer, DWORD bufferSize) = 0;
+};
+
+struct IWICBitmapSource : public IUnknown
+{
+	virtual HRESULT GetSize(UINT* width, UINT* height) = 0;
+	virtual HRESULT GetPixelFormat(WICPixelFormatGUID* pixelFormat) = 0;
+	virtual HRESULT CopyPixels(const WICRect* rc, UINT stride, UINT bufferSize, BYTE* buffer) = 0;
+};
+
+struct IWICBitmapFrameDecode : public IWICBitmapSource {};
+
+struct IWICBitmapDecoder : public IUnknown
+{
+	virtual HRESULT GetFrame(UINT index, IWICBitmapFrameDecode** frame) = 0;
+};
+
+struct IWICFormatConverter : public IWICBitmapSource
+{
+	virtual HRESULT Initialize(IWICBitmapSource* source, REFWICPixelFormatGUID dstFormat, WICBitmapDitherType dither, IWICPalette* palette, double alphaThresholdPercent, WICBitmapPaletteType paletteTranslate) = 0;
+};
+
+struct IWICBitmapScaler : public IWICBitmapSource
+{
+	virtual HRESULT Initialize(IWICBitmapSource* source, UINT width, UINT height, WICBitmapInterpolationMode mode) = 0;
+};
+
+struct IWICBitmapFrameEncode : public IUnknown
+{
+	virtual HRESULT Initialize(IPropertyBag2* encoderOptions) = 0;
+	virtual HRESULT SetSize(UINT width, UINT height) = 0;
+	virtual HRESULT SetPixelFormat(WICPixelFormatGUID* pixelFormat) = 0;
+	virtual HRESULT WritePixels(UINT lineCount, UINT stride, UINT bufferSize, BYTE* pixels) = 0;
+	virtual HRESULT Commit() = 0;
+};
+
+struct IWICBitmapEncoder : public IUnknown
+{
+	virtual HRESULT Initialize(IStream* stream, WICBitmapEncoderCacheOption cacheOption) = 0;
+	virtual HRESULT CreateNewFrame(IWICBitmapFrameEncode** frameEncode, IPropertyBag2** encoderOptions) = 0;
+	virtual HRESULT Commit() = 0;
+};
+
+struct IWICImagingFactory : public IUnknown
+{
+	virtual HRESULT CreateDecoderFromFilename(LPCWSTR fileName, const GUID* vendor, DWORD desiredAccess, WICDecodeOptions options, IWICBitmapDecoder** decoder) = 0;
+	virtual HRESULT CreateDecoderFromStream(IStream* stream, const GUID* vendor, WICDecodeOptions options, IWICBitmapDecoder** decoder) = 0;
+	virtual HRESULT CreateFormatConverter(IWICFormatConverter** converter) = 0;
+	virtual HRESULT CreateBitmapScaler(IWICBitmapScaler** scaler) = 0;
+	virtual HRESULT CreateStream(IWICStream** stream) = 0;
+	virtual HRESULT CreateEncoder(REFGUID containerFormat, const GUID* vendor, IWICBitmapEncoder** encoder) = 0;
+};
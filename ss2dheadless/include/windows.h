@@ -0,0 +1,450 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////
+// Just enough of windows.h for the engine's headless path (SS2DWorld,
+// the shapes and the worlds in ss2dtest) to build with g++ on Linux.
+// Types, constants and the few calls it makes. Files and mappings are
+// POSIX underneath. Window calls do nothing as there are no windows.
+// Not for building anything that opens a window.
+////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Types
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef uint32_t DWORD;		// 32 bits as on Windows, not unsigned long
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int32_t INT32;
+typedef int16_t INT16;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef intptr_t INT_PTR;
+typedef uintptr_t UINT_PTR;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef float FLOAT;
+typedef wchar_t WCHAR;
+typedef char CHAR;
+typedef const char* LPCSTR;
+typedef char* LPSTR;
+typedef const wchar_t* LPCWSTR;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCTSTR;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef int32_t HRESULT;
+
+typedef UINT_PTR WPARAM;
+typedef LONG_PTR LPARAM;
+typedef LONG_PTR LRESULT;
+typedef DWORD COLORREF;
+
+typedef void* HANDLE;
+typedef struct HWND__* HWND;
+typedef struct HINSTANCE__* HINSTANCE;
+typedef struct HDC__* HDC;
+typedef struct HACCEL__* HACCEL;
+typedef void* HLOCAL;
+
+typedef union _LARGE_INTEGER {
+	struct {
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct tagPOINT { LONG x; LONG y; } POINT;
+typedef struct tagSIZE { LONG cx; LONG cy; } SIZE;
+typedef struct tagRECT { LONG left; LONG top; LONG right; LONG bottom; } RECT;
+
+typedef struct _SYSTEM_INFO {
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define WINAPI
+#define CALLBACK
+#define APIENTRY
+#define __stdcall
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+
+// Results
+#define S_OK					((HRESULT)0)
+#define S_FALSE					((HRESULT)1)
+#define E_FAIL					((HRESULT)0x80004005L)
+#define E_NOTIMPL				((HRESULT)0x80004001L)
+#define E_OUTOFMEMORY			((HRESULT)0x8007000EL)
+#define E_INVALIDARG			((HRESULT)0x80070057L)
+#define SUCCEEDED(hr)			(((HRESULT)(hr)) >= 0)
+#define FAILED(hr)				(((HRESULT)(hr)) < 0)
+#define HRESULT_CODE(hr)		((hr) & 0xFFFF)
+#define HRESULT_FROM_WIN32(x)	((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | 0x80070000)))
+
+#define ERROR_SUCCESS				0L
+#define ERROR_FILE_NOT_FOUND		2L
+#define ERROR_ACCESS_DENIED			5L
+#define ERROR_NOT_ENOUGH_MEMORY		8L
+#define ERROR_INVALID_DATA			13L
+#define ERROR_HANDLE_EOF			38L
+
+#define INFINITE		0xFFFFFFFF
+#define STILL_ACTIVE	259
+#define MAX_PATH		260
+
+// Colours
+#define RGB(r, g, b)	((COLORREF)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | (((DWORD)(BYTE)(b)) << 16)))
+#define GetRValue(rgb)	((BYTE)(rgb))
+#define GetGValue(rgb)	((BYTE)(((WORD)(rgb)) >> 8))
+#define GetBValue(rgb)	((BYTE)((rgb) >> 16))
+
+#define LOWORD(l)			((WORD)(((ULONG_PTR)(l)) & 0xffff))
+#define HIWORD(l)			((WORD)((((ULONG_PTR)(l)) >> 16) & 0xffff))
+#define MAKELONG(a, b)		((LONG)(((WORD)(((ULONG_PTR)(a)) & 0xffff)) | ((DWORD)((WORD)(((ULONG_PTR)(b)) & 0xffff))) << 16))
+#define MAKELPARAM(l, h)	((LPARAM)(DWORD)MAKELONG(l, h))
+
+// Messages
+#define WM_DESTROY			0x0002
+#define WM_SIZE				0x0005
+#define WM_KILLFOCUS		0x0008
+#define WM_PAINT			0x000F
+#define WM_ERASEBKGND		0x0014
+#define WM_DISPLAYCHANGE	0x007E
+#define WM_KEYDOWN			0x0100
+#define WM_KEYUP			0x0101
+#define WM_CHAR				0x0102
+#define WM_SYSKEYDOWN		0x0104
+#define WM_SYSKEYUP			0x0105
+#define WM_TIMER			0x0113
+#define WM_MOUSEMOVE		0x0200
+#define WM_LBUTTONDOWN		0x0201
+#define WM_LBUTTONUP		0x0202
+#define WM_RBUTTONDOWN		0x0204
+#define WM_RBUTTONUP		0x0205
+#define WM_MBUTTONDOWN		0x0207
+#define WM_MBUTTONUP		0x0208
+#define WM_APP				0x8000
+
+#define MK_LBUTTON			0x0001
+#define MK_RBUTTON			0x0002
+#define MK_MBUTTON			0x0010
+
+#define SIZE_RESTORED		0
+
+// Virtual keys
+#define VK_LBUTTON		0x01
+#define VK_RBUTTON		0x02
+#define VK_MBUTTON		0x04
+#define VK_BACK			0x08
+#define VK_TAB			0x09
+#define VK_RETURN		0x0D
+#define VK_SHIFT		0x10
+#define VK_CONTROL		0x11
+#define VK_MENU			0x12
+#define VK_ESCAPE		0x1B
+#define VK_SPACE		0x20
+#define VK_LEFT			0x25
+#define VK_UP			0x26
+#define VK_RIGHT		0x27
+#define VK_DOWN			0x28
+#define VK_LSHIFT		0xA0
+#define VK_RSHIFT		0xA1
+#define VK_LCONTROL		0xA2
+#define VK_RCONTROL		0xA3
+#define VK_LMENU		0xA4
+#define VK_RMENU		0xA5
+
+#define MB_OK			0x00000000L
+
+// Critical sections
+typedef struct _CRITICAL_SECTION {
+	std::recursive_mutex* m_mutex;
+} CRITICAL_SECTION;
+
+inline void InitializeCriticalSection(CRITICAL_SECTION* p) { p->m_mutex = new std::recursive_mutex; }
+inline void DeleteCriticalSection(CRITICAL_SECTION* p) { delete p->m_mutex; p->m_mutex = NULL; }
+inline void EnterCriticalSection(CRITICAL_SECTION* p) { p->m_mutex->lock(); }
+inline void LeaveCriticalSection(CRITICAL_SECTION* p) { p->m_mutex->unlock(); }
+
+// Time
+inline ULONGLONG GetTickCount64() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ULONGLONG)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+inline DWORD GetTickCount() { return (DWORD)GetTickCount64(); }
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* p) { p->QuadPart = 1000000000LL; return TRUE; }
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* p) {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	p->QuadPart = (LONGLONG)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	return TRUE;
+}
+
+inline void Sleep(DWORD ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+inline void GetSystemInfo(SYSTEM_INFO* p) {
+	p->dwNumberOfProcessors = (std::max)(1u, std::thread::hardware_concurrency());
+}
+
+inline DWORD GetCurrentThreadId() { return (DWORD)std::hash<std::thread::id>()(std::this_thread::get_id()); }
+
+// Errors
+inline DWORD& ShimLastError() { static thread_local DWORD e = 0; return e; }
+inline DWORD GetLastError() { return ShimLastError(); }
+inline void SetLastError(DWORD e) { ShimLastError() = e; }
+
+#define FORMAT_MESSAGE_ALLOCATE_BUFFER	0x00000100
+#define FORMAT_MESSAGE_IGNORE_INSERTS	0x00000200
+#define FORMAT_MESSAGE_FROM_SYSTEM		0x00001000
+#define LANG_NEUTRAL					0x00
+#define SUBLANG_DEFAULT					0x01
+#define MAKELANGID(p, s)				((((WORD)(s)) << 10) | (WORD)(p))
+
+inline HLOCAL LocalFree(HLOCAL h) { free(h); return NULL; }
+
+// Only FORMAT_MESSAGE_ALLOCATE_BUFFER, which is all wrap32lib asks for
+inline DWORD FormatMessageW(DWORD flags, LPCVOID, DWORD id, DWORD, LPWSTR buffer, DWORD, void*) {
+	const char* s = strerror((int)id);
+	size_t n = strlen(s);
+	wchar_t* w = (wchar_t*)malloc((n + 1) * sizeof(wchar_t));
+	mbstowcs(w, s, n + 1);
+	*(LPWSTR*)buffer = w;
+	return (DWORD)n;
+}
+#define FormatMessage FormatMessageW
+
+// Files. Handles are POSIX file descriptors underneath.
+#define GENERIC_READ			0x80000000L
+#define GENERIC_WRITE			0x40000000L
+#define FILE_SHARE_READ			0x00000001
+#define FILE_SHARE_WRITE		0x00000002
+#define CREATE_NEW				1
+#define CREATE_ALWAYS			2
+#define OPEN_EXISTING			3
+#define OPEN_ALWAYS				4
+#define FILE_ATTRIBUTE_NORMAL	0x00000080
+#define FILE_FLAG_SEQUENTIAL_SCAN	0x08000000
+#define INVALID_HANDLE_VALUE	((HANDLE)(LONG_PTR)-1)
+#define PAGE_READONLY			0x02
+#define FILE_MAP_READ			0x0004
+
+class ShimHandle
+{
+public:
+	ShimHandle(int fd, bool mapping) : m_fd(fd), m_mapping(mapping) {}
+
+	int m_fd;
+	bool m_mapping;	// a CreateFileMapping() handle. The fd belongs to the file's handle.
+};
+
+inline std::string ShimPath(LPCWSTR path) {
+	std::string s;
+	for (; *path; path++) {
+		wchar_t c = (*path == L'\\') ? L'/' : *path;
+		char mb[MB_LEN_MAX];
+		int n = wctomb(mb, c);
+		if (n > 0) {
+			s.append(mb, n);
+		}
+	}
+	return s;
+}
+
+inline HANDLE CreateFileW(LPCWSTR path, DWORD access, DWORD, void*, DWORD disposition, DWORD, HANDLE) {
+	int flags = (access & GENERIC_WRITE) ? ((access & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+	switch (disposition) {
+	case CREATE_NEW:	flags |= O_CREAT | O_EXCL;		break;
+	case CREATE_ALWAYS:	flags |= O_CREAT | O_TRUNC;		break;
+	case OPEN_ALWAYS:	flags |= O_CREAT;				break;
+	}
+	int fd = open(ShimPath(path).c_str(), flags, 0644);
+	if (fd < 0) {
+		SetLastError((errno == ENOENT) ? ERROR_FILE_NOT_FOUND : ERROR_ACCESS_DENIED);
+		return INVALID_HANDLE_VALUE;
+	}
+	return new ShimHandle(fd, false);
+}
+#define CreateFile CreateFileW
+
+inline BOOL CloseHandle(HANDLE h) {
+	if (!h || (h == INVALID_HANDLE_VALUE)) {
+		return FALSE;
+	}
+	ShimHandle* p = (ShimHandle*)h;
+	if (!p->m_mapping) {
+		close(p->m_fd);
+	}
+	delete p;
+	return TRUE;
+}
+
+inline BOOL GetFileSizeEx(HANDLE h, LARGE_INTEGER* pSize) {
+	struct stat st;
+	if (fstat(((ShimHandle*)h)->m_fd, &st) != 0) {
+		return FALSE;
+	}
+	pSize->QuadPart = st.st_size;
+	return TRUE;
+}
+
+inline BOOL ReadFile(HANDLE h, LPVOID p, DWORD n, DWORD* pRead, void*) {
+	ssize_t r = read(((ShimHandle*)h)->m_fd, p, n);
+	if (pRead) {
+		*pRead = (r < 0) ? 0 : (DWORD)r;
+	}
+	return r >= 0;
+}
+
+inline BOOL WriteFile(HANDLE h, LPCVOID p, DWORD n, DWORD* pWritten, void*) {
+	ssize_t r = write(((ShimHandle*)h)->m_fd, p, n);
+	if (pWritten) {
+		*pWritten = (r < 0) ? 0 : (DWORD)r;
+	}
+	return r >= 0;
+}
+
+// Read only mappings of the whole file, which is all the engine makes
+inline HANDLE CreateFileMappingW(HANDLE hFile, void*, DWORD, DWORD, DWORD, LPCWSTR) {
+	return new ShimHandle(((ShimHandle*)hFile)->m_fd, true);
+}
+#define CreateFileMapping CreateFileMappingW
+
+inline std::mutex& ShimViewsLock() { static std::mutex m; return m; }
+inline std::vector<std::pair<void*, size_t>>& ShimViews() { static std::vector<std::pair<void*, size_t>> v; return v; }
+
+inline LPVOID MapViewOfFile(HANDLE hMapping, DWORD, DWORD, DWORD, SIZE_T) {
+	int fd = ((ShimHandle*)hMapping)->m_fd;
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		return NULL;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	std::lock_guard<std::mutex> lock(ShimViewsLock());
+	ShimViews().push_back(std::make_pair(p, (size_t)st.st_size));
+	return p;
+}
+
+inline BOOL UnmapViewOfFile(LPCVOID p) {
+	std::lock_guard<std::mutex> lock(ShimViewsLock());
+	auto& views = ShimViews();
+	for (size_t i = 0; i < views.size(); i++) {
+		if (views[i].first == p) {
+			munmap(views[i].first, views[i].second);
+			views.erase(views.begin() + i);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+// Windows. There aren't any.
+inline LRESULT SendMessage(HWND, UINT, WPARAM, LPARAM) { return 0; }
+inline BOOL PostMessage(HWND, UINT, WPARAM, LPARAM) { return FALSE; }
+inline int MessageBox(HWND, LPCWSTR text, LPCWSTR caption, UINT) { fwprintf(stderr, L"%ls: %ls\n", caption, text); return 0; }
+inline short GetAsyncKeyState(int) { return 0; }
+inline BOOL SetRectEmpty(RECT* p) { p->left = p->top = p->right = p->bottom = 0; return TRUE; }
+inline BOOL SetRect(RECT* p, int l, int t, int r, int b) { p->left = l; p->top = t; p->right = r; p->bottom = b; return TRUE; }
+inline BOOL DestroyAcceleratorTable(HACCEL) { return TRUE; }
+
+// COM
+#define CLSCTX_INPROC_SERVER	0x1
+#define COINIT_MULTITHREADED	0x0
+
+struct GUID {
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+typedef const GUID& REFGUID;
+typedef const GUID& REFIID;
+typedef const GUID& REFCLSID;
+typedef GUID IID;
+
+// Every interface has its own (all zero) id. Nothing looks them up.
+template<class T> inline const GUID& ShimUuidOf() { static const GUID g = {}; return g; }
+#define __uuidof(x) ShimUuidOf<x>()
+
+struct IUnknown
+{
+	virtual HRESULT QueryInterface(REFIID riid, void** ppv) = 0;
+	virtual ULONG AddRef() = 0;
+	virtual ULONG Release() = 0;
+	virtual ~IUnknown() {}
+};
+
+inline HRESULT CoInitializeEx(LPVOID, DWORD) { return S_OK; }
+inline void CoUninitialize() {}
+inline HRESULT CoCreateInstance(REFCLSID, IUnknown*, DWORD, REFIID, LPVOID* ppv) { *ppv = NULL; return E_NOTIMPL; }
+
+// The CRT's _s functions, as used
+#define _TRUNCATE ((size_t)-1)
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+
+template<size_t N, class... Args> inline int swprintf_s(wchar_t (&buffer)[N], const wchar_t* format, Args... args) {
+	return swprintf(buffer, N, format, args...);
+}
+template<class... Args> inline int swprintf_s(wchar_t* buffer, size_t count, const wchar_t* format, Args... args) {
+	return swprintf(buffer, count, format, args...);
+}
+template<size_t N, class... Args> inline int _snwprintf_s(wchar_t (&buffer)[N], size_t, const wchar_t* format, Args... args) {
+	return swprintf(buffer, N, format, args...);
+}
+template<size_t N, class... Args> inline int sprintf_s(char (&buffer)[N], const char* format, Args... args) {
+	return snprintf(buffer, N, format, args...);
+}
+template<class... Args> inline int sprintf_s(char* buffer, size_t count, const char* format, Args... args) {
+	return snprintf(buffer, count, format, args...);
+}
+
+inline int _wcsicmp(const wchar_t* a, const wchar_t* b) {
+	while (*a && (towlower(*a) == towlower(*b))) {
+		a++;
+		b++;
+	}
+	return (int)towlower(*a) - (int)towlower(*b);
+}
+
+inline int _wtoi(const wchar_t* s) { return (int)wcstol(s, NULL, 10); }
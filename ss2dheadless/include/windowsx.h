@@ -0,0 +1,8 @@
+#pragma once
+
+// windowsx.h's message crackers, as far as utils.h uses them
+
+#include <windows.h>
+
+#define GET_X_LPARAM(lp)	((int)(short)LOWORD(lp))
+#define GET_Y_LPARAM(lp)	((int)(short)HIWORD(lp))
@@ -0,0 +1,57 @@
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+
+#include <SS2DArchive.h>
+
+#include "Benchmark.h"
+
+#include "SweepCorpus.h"
+#include "StoreCheck.h"
+#include "StoreMoveBench.h"
+#include "TreeBench.h"
+
+#define ARCHIVENAME L"runtime.ss2d"
+
+////////////////////////////////////////////////////////////////////////////////
+// ss2dheadless runs ss2dtest's worlds with no window, the same as its
+// "-bench" does, and prints how long each phase took. It builds with g++
+// (see the Makefile) using the stand-ins for the Windows headers in include/
+// so the engine can be timed and checked on Linux. Run it from runtime/ so
+// the worlds find their files.
+//
+//   ss2dheadless [ticks]
+//   ss2dheadless -sweep		ball/rectangle sweeps vs stepping (SweepCorpus.h)
+//   ss2dheadless -store [ticks]	the shape store off vs on (StoreCheck.h)
+//   ss2dheadless -storemove	the store's SIMD move vs the scalar one (StoreMoveBench.h)
+//   ss2dheadless -tree		a group's AABB tree vs scanning its children (TreeBench.h)
+//
+// The checks exit with 1 if they fail.
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+	if ((argc > 1) && (strcmp(argv[1], "-sweep") == 0)) {
+		return SweepCorpus().Run() ? 0 : 1;
+	}
+
+	if ((argc > 1) && (strcmp(argv[1], "-storemove") == 0)) {
+		return StoreMoveBench().Run() ? 0 : 1;
+	}
+
+	if ((argc > 1) && (strcmp(argv[1], "-tree") == 0)) {
+		return TreeBench().Run() ? 0 : 1;
+	}
+
+	w32seed();
+	SS2DArchive::Mounted().Open(ARCHIVENAME);	// loose files if it isn't there
+
+	if ((argc > 1) && (strcmp(argv[1], "-store") == 0)) {
+		int ticks = (argc > 2) ? atoi(argv[2]) : 0;
+		return StoreCheck((ticks > 0) ? ticks : 1000).Run() ? 0 : 1;
+	}
+
+	int ticks = (argc > 1) ? atoi(argv[1]) : 0;
+	wprintf(L"%ls", RunBenchmark((ticks > 0) ? ticks : 5000).c_str());
+	return 0;
+}
@@ -45,6 +45,7 @@ protected:
 
 	// Direct2D overrides from the engine Window. Pass them to our world.
 	bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) override {
+		m_worldStarter.SS2DSetInput(SS2DGetInput());
 		return m_worldStarter.SS2DUpdate(tick, ptMouse, events);
 	}
 
@@ -54,14 +55,16 @@ protected:
 	}
 
 	void D2DRender() override {
-		D2DClearScreen(m_worldStarter.m_colorBackground);
+		if (!m_worldStarter.SS2DUsingDirtyRects()) {
+			D2DClearScreen(m_worldStarter.m_colorBackground);	// otherwise the world clears what it redraws
+		}
+
+		m_worldStarter.D2DRender(m_ess);
 
-		// Draw the fixed aspect rectangle
+		// Draw the fixed aspect rectangle. After the world so its redraws can't wipe it.
 		RectF rectBounds;
 		D2DGetFARRect(&rectBounds);
 		m_ess.m_pRenderTarget->DrawRectangle(rectBounds, *m_worldStarter.GetDefaultBrush());
-
-		m_worldStarter.D2DRender(m_ess);
 		__super::D2DRender();
 	}
 
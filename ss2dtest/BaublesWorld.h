@@ -19,6 +19,11 @@ public:
 		m_notifier(notifier)
 	{
 		SS2DSetScreenSize(w32Size(c_screenWidth, c_screenHeight));
+		SS2DUseBroadphase(true, c_ballDiameter * 2);	// snow vs bauble checks
+		SS2DUseAtlas(true, L"atlas.txt");
+		SS2DUseAsyncLoading(true);	// first frame without waiting for the atlas pages
+		SS2DUseCommandList(true);	// sprite batches per atlas page
+		SS2DUseCulling(true);
 	}
 
 	MovingGroup* NewBauble(FLOAT x, FLOAT y, int dir) {
@@ -30,6 +35,8 @@ public:
 	}
 
 	bool SS2DInit() override {
+		SS2DPrewarmPools(0, 2048);	// falling and settled snow
+
 		// Create the resources we need
 		m_brushInvisible = NewResourceBrush(RGB(255, 255, 255), 0.0f);
 
@@ -93,9 +100,9 @@ public:
 	}
 
 	MovingGroup* HitTestBaubles(MovingGroup* bullet) {
-		MovingCircle* bulletMask = (MovingCircle*)bullet->GetChildren()[1];
+		MovingCircle* bulletMask = ShapeCast<MovingCircle>(bullet->GetChildren()[1]);
 		for (auto group : m_baubles) {
-			MovingCircle* mask = (MovingCircle*)group->GetChildren()[1];
+			MovingCircle* mask = ShapeCast<MovingCircle>(group->GetChildren()[1]);
 			if (group->IsActive() && bulletMask->HitTestShape(mask)) {
 				return group;
 			}
@@ -145,33 +152,37 @@ public:
 
 	bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) override {
 		// Clean up snow that's fallen outside the screen border
-		for (auto it = m_snow.begin(); it != m_snow.end(); ) {
-			auto s = *it;
+		for (size_t i = 0; i < m_snow.size(); ) {
+			auto s = m_snow[i];
 			if (s->WillHitBounds(SS2DGetScreenSize()) != Shape::moveResult::ok) {
-				it = m_snow.erase(it);
-				RemoveShape(s, true);
+				m_snow[i] = m_snow.back();	// snow order doesn't matter so swap and pop
+				m_snow.pop_back();
+				Despawn(s);
 			}
 			else {
-				++it;
+				++i;
 			}
 		}
 
 		// Hit test the snow with the baubles and settle if there's a hit.
-		for (auto it = m_snow.begin(); it != m_snow.end(); ) {
-			auto sf = *it;
+		for (size_t i = 0; i < m_snow.size(); ) {
+			auto sf = m_snow[i];
 
 			bool hit = false;
-			for (auto group : m_baubles) {
-				if (group->IsActive()) {
+			std::vector<Shape*> nearby;
+			QueryShape(sf, nearby);
+			for (auto candidate : nearby) {
+				auto group = ShapeCast<MovingGroup>(candidate->GetParent());
+				if (group && (group != m_bullet) && group->IsActive() && (group->GetChildren()[1] == candidate)) {	// a bauble mask?
 					if (w32rand(100) == 0) {
-						auto mask = (MovingCircle*)group->GetChildren()[1];
-						if (sf->HitTestShape(mask)) {
+						auto mask = ShapeCast<MovingCircle>(candidate);
+						if (mask && sf->HitTestShape(mask)) {
 							// Stop the snowflake and move into the bauble group that it hit
 							sf->SetSpeed(0);
 
 							RemoveShape(sf);				// Remove it as a standalone from the engine
 							group->AddChildAndOffset(sf);	// Add it to the group (which is already in the engine)
-							m_snowSettled.push(sf);
+							m_snowSettled.push(GetHandle(sf));
 							hit = true;
 							break;
 						}
@@ -180,10 +191,11 @@ public:
 			}
 
 			if (hit) {
-				it = m_snow.erase(it);
+				m_snow[i] = m_snow.back();
+				m_snow.pop_back();
 			}
 			else
-				++it;
+				++i;
 		}
 
 		// Wrap any baubles gone off the board
@@ -204,7 +216,7 @@ public:
 			m_bullet->SetSpeed(0);
 			int col = w32rand(4);;
 			m_bullet->SetUserData(col);
-			((MovingBitmap*)m_bullet->GetChildren()[0])->SetBitmap(m_baubleBitmaps[col]);
+			ShapeCast<MovingBitmap>(m_bullet->GetChildren()[0])->SetBitmap(m_baubleBitmaps[col]);
 		}
 
 		// Did the bullet hit anything
@@ -218,10 +230,10 @@ public:
 
 			m_bullet->SetUserData(cbr);
 			SS2DBitmap* bmpNext = m_baubleMovingBitmaps[cbr] ? m_baubleMovingBitmaps[cbr] : m_baubleBitmaps[cbr];
-			((MovingBitmap*)m_bullet->GetChildren()[0])->SetBitmap(bmpNext);
+			ShapeCast<MovingBitmap>(m_bullet->GetChildren()[0])->SetBitmap(bmpNext);
 
 			baublehit->SetUserData(bmp);
-			((MovingBitmap*)baublehit->GetChildren()[0])->SetBitmap(m_baubleBitmaps[bmp]);
+			ShapeCast<MovingBitmap>(baublehit->GetChildren()[0])->SetBitmap(m_baubleBitmaps[bmp]);
 
 			m_bullet->SetSpeed(m_bullet->GetSpeed() / 2);
 			CheckLines();
@@ -273,18 +285,19 @@ public:
 		int dir = w32rand(160, 200);
 		int speed = w32rand(50, 150);
 
-		auto snowflake = NewMovingCircle((FLOAT)x, 2, 1, (FLOAT)speed / 100.0f, dir, GetDefaultBrush());
+		auto snowflake = SpawnMovingCircle((FLOAT)x, 2, 1, (FLOAT)speed / 100.0f, dir, GetDefaultBrush());
 		m_snow.push_back(snowflake);
 
 		// Clean up SNOW!
 		if (m_snowSettled.size() > 1000) {
-			auto sf = m_snowSettled.front();
+			auto sf = Resolve<MovingCircle>(m_snowSettled.front());
 			m_snowSettled.pop();
-			auto group = (MovingGroup*)sf->GetParent();
-			group->RemoveChild(sf, true);
+			if (sf) {	// its bauble may have taken it with it
+				sf->GetParent()->RemoveChild(sf, true);
+			}
 		}
 
-		return __super::SS2DUpdate(tick, ptMouse, events);
+		return SS2DWorld::SS2DUpdate(tick, ptMouse, events);
 	}
 
 protected:
@@ -300,7 +313,7 @@ protected:
 	std::vector<SS2DBitmap*> m_baubleMovingBitmaps;
 
 	std::vector<MovingCircle*> m_snow;
-	std::queue<MovingCircle*> m_snowSettled;
+	std::queue<SS2DHandle> m_snowSettled;	// Snow stuck to baubles, oldest first
 
 	MovingText* m_scoreLabel;
 	MovingText* m_scoreValue;
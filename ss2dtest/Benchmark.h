@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+
+#include <SS2DHeadless.h>
+#include <SS2DSoftwareBackend.h>
+
+#include <Notifier.h>
+
+#include "MenuWorld.h"
+#include "InvaderWorld.h"
+#include "BreakoutWorld.h"
+#include "ColorsWorld.h"
+#include "BaublesWorld.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// RunBenchmark() runs each world headless with scripted input and returns a
+// line per world of how long each phase took. ss2dtest's "-bench" shows it in
+// a message box and ss2dheadless prints it.
+// Scripted input reaches the worlds' KeyDown() and KeyPressed() as well as their events.
+////////////////////////////////////////////////////////////////////////////////
+
+inline void BenchWorld(LPCWSTR name, SS2DHeadless& headless, size_t ticks, std::wstring& report) {
+	SS2DHeadless::Timings t = headless.Run(ticks);
+
+	wchar_t draws[32] = L"";
+	if (t.m_drawCallsCounted) {
+		swprintf_s(draws, L"  (%zu draws)", t.m_drawCalls);
+	}
+
+	wchar_t line[256];
+	swprintf_s(line, L"%-10ls %6zu ticks  update %.3fms  prerender %.3fms  record %.3fms  render %.3fms%ls  %.0f ticks/s%ls\n",
+		name, t.m_ticks,
+		t.PerTickMS(t.m_updateMS), t.PerTickMS(t.m_preRenderMS), t.PerTickMS(t.m_recordMS), t.PerTickMS(t.m_renderMS),
+		draws, t.TicksPerSecond(), t.m_quit ? L" (quit)" : L"");
+	report += line;
+}
+
+inline std::wstring RunBenchmark(size_t ticks) {
+	Notifier notifier;	// nobody listening
+	std::wstring report;
+
+	MenuWorld menu(notifier);
+	SS2DHeadless hMenu(menu);
+	for (size_t n = 0; n < ticks; n += 10) {
+		hMenu.MouseTo(n, Point2F((FLOAT)(n % 1920), (FLOAT)(n % 1080)));
+	}
+	BenchWorld(L"Menu", hMenu, ticks, report);
+
+	SS2DSoftwareBackend software(1920, 1080);
+	MenuWorld menuSoftware(notifier);
+	SS2DHeadless hMenuSoftware(menuSoftware, &software);
+	hMenuSoftware.SetTargetSize(w32Size(software.GetWidth(), software.GetHeight()));
+	BenchWorld(L"Menu (cpu)", hMenuSoftware, ticks, report);
+
+	InvaderWorld invaders(notifier);
+	SS2DHeadless hInvaders(invaders);
+	for (size_t n = 0; n < ticks; n += 60) {
+		hInvaders.KeyPress(n, ((n / 60) % 2) ? VK_LEFT : VK_RIGHT, 30);	// player strafes and fires
+		hInvaders.KeyPress(n + 10, VK_CONTROL);
+	}
+	BenchWorld(L"Invaders", hInvaders, ticks, report);
+
+	BreakoutWorld breakout(notifier);
+	SS2DHeadless hBreakout(breakout);
+	for (size_t n = 0; n < ticks; n += 50) {
+		hBreakout.Click(n, Point2F((FLOAT)(200 + (n * 7) % 1400), 1000));	// bat sweeps, ball relaunches
+	}
+	BenchWorld(L"Breakout", hBreakout, ticks, report);
+
+	ColorsWorld colors(notifier);
+	SS2DHeadless hColors(colors);
+	for (size_t n = 0; n < ticks; n += 25) {
+		hColors.KeyPress(n, (n % 50) ? VK_LEFT : VK_RIGHT);
+		hColors.KeyPress(n + 5, VK_CONTROL);
+	}
+	BenchWorld(L"Colors", hColors, ticks, report);
+
+	BaublesWorld baubles(notifier);
+	SS2DHeadless hBaubles(baubles);
+	for (size_t n = 0; n < ticks; n += 40) {
+		hBaubles.KeyPress(n, VK_CONTROL);	// fire
+	}
+	BenchWorld(L"Baubles", hBaubles, ticks, report);
+
+	return report;
+}
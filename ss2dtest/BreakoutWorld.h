@@ -1,6 +1,7 @@
 #pragma once
 
 #include <list>
+#include <sstream>
 
 #include <SS2DWorld.h>
 
@@ -44,6 +45,12 @@ public:
 	BreakoutWorld(Notifier& notifier) :
 		m_notifier(notifier)
 	{
+		SS2DUseBroadphase(true, 128.0f);	// ball/bullet vs brick checks
+		SS2DUseAtlas(true, L"atlas.txt");
+		SS2DUseAsyncLoading(true);	// first frame without waiting for the atlas pages
+		SS2DUseCommandList(true);	// dirty rects need it
+		SS2DUseDirtyRects(true);	// most frames it's just the ball, bat and score
+		SS2DUseCulling(true);
 	}
 	~BreakoutWorld() {}
 
@@ -69,11 +76,16 @@ public:
 				}*/
 
 		MovingGroup* pCurrentGroup = NULL;
-		File f;
-		f.Open(L"level1.txt", GENERIC_READ, OPEN_EXISTING);
+		std::string level;
+		SS2DArchive::ReadAsset(L"level1.txt", level);	// runtime.ss2d or the folder
+		std::istringstream lines(level);
 		std::string s;
 		int y = 0;
-		while (f.ReadLine(s)) {
+		while (std::getline(lines, s)) {
+			if (!s.empty() && (s.back() == '\r')) {
+				s.pop_back();
+			}
+
 			// Skip comment lines
 			if ((s.length() > 0) && (s.at(0) == '#')) {
 				continue;
@@ -115,7 +127,8 @@ public:
 				if (isBrick) {
 					if (pCurrentGroup == NULL) {
 						pCurrentGroup = NewMovingGroup(0, 0, 0, 0);
-						m_groups.push_back(pCurrentGroup);
+						pCurrentGroup->SetUseTree(true);	// bricks never move
+						pCurrentGroup->SetCacheLayer(true);	// drawn as one bitmap until a brick goes
 					}
 
 					if (bitmap) {
@@ -177,6 +190,8 @@ public:
 	}
 
 	bool SS2DInit() {
+		SS2DPrewarmPools(0, 64);	// multiballs
+
 		m_brushBrick = NewResourceBrush(RGB(200, 200, 200));
 		m_brushBrickSlower = NewResourceBrush(RGB(0, 0, 255));
 		m_brushRed = NewResourceBrush(RGB(255, 0, 0));
@@ -201,7 +216,7 @@ public:
 		m_score = 0;
 		m_textScore->SetText(std::to_wstring(m_score).c_str());
 
-		m_balls.push_back(NewMovingCircle(200.0f, 600.0f, m_ballRadius, m_ballStartSpeed, 135, GetDefaultBrush()));
+		m_balls.push_back(SpawnMovingCircle(200.0f, 600.0f, m_ballRadius, m_ballStartSpeed, 135, GetDefaultBrush()));
 
 		GenerateBricks();
 
@@ -284,7 +299,7 @@ public:
 			auto pBall = *it;
 			if (CheckBallHitScreenEdges(pBall)) {	// true means it's off the bottom
 				it = m_balls.erase(it);
-				RemoveShape(pBall, true);
+				Despawn(pBall);
 			}
 			else {
 				++it;
@@ -324,7 +339,7 @@ public:
 			}
 		}
 
-		return __super::SS2DUpdate(tick, mouse, events);
+		return SS2DWorld::SS2DUpdate(tick, mouse, events);
 	}
 
 	void BrickWasHit(Shape* pBrickHit) {
@@ -332,7 +347,7 @@ public:
 		if ((int)pBrickHit->GetUserData() != m_brickNormal) {
 			pBrickHit->SetDirectionInDeg(180);
 			pBrickHit->SetSpeed(2.0F);
-			MovingGroup* pGroup = (MovingGroup *)pBrickHit->GetParent();
+			MovingGroup* pGroup = ShapeCast<MovingGroup>(pBrickHit->GetParent());
 			pGroup->RemoveChild(pBrickHit);
 			QueueShape(pBrickHit);
 		}
@@ -383,31 +398,45 @@ public:
 		bool hit = false;
 		Shape* pBrickHit = NULL;
 
-		for (auto group : m_groups) {
-			std::vector<Shape*> bricksHit;
-			if (group->WillHitShapes(*pBall, bricksHit) > 0) {
+		// Where the ball will be
+		Point2F pos = pBall->GetPos();
+		pBall->MovePos(pos);
+		RectF rBall;
+		pBall->GetBoundingBox(&rBall, pos);
+
+		// Ask the broadphase for the bricks near the ball
+		std::vector<Shape*> nearby;
+		QueryShape(pBall, nearby);
+
+		std::vector<Shape*> bricksHit;
+		for (auto pBrick : nearby) {
+			if (IsBrickInWall(pBrick) && pBrick->HitTest(rBall)) {
+				bricksHit.push_back(pBrick);
+			}
+		}
+
+		if (!bricksHit.empty()) {
+			for (auto pBrick : bricksHit) {
+				if (pBrick->IsActive() && (pBrick->GetSpeed() == 0.0F)) {	// brick is visible and not falling
+					if (pBall->WillBounceOffRectSides(pBrick)) {
+						special = (int)pBrick->GetUserData();
+						hit = true;
+						pBrickHit = pBrick;
+						break;
+					}
+				}
+			}
+
+			if (hit) {
 				for (auto pBrick : bricksHit) {
-					if (pBrick->IsActive() && (pBrick->GetSpeed() == 0.0F)) {	// brick is visible and not falling
-						if (pBall->WillBounceOffRectSides(pBrick)) {
+					if (pBrick->IsActive() && (pBrick->GetSpeed() == 0.0F)) {
+						if (pBall->WillBounceOffRectCorners(pBrick)) {
 							special = (int)pBrick->GetUserData();
-							hit = true;
 							pBrickHit = pBrick;
 							break;
 						}
 					}
 				}
-
-				if (hit) {
-					for (auto pBrick : bricksHit) {
-						if (pBrick->IsActive() && (pBrick->GetSpeed() == 0.0F)) {
-							if (pBall->WillBounceOffRectCorners(pBrick)) {
-								special = (int)pBrick->GetUserData();
-								pBrickHit = pBrick;
-								break;
-							}
-						}
-					}
-				}
 			}
 		}
 
@@ -469,15 +498,12 @@ public:
 						int direction = pBall->GetDirectionInDeg();
 
 						// Add two more balls at this position
-						MovingCircle* pBallNew = new MovingCircle(pos.x, pos.y, m_ballRadius, m_ballStartSpeed, direction + 2, GetDefaultBrush());
-						newBalls.push_back(pBallNew);
-						pBallNew = new MovingCircle(pos.x, pos.y, m_ballRadius, m_ballStartSpeed, direction - 2, GetDefaultBrush());
-						newBalls.push_back(pBallNew);
+						newBalls.push_back(SpawnMovingCircle(pos.x, pos.y, m_ballRadius, m_ballStartSpeed, direction + 2, GetDefaultBrush()));
+						newBalls.push_back(SpawnMovingCircle(pos.x, pos.y, m_ballRadius, m_ballStartSpeed, direction - 2, GetDefaultBrush()));
 					}
 
 					// Add all the newly create balls into the world
 					for (auto pBall : newBalls) {
-						QueueShape(pBall);
 						m_balls.push_back(pBall);
 					}
 				}
@@ -504,8 +530,10 @@ public:
 			return;
 		}
 
-		for (auto pBrick : m_bricks) {
-			if (pBrick->IsActive() && (pBrick->GetSpeed() == 0.0F)) {
+		std::vector<Shape*> nearby;
+		QueryShape(m_playerBullet, nearby);
+		for (auto pBrick : nearby) {
+			if (IsBrickInWall(pBrick) && pBrick->IsActive() && (pBrick->GetSpeed() == 0.0F)) {
 				if (m_playerBullet->HitTestShape(pBrick)) {
 					BrickWasHit(pBrick);
 					ResetBullet();
@@ -514,6 +542,12 @@ public:
 		}
 	}
 
+	// Standing bricks are children of a wall group. Knocked out ones are either
+	// inactive or, if they're falling, moved out to the world.
+	bool IsBrickInWall(Shape* p) {
+		return ShapeCast<MovingGroup>(p->GetParent()) != NULL;
+	}
+
 	void AdjustBallAngle(MovingCircle* pBall) {
 		// The ball travelling too horizontally can be very boring while the player waits for it
 		// to descend so if ever we see this, correct the angle to a steeper one.
@@ -542,7 +576,6 @@ protected:
 	MovingRectangle* m_bat;
 	std::list<MovingCircle*> m_balls;
 	std::vector<Shape*> m_bricks;
-	std::vector<MovingGroup*> m_groups;
 	int m_score;
 
 	FLOAT m_batWidthRequired;
@@ -33,10 +33,17 @@ public:
 
 		void Clear() {
 			m_board.clear();
+			m_tree.Clear();
+			m_proxies.clear();
 		}
 
 		void Set(int row, int col, Shape* p) {
+			Shape* old = Get(row, col);
+			if (old && (old != p)) {
+				TreeRemove(old);
+			}
 			m_board[row][col] = p;
+			Refit(p);
 		}
 
 		Shape* Get(int row, int col) {
@@ -68,14 +75,12 @@ public:
 		}
 
 		bool HitTest(RectF& rect) {
-			for (auto& c : m_board) {
-				for (auto& r : c.second) {
-					if (r.second->HitTest(rect)) {
-						return true;
-					}
-				}
-			}
-			return false;
+			bool ret = false;
+			m_tree.Query(rect, [&](Shape* p) {
+				ret = p->HitTest(rect);
+				return !ret;
+			});
+			return ret;
 		}
 
 		bool MarkMatches() {
@@ -90,6 +95,9 @@ public:
 			if (it == m_board.end())	return NULL;
 			Shape* ret = it->second[col];
 			it->second.erase(col);
+			if (ret) {
+				TreeRemove(ret);
+			}
 			return ret;
 		}
 
@@ -104,8 +112,8 @@ public:
 				}
 
 				RemoveSquare(row, col);
-				Set(row + 1, col, sq);
 				sq->OffsetPos(Point2F(0.0f, c_blockSize));
+				Set(row + 1, col, sq);
 			}
 
 			return ret;
@@ -134,9 +142,10 @@ public:
 			for (auto x : m_board) {
 				for (auto y : x.second) {
 					if (y.second->GetUserData() == 1) {
-						MovingRectangle* p = (MovingRectangle *)y.second;
+						MovingRectangle* p = ShapeCast<MovingRectangle>(y.second);
 						p->OffsetPos(Point2F(0, 0.5f));
 						p->SetHeight(p->GetHeight() - 1.0f);
+						Refit(p);
 						if (p->GetHeight() < 2.0f) {
 							deleteShapes.push_back(RemoveSquareAndDrop((int)(p->GetPos().y / c_blockSize), (int)(p->GetPos().x / c_blockSize)));
 						}
@@ -215,13 +224,40 @@ public:
 			return found;
 		}
 
+	protected:
+		// Squares are also kept in a tree so hit tests don't have to check the whole board
+		void Refit(Shape* p) {
+			RectF r;
+			p->GetBoundingBox(&r, p->GetPos());
+			auto it = m_proxies.find(p);
+			if (it == m_proxies.end()) {
+				m_proxies[p] = m_tree.Insert(r, p);
+			}
+			else {
+				m_tree.Move(it->second, r);
+			}
+		}
+
+		void TreeRemove(Shape* p) {
+			auto it = m_proxies.find(p);
+			if (it != m_proxies.end()) {
+				m_tree.Remove(it->second);
+				m_proxies.erase(it);
+			}
+		}
+
 	protected:
 		std::map<int, std::map<int, Shape*>> m_board;
+		SS2DAABBTree m_tree;
+		std::unordered_map<Shape*, int> m_proxies;
 	};
 
 	ColorsWorld(Notifier& notifier) : 
 		m_notifier(notifier) {
 		SS2DSetScreenSize(w32Size(c_screenWidth, c_screenHeight));
+		SS2DUseCommandList(true);	// dirty rects need it
+		SS2DUseDirtyRects(true);	// only the falling piece moves most frames
+		SS2DUseCulling(true);
 	}
 
 	bool SS2DInit() override {
@@ -237,6 +273,7 @@ public:
 
 	void SS2DDeInit() {
 		m_board.Clear();
+		m_brushes.clear();	// DeInit() deletes them. SS2DInit() asks again.
 	}
 
 	bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) override {
@@ -321,13 +358,13 @@ public:
 			events.pop();
 		}
 
-		return __super::SS2DUpdate(tick, ptMouse, events);
+		return SS2DWorld::SS2DUpdate(tick, ptMouse, events);
 	}
 
 	bool AddToBoard() {
 		// Add the blocks to the board
 		for (auto mr : m_fallingGroup->GetChildren()) {
-			m_board.Set((int)(mr->GetPos().y / c_blockSize), (int)(mr->GetPos().x / c_blockSize), (MovingRectangle*)mr);
+			m_board.Set((int)(mr->GetPos().y / c_blockSize), (int)(mr->GetPos().x / c_blockSize), ShapeCast<MovingRectangle>(mr));
 			QueueShape(mr);
 		}
 
@@ -59,7 +59,7 @@ protected:
 
 	const COLORREF m_gameOverColour = RGB(255, 255, 255);
 
-	const enum class invaderType {
+	enum class invaderType {
 		octopus,
 		crab,
 		squid,
@@ -77,12 +77,18 @@ public:
 		m_tdHitBitmap(100, false)
 	{
 		SS2DSetScreenSize(w32Size(1000, 1080));
+		SS2DUseAtlas(true, L"atlas.txt");	// the whole formation in one sprite batch
+		SS2DUseAsyncLoading(true);	// first frame without waiting for the atlas pages
+		SS2DUseCommandList(true);	// which needs the command list to batch it
+		SS2DUseCulling(true);
 	}
 
 	~InvaderWorld() {
 	}
 
 	bool SS2DInit() {
+		SS2DPrewarmPools(64, 0);	// invader bullets
+
 		// Set up brushes
 		m_brushGreen = NewResourceBrush(RGB(0, 255, 0));
 		m_brushPurple = NewResourceBrush(RGB(255, 0, 255));
@@ -215,6 +221,8 @@ protected:
 			FLOAT divBarrierHeight = m_barrierHeight / m_barrierDividerY;
 
 			m_groupBarriers[i] = NewMovingGroup(step / 2.0f + step * i - m_barrierWidth / 2, m_barrierY, 0, 0);
+			m_groupBarriers[i]->SetUseTree(true);	// barriers only ever lose pieces
+			m_groupBarriers[i]->SetCacheLayer(true);
 			for (int x = 0; x < m_barrierDividerX; x++) {
 				for (int y = 0; y < m_barrierDividerY; y++) {
 					m_groupBarriers[i]->NewMovingRectangle(
@@ -288,13 +296,13 @@ protected:
 			// Replace the bitmap
 			for (auto* p : m_groupInvaders->GetChildren()) {
 				if (p->GetUserData() == (LPARAM)invaderType::squid) {
-					((MovingBitmap*)p)->SetBitmap(m_bitmapSquid[m_frame]);
+					ShapeCast<MovingBitmap>(p)->SetBitmap(m_bitmapSquid[m_frame]);
 				}
 				else if (p->GetUserData() == (LPARAM)invaderType::crab) {
-					((MovingBitmap*)p)->SetBitmap(m_bitmapCrab[m_frame]);
+					ShapeCast<MovingBitmap>(p)->SetBitmap(m_bitmapCrab[m_frame]);
 				}
 				else if (p->GetUserData() == (LPARAM)invaderType::octopus) {
-					((MovingBitmap*)p)->SetBitmap(m_bitmapOctopus[m_frame]);
+					ShapeCast<MovingBitmap>(p)->SetBitmap(m_bitmapOctopus[m_frame]);
 				}
 			}
 			m_frame = m_frame ? 0 : 1;
@@ -336,7 +344,7 @@ protected:
 					if (g->HitTestShapes(m_playerBullet, hits)) {
 						for (auto barrierHit : hits) {
 							g->RemoveChild(barrierHit);
-							delete barrierHit;
+							Shape::Destroy(barrierHit);
 						}
 						m_playerBullet->SetUserData(0);	// Reset the player bullet
 					}
@@ -384,7 +392,7 @@ protected:
 			if ((*it)->IsActive()) {
 				if ((*it)->WillHitBounds(SS2DGetScreenSize()) != Shape::moveResult::ok) {
 					// we're out of bounds
-					RemoveShape(*it, true);
+					Despawn(*it);
 					it = m_invaderBullets.erase(it);	// remove the bullet
 					continue;
 				}
@@ -398,7 +406,7 @@ protected:
 					if (g->HitTestShapes(*it, hits)) {
 						for (auto barrierHit : hits) {
 							g->RemoveChild(barrierHit);
-							delete barrierHit;
+							Shape::Destroy(barrierHit);
 						}
 						hitBarrier = true;
 					}
@@ -406,7 +414,7 @@ protected:
 
 				// If so, destroy the bullet
 				if (hitBarrier) {
-					RemoveShape(*it, true);
+					Despawn(*it);
 					it = m_invaderBullets.erase(it);	// remove the bullet
 					continue;
 				}
@@ -424,7 +432,7 @@ protected:
 					m_tdPlayerReset.SetActive(true);
 					m_player->SetActive(false);
 					m_playerBullet->SetActive(false);
-					RemoveShape(*it, true);
+					Despawn(*it);
 					it = m_invaderBullets.erase(it);	// remove the bullet
 					continue;
 				}
@@ -442,7 +450,7 @@ protected:
 				Point2F ptBullet = inv->GetPos();
 				ptBullet.x += (m_invaderWidth - m_bulletWidth) / 2;
 
-				MovingRectangle* bullet = NewMovingRectangle(
+				MovingRectangle* bullet = SpawnMovingRectangle(
 					ptBullet.x, ptBullet.y, m_bulletWidth, m_bulletHeight, m_invaderbulletSpeed, 180, GetDefaultBrush()
 				);
 
@@ -18,6 +18,9 @@ public:
 	MenuWorld(Notifier& notifier) :
 		m_notifier(notifier)
 	{
+		SS2DUseShapeStore(true);	// lots of shapes - move them in one sweep
+		SS2DUseCommandList(true);	// and draw them in batches by brush
+		SS2DUseCulling(true);
 	}
 
 	~MenuWorld() {
@@ -28,7 +31,7 @@ public:
 			FLOAT speed = w32randf(5.0f, 15.f);
 			DWORD direction = w32rand(0, 359);
 			COLORREF color = RGB(w32rand(0, 256), w32rand(0, 256), w32rand(0, 256));
-			auto br = NewResourceBrush(color);
+			auto br = NewResourceBrush(color, 1.0f, 3);	// 512 brushes at most, however many shapes
 			if (w32rand(1)) {
 				FLOAT width = w32randf(m_minRadius, m_maxRadius);
 				FLOAT height = w32randf(m_minRadius, m_maxRadius);
@@ -73,10 +76,12 @@ public:
 	}
 
 	bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) override {
-		// Check all the shapes in the background
-		for (auto shape : m_movingShapes) {
-			// Bounce the shape off the edge
-			switch (shape->WillHitBounds(SS2DGetScreenSize())) {
+		// Bounce the shapes in the background off the edges (not the menu). Only the ones hitting an edge come back.
+		m_boundsHits.clear();
+		SS2DClassifyBounds(SS2DGetScreenSize(), m_movingShapes, m_boundsHits);
+		for (auto& hit : m_boundsHits) {
+			Shape* shape = hit.first;
+			switch (hit.second) {
 			case Shape::moveResult::hitboundsleft:
 				shape->BounceX();
 				break;
@@ -90,7 +95,10 @@ public:
 				shape->BounceY();
 				break;
 			}
+		}
 
+		// Check all the shapes in the background
+		for (auto shape : m_movingShapes) {
 			// Is the mouse touching it?
 			if (shape->HitTest(ptMouse)) {
 				shape->SetActive(false);
@@ -131,7 +139,7 @@ public:
 			events.pop();
 		}
 
-		return __super::SS2DUpdate(tick, ptMouse, events);
+		return SS2DWorld::SS2DUpdate(tick, ptMouse, events);
 	}
 
 protected:
@@ -161,6 +169,7 @@ protected:
 	MovingRectangle* m_menuBackground;	// transparent box around menu items.
 	std::vector<std::pair<MovingText*, AppMessage>> m_menuitems;	// the menu texts
 	std::vector<Shape*> m_movingShapes;	// moving shapes in the background
+	std::vector<std::pair<Shape*, Shape::moveResult>> m_boundsHits;	// shapes about to hit the screen edge
 
 public:
 	AppMessage m_amRunInvaders;
@@ -1,9 +1,14 @@
 #include <string>
 
 #include <d2dWindow.h>
+#include <SS2DHeadless.h>
+#include <SS2DSoftwareBackend.h>
+#include <SS2DAtlas.h>
+#include <SS2DArchive.h>
 #include <time.h>
 
 #include <WindowSaverExt.h>
+#include <Directory.h>
 #include <Notifier.h>
 
 #include "MenuWorld.h"
@@ -11,8 +16,10 @@
 #include "BreakoutWorld.h"
 #include "ColorsWorld.h"
 #include "BaublesWorld.h"
+#include "Benchmark.h"
 
 #define APPNAME L"w32ld2d"
+#define ARCHIVENAME L"runtime.ss2d"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -74,6 +81,7 @@ protected:
 	}
 
 	bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) override {
+		m_worldActive->SS2DSetInput(SS2DGetInput());
 		return m_worldActive->SS2DUpdate(tick, ptMouse, events);
 	}
 
@@ -82,14 +90,16 @@ protected:
 	}
 
 	void D2DRender() override {
-		D2DClearScreen(m_worldActive->m_colorBackground);
+		if (!m_worldActive->SS2DUsingDirtyRects()) {
+			D2DClearScreen(m_worldActive->m_colorBackground);	// otherwise the world clears what it redraws
+		}
+
+		m_worldActive->D2DRender(m_ess);
 
-		// Draw the fixed aspect rectangle
+		// Draw the fixed aspect rectangle. After the world so its redraws can't wipe it.
 		RectF rectBounds;
 		D2DGetFARRect(&rectBounds);
 		m_ess.m_pRenderTarget->DrawRectangle(rectBounds, m_pBrush);
-
-		m_worldActive->D2DRender(m_ess);
 	}
 
 	void D2DOnResize(const SS2DEssentials& ess) override {
@@ -163,6 +173,110 @@ protected:
 	Notifier m_notifier;	// Notifications between the menu and the games
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// "-bench [ticks]" on the command line runs each world headless instead of
+// showing the window and reports how long each phase took (see Benchmark.h).
+////////////////////////////////////////////////////////////////////////////////
+
+static void ShowBenchmark(size_t ticks) {
+	MessageBox(NULL, RunBenchmark(ticks).c_str(), APPNAME L" benchmark", MB_OK);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// "-atlas" packs the PNGs in the current folder into atlas<n>.png and writes
+// atlas.txt for the worlds' SS2DUseAtlas() to pick up instead of packing at load time.
+////////////////////////////////////////////////////////////////////////////////
+
+static void BuildAtlas() {
+	IWICImagingFactory* pIWICFactory = NULL;
+	HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_IWICImagingFactory, reinterpret_cast<void**>(&pIWICFactory));
+	if (FAILED(hr)) {
+		Window::ReportError(HRESULT_CODE(hr));
+		return;
+	}
+
+	std::vector<std::wstring> files;
+	Directory(L".").GetContents(files, false, true, L"*.png");
+
+	std::vector<SS2DBitmap*> bitmaps;
+	for (auto& f : files) {
+		if (f.compare(0, 5, L"atlas") != 0) {	// not our own output
+			SS2DBitmap* p = new SS2DBitmap(f.c_str());
+			p->LoadPixelsFromFile(pIWICFactory);
+			bitmaps.push_back(p);
+		}
+	}
+
+	SS2DAtlas atlas;
+	size_t packed = atlas.Build(bitmaps);
+	hr = atlas.Save(pIWICFactory, L"atlas");
+
+	wchar_t report[128];
+	swprintf_s(report, L"%zu of %zu bitmaps packed into %zu page(s)%s", packed, bitmaps.size(), atlas.GetPageCount(), FAILED(hr) ? L" - save failed" : L"");
+	MessageBox(NULL, report, APPNAME L" atlas", MB_OK);
+
+	for (auto p : bitmaps) {
+		delete p;
+	}
+	SafeRelease(&pIWICFactory);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// "-pack" puts the files in the current folder into runtime.ss2d, which is
+// used instead of them when it's there. Images go in decoded, ready to upload.
+////////////////////////////////////////////////////////////////////////////////
+
+static bool IsPackable(const std::wstring& file) {
+	size_t dot = file.find_last_of(L'.');
+	std::wstring ext = (dot == std::wstring::npos) ? L"" : file.substr(dot);
+	for (auto& c : ext) {
+		c = (wchar_t)towlower(c);
+	}
+	return (file != ARCHIVENAME) && (ext != L".exe") && (ext != L".dll") && (ext != L".pdb") && (ext != L".ilk") && (ext != L".zip");
+}
+
+static void BuildArchive() {
+	IWICImagingFactory* pIWICFactory = NULL;
+	HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_IWICImagingFactory, reinterpret_cast<void**>(&pIWICFactory));
+	if (FAILED(hr)) {
+		Window::ReportError(HRESULT_CODE(hr));
+		return;
+	}
+
+	std::vector<std::wstring> files;
+	Directory(L".").GetContents(files, false, true);
+
+	SS2DArchiveWriter writer;
+	size_t images = 0;
+	for (auto& f : files) {
+		if (!IsPackable(f)) {
+			continue;
+		}
+
+		std::vector<uint32_t> pixels;
+		UINT width = 0, height = 0;
+		size_t dot = f.find_last_of(L'.');
+		bool image = (dot != std::wstring::npos) && ((_wcsicmp(f.c_str() + dot, L".png") == 0) || (_wcsicmp(f.c_str() + dot, L".bmp") == 0));
+		if (image && SUCCEEDED(SS2DBitmap::DecodeFile(pIWICFactory, f.c_str(), &width, &height, pixels))) {
+			writer.AddPixels(f.c_str(), width, height, pixels.data());
+			images++;
+			continue;
+		}
+
+		std::string data;
+		if (SS2DArchive::ReadAsset(f.c_str(), data)) {	// nothing's mounted yet so it's the file
+			writer.AddFile(f.c_str(), data.data(), data.size());
+		}
+	}
+	hr = writer.Save(ARCHIVENAME);
+
+	wchar_t report[128];
+	swprintf_s(report, L"%zu files (%zu images decoded) packed into " ARCHIVENAME L"%s", writer.GetCount(), images, FAILED(hr) ? L" - save failed" : L"");
+	MessageBox(NULL, report, APPNAME L" pack", MB_OK);
+
+	SafeRelease(&pIWICFactory);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Main routine. Init the library, create a window and run the program.
 ////////////////////////////////////////////////////////////////////////////////
@@ -176,6 +290,26 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 	if (SUCCEEDED(CoInitialize(NULL))) {
 		Window::LibInit(hInstance);	// Initialise the library
 
+		if (wcsncmp(lpCmdLine, L"-atlas", 6) == 0) {
+			BuildAtlas();
+			CoUninitialize();
+			return 0;
+		}
+		if (wcsncmp(lpCmdLine, L"-pack", 5) == 0) {
+			BuildArchive();
+			CoUninitialize();
+			return 0;
+		}
+
+		SS2DArchive::Mounted().Open(ARCHIVENAME);	// loose files if it isn't there
+
+		if (wcsncmp(lpCmdLine, L"-bench", 6) == 0) {
+			int ticks = _wtoi(lpCmdLine + 6);
+			ShowBenchmark((ticks > 0) ? ticks : 5000);
+			CoUninitialize();
+			return 0;
+		}
+
 		MainWindow w;	// Our custom Window (defined above)
 
 		// Create and show it
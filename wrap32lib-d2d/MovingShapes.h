@@ -1,16 +1,27 @@
 #pragma once
 
 #include "Shape.h"
+#include "SS2DAABBTree.h"
+#include "SS2DRenderBackend.h"
+#include "SS2DCommandList.h"
+#include "SS2DText.h"
+
+#include <unordered_map>
 
 class MovingCircle : public Shape
 {
 public:
+	static const type Type = type::circle;
+	type GetType() const override { return Type; }
+	bool IsType(type t) const override { return t == Type || Shape::IsType(t); }
+
 	MovingCircle(FLOAT x, FLOAT y, FLOAT radius, FLOAT speed, int dir, SS2DBrush* brush, LPARAM userdata = 0) :
 		Shape(x, y, speed, dir, brush, userdata), m_fRadius(radius) {}
 
 	bool HitTest(Point2F pos) override {
-		float distSq = (pos.x - m_pos.x) * (pos.x - m_pos.x) +
-			(pos.y - m_pos.y) * (pos.y - m_pos.y);
+		Point2F posThis = GetLocalPos();
+		float distSq = (pos.x - posThis.x) * (pos.x - posThis.x) +
+			(pos.y - posThis.y) * (pos.y - posThis.y);
 		return distSq <= m_fRadius * m_fRadius;
 	}
 
@@ -23,8 +34,8 @@ public:
 		ess.m_rsFAR.ScaleNoOffset(&r);
 		e.radiusX = e.radiusY = r;
 
-		ess.m_pRenderTarget->FillEllipse(&e, *GetBrush());
-		__super::Draw(ess);
+		ess.m_pBackend->FillEllipse(e, GetBrush());
+		Shape::Draw(ess);
 	}
 
 	void GetBoundingBox(RectF* p, const Point2F& pos) const {
@@ -34,84 +45,110 @@ public:
 		p->bottom = pos.y + m_fRadius - 1;
 	}
 
-	// Some bounce code for rectangle - sides and corners. Not quite right but close.
-	bool WillBounceOffRectSides(Shape* shape) {
-		Point2F pos = shape->GetPos();	// Get where shape is going to be
-		shape->MovePos(pos);
-		RectF r;
-		shape->GetBoundingBox(&r, pos);
-
-		pos = GetPos();	// where we are
-		MovePos(pos);	// where we will be
-
-		// Check we're anywhere near it first
-		if ((pos.x + m_fRadius < r.left) || (pos.x - m_fRadius > r.right) ||
-			(pos.y + m_fRadius < r.top) || (pos.y - m_fRadius > r.bottom)) {
+	// Result of sweeping a circle along its step against a rectangle
+	class SweepHit {
+	public:
+		FLOAT t;			// Fraction of the step (0 - 1) where contact starts
+		Point2F normal;		// Points out of the rectangle at the contact
+		Point2F contact;	// Corner touched (corner hits only)
+	};
+
+	// Time of impact with the sides of r. The zones are the bands of width radius just outside each
+	// side and only count if the circle is heading into the rectangle. Left/right win ties with top/bottom.
+	static bool SweepRectSides(const Point2F& pos, const Point2F& step, FLOAT radius, const RectF& r, SweepHit* hit) {
+		bool ret = false;
+		hit->t = 2.0f;
+		if (step.x > 0.0f)	ret |= SweepZone(pos, step, r.left - radius, r.top, r.left, r.bottom, Point2F(-1.0f, 0.0f), hit);
+		if (step.x < 0.0f)	ret |= SweepZone(pos, step, r.right, r.top, r.right + radius, r.bottom, Point2F(1.0f, 0.0f), hit);
+		if (step.y > 0.0f)	ret |= SweepZone(pos, step, r.left, r.top - radius, r.right, r.top, Point2F(0.0f, -1.0f), hit);
+		if (step.y < 0.0f)	ret |= SweepZone(pos, step, r.left, r.bottom, r.right, r.bottom + radius, Point2F(0.0f, 1.0f), hit);
+		return ret;
+	}
+
+	// Time of impact with the corners of r i.e. when the centre first comes within radius of one
+	static bool SweepRectCorners(const Point2F& pos, const Point2F& step, FLOAT radius, const RectF& r, SweepHit* hit) {
+		bool ret = false;
+		hit->t = 2.0f;
+
+		const Point2F corners[4] = {
+			Point2F(r.left, r.top), Point2F(r.right, r.top), Point2F(r.left, r.bottom), Point2F(r.right, r.bottom)
+		};
+
+		FLOAT a = step.x * step.x + step.y * step.y;
+		if (a == 0.0f) {
 			return false;
 		}
 
-		float endlen = sqrt(m_cacheStep.lengthsq());
-		float len = 0.0;
-		while (len < endlen) {	// Check in radius/2 steps
-			len += 1.0;
-
-			pos = GetPos();		// where we are
-			MovePos(pos, len);	// where we will be
+		for (const Point2F& corner : corners) {
+			// |pos + step * t - corner|^2 = radius^2
+			FLOAT fx = pos.x - corner.x;
+			FLOAT fy = pos.y - corner.y;
+			FLOAT b = fx * step.x + fy * step.y;	// half b
+			if (b >= 0.0f) {
+				continue;	// heading away from this corner
+			}
 
-			// Check left and right bounce zone
-			if (WillHitRectX(r, pos)) {
-				SetPos(pos);
-				BounceX();
-				return true;
+			FLOAT c = fx * fx + fy * fy - radius * radius;
+			FLOAT t;
+			if (c <= 0.0f) {
+				t = 0.0f;	// already touching
+			}
+			else {
+				FLOAT disc = b * b - a * c;
+				if (disc < 0.0f) {
+					continue;
+				}
+				t = (-b - sqrt(disc)) / a;
 			}
 
-			// Check top and bottom bounce zone
-			if (WillHitRectY(r, pos)) {
-				SetPos(pos);
-				BounceY();
-				return true;
+			if ((t <= 1.0f) && (t < hit->t)) {
+				hit->t = t;
+				hit->contact = corner;
+				FLOAT nx = pos.x + step.x * t - corner.x;
+				FLOAT ny = pos.y + step.y * t - corner.y;
+				FLOAT len = sqrt(nx * nx + ny * ny);
+				hit->normal = (len > 0.0f) ? Point2F(nx / len, ny / len) : Point2F();
+				ret = true;
 			}
 		}
-
-		return false;
+		return ret;
 	}
 
-	bool WillBounceOffRectCorners(Shape* shape) {
-		Point2F pos = shape->GetPos();
-		shape->MovePos(pos);
+	// Bounce off the sides of a rectangle. Moves to the point of contact and bounces.
+	bool WillBounceOffRectSides(Shape* shape) {
 		RectF r;
-		shape->GetBoundingBox(&r, pos);
+		Point2F pos, step;
+		GetSweep(shape, &r, &pos, &step);
 
-		pos = GetPos();	// where we are
-		MovePos(pos);	// where we will be
-
-		// Check we're anywhere near it first
-		if ((pos.x + m_fRadius < r.left) || (pos.x - m_fRadius > r.right) ||
-			(pos.y + m_fRadius < r.top) || (pos.y - m_fRadius > r.bottom)) {
+		SweepHit hit;
+		if (!SweepRectSides(pos, step, m_fRadius, r, &hit)) {
 			return false;
 		}
 
-		double radsq = m_fRadius * m_fRadius;
-		std::vector<Point2F> corners;
-		r.GetCorners(corners);
+		SetPos(Point2F(pos.x + step.x * hit.t, pos.y + step.y * hit.t));
+		if (hit.normal.x != 0.0f) {
+			BounceX();
+		}
+		else {
+			BounceY();
+		}
+		return true;
+	}
 
-		float endlensq = m_cacheStep.lengthsq();
-		float lensq = 0.0;
-		while (lensq < endlensq) {	// Check in radius/2 steps
-			lensq += 1.0;
-			MovePos(pos, lensq);	// where we will be
+	// Bounce off the corners of a rectangle. Moves to the point of contact and deflects off the corner.
+	bool WillBounceOffRectCorners(Shape* shape) {
+		RectF r;
+		Point2F pos, step;
+		GetSweep(shape, &r, &pos, &step);
 
-			// Check all 4 corners
-			for (auto& corner : corners) {
-				if (pos.DistanceToSq(corner) < radsq - 0.1F) {
-					SetPos(pos);
-					BounceOffPoint(corner);
-					return true;
-				}
-			}
+		SweepHit hit;
+		if (!SweepRectCorners(pos, step, m_fRadius, r, &hit)) {
+			return false;
 		}
 
-		return false;
+		SetPos(Point2F(pos.x + step.x * hit.t, pos.y + step.y * hit.t));
+		BounceOffPoint(hit.contact);
+		return true;
 	}
 
 	bool HitTestShape(MovingCircle* rhs) {
@@ -125,34 +162,51 @@ protected:
 	void BounceOffPoint(const Point2F& pt) {
 		// Gradient between pt and direction
 		double direction = m_cacheStep.anglerad();
-		double touch = pt.angleradTo(m_pos);
+		double touch = pt.angleradTo(GetLocalPos());
 		double deflection = M_PI - (direction - touch) * 2;
 		m_direction += deflection;
 		UpdateCache();
 	}
 
-	bool WillHitRectX(const RectF& r, const Point2F& pos) {
-		if ((pos.y >= r.top) && (pos.y <= r.bottom)) {
-			if ((pos.x >= r.right) && (pos.x - m_fRadius <= r.right)) {
-				return true;
-			}
-			if ((pos.x <= r.left) && (pos.x + m_fRadius >= r.left)) {
-				return true;
-			}
+	// Where the shape will be and where we are now and our step for this frame
+	void GetSweep(Shape* shape, RectF* r, Point2F* pos, Point2F* step) {
+		Point2F posShape = shape->GetPos();
+		shape->MovePos(posShape);
+		shape->GetBoundingBox(r, posShape);
+
+		*pos = GetPos();
+		*step = Point2F();
+		MovePos(*step);
+	}
+
+	// Earliest entry into the zone (x0, y0) - (x1, y1) along the step. Slab test on each axis.
+	static bool SweepZone(const Point2F& pos, const Point2F& step, FLOAT x0, FLOAT y0, FLOAT x1, FLOAT y1, const Point2F& normal, SweepHit* hit) {
+		FLOAT t0 = 0.0f, t1 = 1.0f;
+		if (!Slab(pos.x, step.x, x0, x1, &t0, &t1) || !Slab(pos.y, step.y, y0, y1, &t0, &t1)) {
+			return false;
+		}
+
+		if (t0 < hit->t) {
+			hit->t = t0;
+			hit->normal = normal;
+			return true;
 		}
 		return false;
 	}
 
-	bool WillHitRectY(const RectF& r, const Point2F& pos) {
-		if ((pos.x >= r.left) && (pos.x <= r.right)) {
-			if ((pos.y >= r.bottom) && (pos.y - m_fRadius <= r.bottom)) {
-				return true;
-			}
-			if ((pos.y <= r.top) && (pos.y + m_fRadius >= r.top)) {
-				return true;
-			}
+	static bool Slab(FLOAT p, FLOAT d, FLOAT lo, FLOAT hi, FLOAT* t0, FLOAT* t1) {
+		if (d == 0.0f) {
+			return (p >= lo) && (p <= hi);
 		}
-		return false;
+
+		FLOAT a = (lo - p) / d;
+		FLOAT b = (hi - p) / d;
+		if (a > b) {
+			std::swap(a, b);
+		}
+		if (a > *t0)	*t0 = a;
+		if (b < *t1)	*t1 = b;
+		return *t0 <= *t1;
 	}
 
 protected:
@@ -162,6 +216,10 @@ protected:
 class MovingRectangle : public Shape
 {
 public:
+	static const type Type = type::rectangle;
+	type GetType() const override { return Type; }
+	bool IsType(type t) const override { return t == Type || Shape::IsType(t); }
+
 	MovingRectangle(FLOAT x, FLOAT y, FLOAT width, FLOAT height, FLOAT speed, int dir, SS2DBrush* brush, LPARAM userdata = 0) :
 		Shape(x, y, speed, dir, brush, userdata), m_fWidth(width), m_fHeight(height)
 	{
@@ -170,13 +228,14 @@ public:
 	void SetSize(FLOAT width, FLOAT height) {
 		m_fWidth = width;
 		m_fHeight = height;
+		SizeChanged();
 	}
 
 	FLOAT GetWidth() { return m_fWidth; }
 	FLOAT GetHeight() { return m_fHeight; }
 
-	void SetWidth(FLOAT f) { m_fWidth = f; }
-	void SetHeight(FLOAT f) { m_fHeight = f; }
+	void SetWidth(FLOAT f) { m_fWidth = f; SizeChanged(); }
+	void SetHeight(FLOAT f) { m_fHeight = f; SizeChanged(); }
 
 	void Draw(const SS2DEssentials& ess, Point2F pos) override {
 		FLOAT fWidth = m_fWidth;
@@ -190,8 +249,8 @@ public:
 		r.right = pos.x + fWidth;
 		r.top = pos.y;
 		r.bottom = pos.y + fHeight;
-		ess.m_pRenderTarget->FillRectangle(&r, *GetBrush());
-		__super::Draw(ess);
+		ess.m_pBackend->FillRectangle(r, GetBrush());
+		Shape::Draw(ess);
 	}
 
 	void Draw(const SS2DEssentials& ess) override {
@@ -213,6 +272,10 @@ protected:
 class MovingBitmap : public Shape
 {
 public:
+	static const type Type = type::bitmap;
+	type GetType() const override { return Type; }
+	bool IsType(type t) const override { return t == Type || Shape::IsType(t); }
+
 	MovingBitmap(SS2DBitmap* bitmap, FLOAT x, FLOAT y, FLOAT width, FLOAT height, FLOAT speed, int dir, FLOAT opacity = 1.0f, LPARAM userdata = 0) :
 		m_bitmap(bitmap), Shape(x, y, speed, dir, 0, userdata), m_fWidth(width), m_fHeight(height), m_opacity(opacity) {
 	}
@@ -221,6 +284,9 @@ public:
 		m_bitmap = bitmap;
 	}
 
+	// Drawn as a grey box (SS2DEssentials::m_pBrushLoading) until it's decoded
+	bool IsLoading() const { return m_bitmap->IsLoading(); }
+
 	void Draw(const SS2DEssentials& ess) override {
 		Point2F pos = GetPos();
 		FLOAT fWidth = m_fWidth;
@@ -234,11 +300,16 @@ public:
 		r.right = pos.x + fWidth;
 		r.top = pos.y;
 		r.bottom = pos.y + fHeight;
-		m_bitmap->Render(ess.m_pRenderTarget, r, m_opacity);
+		if (!m_bitmap->IsLoading()) {
+			ess.m_pBackend->DrawBitmap(m_bitmap, r, m_opacity);
+		}
+		else if (ess.m_pBrushLoading) {
+			ess.m_pBackend->FillRectangle(r, ess.m_pBrushLoading);
+		}
 		if (ess.m_ss2dFlags & SS2D_SHOW_BITMAP_BOUNDS) {
-			ess.m_pRenderTarget->DrawRectangle(&r, *GetBrush());
+			ess.m_pBackend->DrawRectangle(r, GetBrush());
 		}
-		__super::Draw(ess);
+		Shape::Draw(ess);
 	}
 
 	void GetBoundingBox(RectF* p, const Point2F& pos) const {
@@ -257,6 +328,10 @@ protected:
 
 class MovingText : public Shape {
 public:
+	static const type Type = type::text;
+	type GetType() const override { return Type; }
+	bool IsType(type t) const override { return t == Type || Shape::IsType(t); }
+
 	MovingText(LPCWSTR wsz, FLOAT x, FLOAT y, FLOAT width, FLOAT height, FLOAT speed, int dir, DWRITE_TEXT_ALIGNMENT ta, SS2DBrush* brush, LPARAM userdata = 0) :
 		m_text(wsz),
 		Shape(x, y, speed, dir, brush, userdata),
@@ -267,31 +342,26 @@ public:
 	}
 
 	void SS2DCreateResources(const SS2DEssentials& ess) override {
+		if (!ess.m_pDWriteFactory || !ess.m_pTextFormats) {	// headless
+			Shape::SS2DCreateResources(ess);
+			return;
+		}
+
+		// Shared with every other bit of text this size
 		FLOAT fHeight = m_fHeight;
 		ess.m_rsFAR.ScaleNoOffset(&fHeight);
-		ess.m_pDWriteFactory->CreateTextFormat(
-			L"Arial",
-			NULL,
-			DWRITE_FONT_WEIGHT_REGULAR,
-			DWRITE_FONT_STYLE_NORMAL,
-			DWRITE_FONT_STRETCH_NORMAL,
-			fHeight,
-			L"en-us",
-			&m_pWTF
-		);
-
-		m_pWTF->SetTextAlignment(m_ta);
+		m_pWTF = ess.m_pTextFormats->Get(ess.m_pDWriteFactory, L"Arial", fHeight, DWRITE_FONT_WEIGHT_REGULAR, m_ta);
 
-		__super::SS2DCreateResources(ess);
+		Shape::SS2DCreateResources(ess);
 	}
 
 	void SS2DDiscardResources() override {
-		SafeRelease(&m_pWTF);
-		__super::SS2DDiscardResources();
+		m_pWTF = NULL;	// borrowed from SS2DEssentials::m_pTextFormats
+		Shape::SS2DDiscardResources();
 	}
 
 	void SS2DOnResize(const SS2DEssentials& ess) override {
-		SS2DDiscardResources();	// destroy the text so it gets recreated at the correct size next frame
+		SS2DDiscardResources();	// pick up the format for the new size
 		SS2DCreateResources(ess);
 	}
 
@@ -312,8 +382,8 @@ public:
 		r.right = pos.x + fWidth;
 		r.top = pos.y;
 		r.bottom = pos.y + fHeight;
-		ess.m_pRenderTarget->DrawTextW(m_text.c_str(), (UINT32)m_text.length(), m_pWTF, r, *m_pBrush);
-		__super::Draw(ess);
+		ess.m_pBackend->DrawString(m_text, m_pWTF, m_ta, r, m_pBrush);
+		Shape::Draw(ess);
 	}
 
 	virtual void GetBoundingBox(RectF* pRect, const Point2F& pos) const {
@@ -333,17 +403,68 @@ protected:
 
 class MovingGroup : public MovingRectangle {
 public:
+	static const type Type = type::group;
+	type GetType() const override { return Type; }
+	bool IsType(type t) const override { return t == Type || MovingRectangle::IsType(t); }
+
 	// Set width/height to !0 to debug where the shape is
 	MovingGroup() :
-		MovingRectangle(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, NULL, 0)
+		MovingRectangle(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, NULL, 0),
+		m_useTree(false), m_shifting(false),
+		m_cacheLayer(false), m_layer(L""), m_layerDirty(true), m_layerScale(0.0f)
 	{
 	}
 
 	MovingGroup(FLOAT x, FLOAT y, FLOAT speed, int dir, LPARAM userdata = 0) :
-		MovingRectangle(x, y, 0.0f, 0.0f, speed, dir, NULL, userdata)
+		MovingRectangle(x, y, 0.0f, 0.0f, speed, dir, NULL, userdata),
+		m_useTree(false), m_shifting(false),
+		m_cacheLayer(false), m_layer(L""), m_layerDirty(true), m_layerScale(0.0f)
 	{
 	}
 
+	// Index the children in an AABB tree. For big groups whose children rarely move (bricks, barriers)
+	// so hit tests and bounds don't have to look at every child.
+	void SetUseTree(bool b) {
+		m_tree.Clear();
+		m_treeProxies.clear();
+		m_useTree = b;
+		if (m_useTree) {
+			for (auto c : GetChildren()) {
+				TreeInsert(c);
+			}
+		}
+		m_childHasMoved = true;
+	}
+
+	bool UsingTree() const { return m_useTree; }
+
+	// Render the children once into a bitmap (a layer) and draw that every frame instead.
+	// It's rendered again when a child is added, removed, moved or (de)activated, or the
+	// target is resized, and every frame while a bitmap in it is still loading. For big groups
+	// that rarely change (bricks, barriers). Call InvalidateLayer() after changing how a child
+	// looks some other way (e.g. its brush).
+	void SetCacheLayer(bool b) {
+		m_cacheLayer = b;
+		m_layer.Clear();
+		m_layerDirty = true;
+	}
+
+	bool CachingLayer() const { return m_cacheLayer; }
+	void InvalidateLayer() { m_layerDirty = true; }
+
+	void ChildHasMoved(Shape* child = NULL) override {
+		MovingRectangle::ChildHasMoved(child);
+		if (!m_shifting) {
+			m_layerDirty = true;
+		}
+		if (m_useTree && child && !m_shifting) {
+			auto it = m_treeProxies.find(child);
+			if (it != m_treeProxies.end()) {
+				m_tree.Move(it->second, GetChildBounds(child));
+			}
+		}
+	}
+
 	MovingRectangle* NewMovingRectangle(FLOAT x, FLOAT y, FLOAT width, FLOAT height, FLOAT speed, int dir, SS2DBrush* brush, LPARAM userdata = 0, bool active = true) {
 		MovingRectangle* p = new MovingRectangle(x, y, width, height, speed, dir, brush, userdata);
 		AddChild(p);
@@ -363,15 +484,19 @@ public:
 	}
 
 	virtual void SS2DDiscardResources() {
-		for (auto c : m_children) {
+		for (auto c : GetChildren()) {
 			c->SS2DDiscardResources();
 		}
+		m_layer.Clear();
+		m_layerDirty = true;
 	}
 
 	void DeleteAllChildren() {
-		for (auto c : m_children)
-			delete c;
+		for (auto c : GetChildren())
+			Destroy(c);
 		m_children.clear();
+		m_tree.Clear();
+		m_treeProxies.clear();
 	}
 
 	void UpdateBounds() {
@@ -381,24 +506,33 @@ public:
 		}
 
 		RectF rChildren;
-
-		RectF r;
-		for (auto c : GetChildren()) {
-			c->GetBoundingBox(&r, c->GetPos(false));
-			if (rChildren.IsEmpty()) {
-				rChildren = r;
-			}
-			else {
-				rChildren.UnionRect(r);
+		if (m_useTree) {
+			m_tree.GetBounds(&rChildren);	// the tree keeps the union up to date
+		}
+		else {
+			RectF r;
+			for (auto c : GetChildren()) {
+				c->GetBoundingBox(&r, c->GetPos(false));
+				if (rChildren.IsEmpty()) {
+					rChildren = r;
+				}
+				else {
+					rChildren.UnionRect(r);
+				}
 			}
 		}
 		Point2F ptOffset(Point2F(rChildren.left, rChildren.top));
 		if (!ptOffset.Empty()) {
 			OffsetPos(ptOffset);
 			ptOffset = Point2F(-rChildren.left, -rChildren.top);
-			for (auto c : m_children) {
+			m_shifting = true;	// everything moves together so the tree can be shifted in one go
+			for (auto c : GetChildren()) {
 				c->OffsetPos(ptOffset);	// move everything back
 			}
+			m_shifting = false;
+			if (m_useTree) {
+				m_tree.ShiftOrigin(ptOffset);
+			}
 		}
 		SetWidth(rChildren.Width());
 		SetHeight(rChildren.Height());
@@ -418,19 +552,32 @@ public:
 			r.right = pos.x + fWidth;
 			r.top = pos.y;
 			r.bottom = pos.y + fHeight;
-			ess.m_pRenderTarget->DrawRectangle(&r, *GetBrush());
+			ess.m_pBackend->DrawRectangle(r, GetBrush());
+		}
+		if (m_cacheLayer) {
+			DrawLayer(ess);
+		}
+		else {
+			Shape::Draw(ess);
 		}
-		Shape::Draw(ess);
 	}
 
+	bool InView(const RectF& rView) override {
+		RectF rChildren;
+		GetChildrenBounds(&rChildren);
+		return rChildren.hitTest(rView);
+	}
+
+	bool BoundsHoldChildren() const override { return true; }
+
 	moveResult WillHitBounds(const RectF& rBounds) {
 		UpdateBounds();
-		return __super::WillHitBounds(rBounds, GetPos());
+		return MovingRectangle::WillHitBounds(rBounds, GetPos());
 	}
 
 	moveResult WillHitBounds(const w32Size& screenSize) {
 		UpdateBounds();
-		return __super::WillHitBounds(screenSize, GetPos());
+		return MovingRectangle::WillHitBounds(screenSize, GetPos());
 	}
 
 	Shape* HitTestShape(Shape* shape) {
@@ -445,6 +592,17 @@ public:
 		if (!rThis.hitTest(rShape))
 			return NULL;
 
+		if (m_useTree) {
+			Shape* ret = NULL;	// the first hit in child order, as the scan below would find
+			m_tree.Query(ToLocal(rShape), [&](Shape* c) {
+				if (c->IsActive() && c->HitTest(rShape) && (!ret || (c->GetChildIndex() < ret->GetChildIndex()))) {
+					ret = c;
+				}
+				return true;
+			});
+			return ret;
+		}
+
 		for (auto c : GetChildren()) {
 			if (c->IsActive() && c->HitTest(rShape)) {
 				return c;
@@ -466,6 +624,17 @@ public:
 			return 0;
 
 		int count = 0;
+		if (m_useTree) {
+			m_tree.Query(ToLocal(rShape), [&](Shape* c) {
+				if (c->IsActive() && c->HitTest(rShape)) {
+					ret.push_back(c);
+					count++;
+				}
+				return true;
+			});
+			return count;
+		}
+
 		for (auto c : GetChildren()) {
 			if (c->IsActive() && c->HitTest(rShape)) {
 				ret.push_back(c);
@@ -493,6 +662,17 @@ public:
 			return 0;
 
 		int count = 0;
+		if (m_useTree) {
+			m_tree.Query(ToLocal(rShape), [&](Shape* c) {
+				if (c->IsActive() && c->HitTest(rShape)) {
+					ret.push_back(c);
+					count++;
+				}
+				return true;
+			});
+			return count;
+		}
+
 		for (auto c : GetChildren()) {
 			if (c->IsActive()) {
 				pos = c->GetPos();
@@ -505,4 +685,124 @@ public:
 		}
 		return count;
 	}
+
+protected:
+	void ChildAdded(Shape* p) override {
+		if (m_useTree) {
+			TreeInsert(p);
+		}
+		m_layerDirty = true;
+	}
+
+	void ChildRemoved(Shape* p) override {
+		m_layerDirty = true;
+		auto it = m_treeProxies.find(p);
+		if (it != m_treeProxies.end()) {
+			m_tree.Remove(it->second);
+			m_treeProxies.erase(it);
+		}
+	}
+
+	void TreeInsert(Shape* c) {
+		m_treeProxies[c] = m_tree.Insert(GetChildBounds(c), c);
+	}
+
+	// Tree entries are relative to the group
+	static RectF GetChildBounds(Shape* c) {
+		RectF r;
+		c->GetBoundingBox(&r, c->GetPos(false));
+		return r;
+	}
+
+	// Where the children are in the world. Worked out in place rather than with UpdateBounds()
+	// so drawing doesn't shift positions.
+	void GetChildrenBounds(RectF* p) {
+		p->SetEmpty();
+		if (m_useTree) {
+			m_tree.GetBounds(p);
+		}
+		else {
+			RectF r;
+			for (auto c : GetChildren()) {
+				c->GetBoundingBox(&r, c->GetPos(false));
+				if (p->IsEmpty()) {
+					*p = r;
+				}
+				else {
+					p->UnionRect(r);
+				}
+			}
+		}
+		p->Offset(GetPos());
+	}
+
+	// Draw the layer, rendering it first if it's out of date. The layer covers the children's
+	// bounds on the target, out to whole pixels so they land on the same pixels as they would
+	// drawn directly.
+	void DrawLayer(const SS2DEssentials& ess) {
+		RectF r;
+		GetChildrenBounds(&r);
+		FLOAT unit = 1.0f;
+		ess.m_rsFAR.Scale(&r);
+		ess.m_rsFAR.ScaleNoOffset(&unit);
+		r.left = floorf(r.left) - 1;			// a pixel all round for anti-aliasing
+		r.top = floorf(r.top) - 1;
+		r.right = ceilf(r.right + unit) + 1;	// and bounding boxes stop a unit short
+		r.bottom = ceilf(r.bottom + unit) + 1;
+		if ((r.right <= r.left) || (r.bottom <= r.top)) {
+			return;
+		}
+
+		UINT width = (UINT)(r.right - r.left);
+		UINT height = (UINT)(r.bottom - r.top);
+		w32Size size = m_layer.GetSize();
+		if (m_layerDirty || (ess.m_rsFAR.GetScaleX() != m_layerScale) || (size.cx != (long)width) || (size.cy != (long)height)) {
+			SS2DCommandList children;
+			SS2DEssentials essLayer = ess;
+			essLayer.m_pBackend = &children;
+			essLayer.m_cull = false;
+			Shape::Draw(essLayer);
+			children.Offset(-r.left, -r.top);
+
+			if (!ess.m_pBackend->RenderLayer(&m_layer, width, height, [&](SS2DRenderBackend& layer) { children.Replay(layer); })) {
+				Shape::Draw(ess);	// no layers here
+				return;
+			}
+			m_layerDirty = IsLoading(this);	// it's got the loading brush in it, so not for long
+			m_layerScale = ess.m_rsFAR.GetScaleX();
+		}
+		ess.m_pBackend->DrawBitmap(&m_layer, r, 1.0f);
+	}
+
+	// Is a bitmap p draws (itself or any active child down) still loading?
+	static bool IsLoading(Shape* p) {
+		MovingBitmap* pBitmap = ShapeCast<MovingBitmap>(p);
+		if (pBitmap && pBitmap->IsLoading()) {
+			return true;
+		}
+		for (auto c : p->GetChildren()) {
+			if (c->IsActive() && IsLoading(c)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	RectF ToLocal(const RectF& r) {
+		Point2F pos = GetPos();
+		RectF ret = r;
+		ret.Offset(Point2F(-pos.x, -pos.y));
+		return ret;
+	}
+
+protected:
+	bool m_useTree;
+	bool m_shifting;
+	SS2DAABBTree m_tree;
+	std::unordered_map<Shape*, int> m_treeProxies;
+
+	bool m_cacheLayer;
+	SS2DBitmap m_layer;		// SetCacheLayer()
+	bool m_layerDirty;
+	FLOAT m_layerScale;		// Target scale it was rendered at
 };
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <vector>
+
+#include "d2dtypes.h"
+
+class Shape;
+
+////////////////////////////////////////////////////////////////////////
+// SS2DAABBTree is a dynamic bounding volume hierarchy for shapes that
+// rarely move (bricks, barriers, board tiles).
+//
+// Leaves hold a fat box (the shape's bounds grown by a margin) so small
+// moves don't restructure the tree. Each node also tracks the tight union
+// of its leaves so the root gives exact bounds for everything in the tree.
+// Insert, remove and refit are O(log n) and the tree is kept balanced with
+// AVL style rotations.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DAABBTree
+{
+public:
+	static const int NullNode = -1;
+
+	SS2DAABBTree(FLOAT margin = 4.0f) : m_root(NullNode), m_freeList(NullNode), m_margin(margin), m_count(0) {}
+
+	int Size() const { return m_count; }
+	bool IsEmpty() const { return m_root == NullNode; }
+
+	void Clear() {
+		m_nodes.clear();
+		m_root = NullNode;
+		m_freeList = NullNode;
+		m_count = 0;
+	}
+
+	// Add a shape with its bounds. Returns the proxy used to move or remove it.
+	int Insert(const RectF& r, Shape* p) {
+		int proxy = AllocateNode();
+		Node& n = m_nodes[proxy];
+		n.m_tight = r;
+		n.m_fat = Fatten(r);
+		n.m_shape = p;
+		n.m_height = 0;
+		InsertLeaf(proxy);
+		m_count++;
+		return proxy;
+	}
+
+	void Remove(int proxy) {
+		RemoveLeaf(proxy);
+		FreeNode(proxy);
+		m_count--;
+	}
+
+	// The shape's bounds changed. Only restructures if it's escaped its fat box.
+	// Returns true if the leaf was reinserted.
+	bool Move(int proxy, const RectF& r) {
+		Node& n = m_nodes[proxy];
+		n.m_tight = r;
+		if (Contains(n.m_fat, r)) {
+			// Still inside the fat box. Just keep the tight bounds up the tree correct.
+			for (int i = n.m_parent; i != NullNode; i = m_nodes[i].m_parent) {
+				FixNode(i);
+			}
+			return false;
+		}
+
+		RemoveLeaf(proxy);
+		m_nodes[proxy].m_fat = Fatten(r);
+		InsertLeaf(proxy);
+		return true;
+	}
+
+	Shape* GetShape(int proxy) const { return m_nodes[proxy].m_shape; }
+	const RectF& GetFatBounds(int proxy) const { return m_nodes[proxy].m_fat; }
+
+	// Exact bounds of everything in the tree
+	bool GetBounds(RectF* p) const {
+		if (m_root == NullNode) {
+			return false;
+		}
+		*p = m_nodes[m_root].m_tight;
+		return true;
+	}
+
+	int GetHeight() const {
+		return (m_root == NullNode) ? 0 : m_nodes[m_root].m_height;
+	}
+
+	// Call f(Shape*) for every shape whose fat bounds overlap r. Return false from f to stop early.
+	// It only narrows things down. Callers still do their own exact hit test.
+	template<class F> void Query(const RectF& r, F f) const {
+		if (m_root == NullNode) {
+			return;
+		}
+
+		RectF rQuery = r;
+		std::vector<int>& stack = m_stack;
+		stack.clear();
+		stack.push_back(m_root);
+		while (!stack.empty()) {
+			int i = stack.back();
+			stack.pop_back();
+
+			const Node& n = m_nodes[i];
+			if (!rQuery.hitTest(n.m_fat)) {
+				continue;
+			}
+
+			if (n.IsLeaf()) {
+				if (!f(n.m_shape)) {
+					return;
+				}
+			}
+			else {
+				stack.push_back(n.m_child1);
+				stack.push_back(n.m_child2);
+			}
+		}
+	}
+
+	// Move everything by the same amount. Doesn't change the structure.
+	void ShiftOrigin(const Point2F& offset) {
+		for (auto& n : m_nodes) {
+			if (n.m_height >= 0) {
+				n.m_fat.Offset(offset);
+				n.m_tight.Offset(offset);
+			}
+		}
+	}
+
+protected:
+	class Node {
+	public:
+		Node() : m_shape(NULL), m_parent(NullNode), m_child1(NullNode), m_child2(NullNode), m_height(-1) {}
+
+		bool IsLeaf() const { return m_child1 == NullNode; }
+
+		RectF m_fat;	// leaf: bounds + margin, branch: union of children
+		RectF m_tight;	// exact union of the leaves below
+		Shape* m_shape;
+		int m_parent;	// or next free node when on the free list
+		int m_child1;
+		int m_child2;
+		int m_height;	// leaf = 0, free = -1
+	};
+
+	int AllocateNode() {
+		if (m_freeList == NullNode) {
+			m_nodes.push_back(Node());
+			return (int)m_nodes.size() - 1;
+		}
+
+		int i = m_freeList;
+		m_freeList = m_nodes[i].m_parent;
+		m_nodes[i] = Node();
+		return i;
+	}
+
+	void FreeNode(int i) {
+		m_nodes[i].m_parent = m_freeList;
+		m_nodes[i].m_height = -1;
+		m_nodes[i].m_shape = NULL;
+		m_freeList = i;
+	}
+
+	RectF Fatten(const RectF& r) const {
+		RectF ret = r;
+		ret.left -= m_margin;
+		ret.top -= m_margin;
+		ret.right += m_margin;
+		ret.bottom += m_margin;
+		return ret;
+	}
+
+	static RectF Union(const RectF& a, const RectF& b) {
+		RectF ret = a;
+		ret.UnionRect(b);
+		return ret;
+	}
+
+	static FLOAT Perimeter(const RectF& r) {
+		return 2.0f * ((r.right - r.left) + (r.bottom - r.top));
+	}
+
+	static bool Contains(const RectF& outer, const RectF& inner) {
+		return (inner.left >= outer.left) && (inner.top >= outer.top) &&
+			(inner.right <= outer.right) && (inner.bottom <= outer.bottom);
+	}
+
+	// Recalculate a branch from its children
+	void FixNode(int i) {
+		Node& n = m_nodes[i];
+		const Node& c1 = m_nodes[n.m_child1];
+		const Node& c2 = m_nodes[n.m_child2];
+		n.m_fat = Union(c1.m_fat, c2.m_fat);
+		n.m_tight = Union(c1.m_tight, c2.m_tight);
+		n.m_height = 1 + ((c1.m_height > c2.m_height) ? c1.m_height : c2.m_height);
+	}
+
+	void InsertLeaf(int leaf) {
+		if (m_root == NullNode) {
+			m_root = leaf;
+			m_nodes[leaf].m_parent = NullNode;
+			return;
+		}
+
+		// Find the best sibling - the one that grows the tree's total perimeter least
+		RectF rLeaf = m_nodes[leaf].m_fat;
+		int index = m_root;
+		while (!m_nodes[index].IsLeaf()) {
+			const Node& n = m_nodes[index];
+			FLOAT area = Perimeter(n.m_fat);
+			FLOAT combinedArea = Perimeter(Union(n.m_fat, rLeaf));
+
+			FLOAT cost = 2.0f * combinedArea;					// cost of a new parent for this node and the leaf
+			FLOAT inheritanceCost = 2.0f * (combinedArea - area);	// minimum cost of pushing the leaf further down
+
+			FLOAT cost1 = ChildCost(n.m_child1, rLeaf) + inheritanceCost;
+			FLOAT cost2 = ChildCost(n.m_child2, rLeaf) + inheritanceCost;
+			if ((cost < cost1) && (cost < cost2)) {
+				break;
+			}
+
+			index = (cost1 < cost2) ? n.m_child1 : n.m_child2;
+		}
+
+		// Put a new parent over the sibling and the leaf
+		int sibling = index;
+		int oldParent = m_nodes[sibling].m_parent;
+		int newParent = AllocateNode();
+		m_nodes[newParent].m_parent = oldParent;
+		m_nodes[newParent].m_child1 = sibling;
+		m_nodes[newParent].m_child2 = leaf;
+		m_nodes[sibling].m_parent = newParent;
+		m_nodes[leaf].m_parent = newParent;
+		FixNode(newParent);
+
+		if (oldParent == NullNode) {
+			m_root = newParent;
+		}
+		else if (m_nodes[oldParent].m_child1 == sibling) {
+			m_nodes[oldParent].m_child1 = newParent;
+		}
+		else {
+			m_nodes[oldParent].m_child2 = newParent;
+		}
+
+		Refit(m_nodes[leaf].m_parent);
+	}
+
+	FLOAT ChildCost(int child, const RectF& rLeaf) const {
+		const Node& c = m_nodes[child];
+		FLOAT combined = Perimeter(Union(c.m_fat, rLeaf));
+		return c.IsLeaf() ? combined : combined - Perimeter(c.m_fat);
+	}
+
+	void RemoveLeaf(int leaf) {
+		if (leaf == m_root) {
+			m_root = NullNode;
+			return;
+		}
+
+		int parent = m_nodes[leaf].m_parent;
+		int grandParent = m_nodes[parent].m_parent;
+		int sibling = (m_nodes[parent].m_child1 == leaf) ? m_nodes[parent].m_child2 : m_nodes[parent].m_child1;
+
+		// The sibling takes the parent's place
+		m_nodes[sibling].m_parent = grandParent;
+		if (grandParent == NullNode) {
+			m_root = sibling;
+		}
+		else {
+			if (m_nodes[grandParent].m_child1 == parent) {
+				m_nodes[grandParent].m_child1 = sibling;
+			}
+			else {
+				m_nodes[grandParent].m_child2 = sibling;
+			}
+		}
+		FreeNode(parent);
+		m_nodes[leaf].m_parent = NullNode;
+
+		Refit(grandParent);
+	}
+
+	// Walk back up to the root rebalancing and fixing up bounds
+	void Refit(int index) {
+		while (index != NullNode) {
+			index = Balance(index);
+			FixNode(index);
+			index = m_nodes[index].m_parent;
+		}
+	}
+
+	// Rotate the taller child up if the node is out of balance. Returns the node now in its place.
+	int Balance(int iA) {
+		Node& A = m_nodes[iA];
+		if (A.IsLeaf() || (A.m_height < 2)) {
+			return iA;
+		}
+
+		int iB = A.m_child1;
+		int iC = A.m_child2;
+		int balance = m_nodes[iC].m_height - m_nodes[iB].m_height;
+		if (balance > 1) {
+			return RotateUp(iA, iC, false);
+		}
+		if (balance < -1) {
+			return RotateUp(iA, iB, true);
+		}
+		return iA;
+	}
+
+	// Make child iX (child1 of iA if isChild1) the parent of iA. iX keeps its taller child.
+	int RotateUp(int iA, int iX, bool isChild1) {
+		Node& A = m_nodes[iA];
+		Node& X = m_nodes[iX];
+		int iF = X.m_child1;
+		int iG = X.m_child2;
+
+		// X takes A's place
+		X.m_child1 = iA;
+		X.m_parent = A.m_parent;
+		A.m_parent = iX;
+		if (X.m_parent == NullNode) {
+			m_root = iX;
+		}
+		else if (m_nodes[X.m_parent].m_child1 == iA) {
+			m_nodes[X.m_parent].m_child1 = iX;
+		}
+		else {
+			m_nodes[X.m_parent].m_child2 = iX;
+		}
+
+		// X keeps the taller of its children and A takes the other
+		int iKeep = iF, iGive = iG;
+		if (m_nodes[iG].m_height > m_nodes[iF].m_height) {
+			iKeep = iG;
+			iGive = iF;
+		}
+		X.m_child2 = iKeep;
+		if (isChild1) {
+			A.m_child1 = iGive;
+		}
+		else {
+			A.m_child2 = iGive;
+		}
+		m_nodes[iGive].m_parent = iA;
+
+		FixNode(iA);
+		FixNode(iX);
+		return iX;
+	}
+
+protected:
+	std::vector<Node> m_nodes;
+	int m_root;
+	int m_freeList;
+	FLOAT m_margin;
+	int m_count;
+	mutable std::vector<int> m_stack;	// Query() scratch space
+};
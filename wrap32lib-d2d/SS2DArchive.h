@@ -0,0 +1,531 @@
+#pragma once
+
+#include <wrap32lib.h>
+
+#include <stdint.h>
+#include <wctype.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////
+// SS2DArchive is a read-only pack of runtime files, memory mapped so
+// whatever's in it is served straight from the map. Bitmaps (see
+// SS2DBitmap::DecodeFile()), atlas tables and SS2DArchive::ReadAsset()
+// look in Mounted() first and fall back to loose files.
+//
+// Layout (little endian, offsets from the start of the file):
+//   Header
+//   TocEntry[m_count]	sorted by hash, kind and name for a binary search
+//   names				UTF-16, not terminated
+//   payloads			each one starting on an Align boundary
+//
+// A payload is stored as it is or LZ compressed (see Compress()). Pixels
+// entries are 32bpp premultiplied BGRA, ready to upload, so an image
+// packed that way never goes near WIC. A stored one can be used right
+// out of the map (GetPixels()).
+//
+// SS2DArchiveWriter makes them ("ss2dtest -pack").
+////////////////////////////////////////////////////////////////////////
+
+class SS2DArchive
+{
+public:
+	enum Kind : uint8_t { FileData = 0, Pixels = 1 };
+	enum Method : uint8_t { Stored = 0, LZ = 1 };
+
+	static const uint32_t Magic = 0x41443253;	// "S2DA"
+	static const uint16_t Version = 1;
+	static const size_t Align = 16;
+
+	struct Header {
+		uint32_t m_magic;
+		uint16_t m_version;
+		uint16_t m_align;
+		uint32_t m_count;
+		uint32_t m_tocOffset;
+		uint32_t m_namesOffset;
+		uint32_t m_namesLength;		// in UTF-16 units
+		uint64_t m_size;			// of the whole file so a short one is spotted
+	};
+
+	struct TocEntry {
+		uint64_t m_hash;			// Hash() of the name
+		uint64_t m_offset;
+		uint32_t m_name;			// into the names, in UTF-16 units
+		uint16_t m_nameLength;
+		uint8_t m_kind;
+		uint8_t m_method;
+		uint32_t m_size;			// as stored
+		uint32_t m_rawSize;			// once expanded
+		uint32_t m_width;			// Pixels only
+		uint32_t m_height;
+	};
+
+	SS2DArchive() : m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL), m_pView(NULL), m_size(0), m_pHeader(NULL), m_pToc(NULL), m_pNames(NULL) {}
+
+	~SS2DArchive() {
+		Close();
+	}
+
+	// The one everything looks in. Open it (e.g. at startup) or not.
+	static SS2DArchive& Mounted() {
+		static SS2DArchive archive;
+		return archive;
+	}
+
+	bool Open(LPCWSTR path) {
+		Close();
+		m_hFile = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!::GetFileSizeEx(m_hFile, &size) || (size.QuadPart < (LONGLONG)sizeof(Header))) {
+			Close();
+			return false;
+		}
+		m_size = (size_t)size.QuadPart;
+
+		m_hMapping = ::CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_hMapping) {
+			m_pView = (const BYTE*)::MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (!m_pView || !Validate()) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close() {
+		if (m_pView) {
+			::UnmapViewOfFile(m_pView);
+			m_pView = NULL;
+		}
+		if (m_hMapping) {
+			::CloseHandle(m_hMapping);
+			m_hMapping = NULL;
+		}
+		if (m_hFile != INVALID_HANDLE_VALUE) {
+			::CloseHandle(m_hFile);
+			m_hFile = INVALID_HANDLE_VALUE;
+		}
+		m_size = 0;
+		m_pHeader = NULL;
+		m_pToc = NULL;
+		m_pNames = NULL;
+	}
+
+	bool IsOpen() const { return m_pHeader != NULL; }
+	size_t GetCount() const { return m_pHeader ? m_pHeader->m_count : 0; }
+	const TocEntry& GetEntry(size_t n) const { return m_pToc[n]; }
+	std::wstring GetName(size_t n) const { return std::wstring(m_pNames + m_pToc[n].m_name, m_pNames + m_pToc[n].m_name + m_pToc[n].m_nameLength); }
+
+	// NULL if it isn't here
+	const TocEntry* Find(LPCWSTR name, Kind kind) const {
+		if (!m_pHeader) {
+			return NULL;
+		}
+
+		std::wstring key = Normalise(name);
+		uint64_t hash = Hash(key);
+		const TocEntry* pEnd = m_pToc + m_pHeader->m_count;
+		const TocEntry* p = std::lower_bound(m_pToc, pEnd, hash, [](const TocEntry& e, uint64_t h) { return e.m_hash < h; });
+		for (; (p < pEnd) && (p->m_hash == hash); p++) {
+			if ((p->m_kind == kind) && NameIs(*p, key)) {
+				return p;
+			}
+		}
+		return NULL;
+	}
+
+	bool Has(LPCWSTR name, Kind kind = FileData) const { return Find(name, kind) != NULL; }
+
+	// A stored file's bytes in the map, no copy. false if it isn't here or is compressed (see Read()).
+	bool GetFile(LPCWSTR name, const BYTE** pData, size_t* pSize) const {
+		const TocEntry* p = Find(name, FileData);
+		if (!p || (p->m_method != Stored)) {
+			return false;
+		}
+		*pData = m_pView + p->m_offset;
+		*pSize = p->m_size;
+		return true;
+	}
+
+	// A copy of a file's bytes, expanded if need be
+	template <class T>
+	bool Read(LPCWSTR name, T& data) const {
+		const TocEntry* p = Find(name, FileData);
+		if (!p) {
+			return false;
+		}
+		data.resize(p->m_rawSize);
+		return data.empty() || Expand(*p, (BYTE*)&data[0]);
+	}
+
+	// Stored pixels in the map, no copy. false if they aren't here or are compressed (see ReadPixels()).
+	bool GetPixels(LPCWSTR name, UINT* pWidth, UINT* pHeight, const uint32_t** pPixels) const {
+		const TocEntry* p = Find(name, Pixels);
+		if (!p || (p->m_method != Stored)) {
+			return false;
+		}
+		*pWidth = p->m_width;
+		*pHeight = p->m_height;
+		*pPixels = (const uint32_t*)(m_pView + p->m_offset);
+		return true;
+	}
+
+	bool ReadPixels(LPCWSTR name, UINT* pWidth, UINT* pHeight, std::vector<uint32_t>& pixels) const {
+		const TocEntry* p = Find(name, Pixels);
+		if (!p) {
+			return false;
+		}
+		pixels.resize(p->m_rawSize / sizeof(uint32_t));
+		if (!Expand(*p, (BYTE*)pixels.data())) {
+			pixels.clear();
+			return false;
+		}
+		*pWidth = p->m_width;
+		*pHeight = p->m_height;
+		return true;
+	}
+
+	// A runtime file from Mounted() if it's there, from the folder if not
+	static bool ReadAsset(LPCWSTR name, std::string& data) {
+		if (Mounted().Read(name, data)) {
+			return true;
+		}
+
+		HANDLE h = ::CreateFileW(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (h == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		DWORD dwRead = 0;
+		bool ok = ::GetFileSizeEx(h, &size) != FALSE;
+		if (ok) {
+			data.resize((size_t)size.QuadPart);
+			ok = data.empty() || (::ReadFile(h, &data[0], (DWORD)data.size(), &dwRead, NULL) && (dwRead == data.size()));
+		}
+		::CloseHandle(h);
+		return ok;
+	}
+
+	// Names match whatever the case and slashes
+	static std::wstring Normalise(LPCWSTR name) {
+		if ((name[0] == L'.') && ((name[1] == L'\\') || (name[1] == L'/'))) {
+			name += 2;
+		}
+		std::wstring s(name);
+		for (auto& c : s) {
+			c = (c == L'/') ? L'\\' : (wchar_t)towlower(c);
+		}
+		return s;
+	}
+
+	// FNV-1a over the UTF-16 units of a Normalise()d name
+	static uint64_t Hash(const std::wstring& key) {
+		uint64_t hash = 14695981039346656037ULL;
+		for (auto c : key) {
+			hash = (hash ^ (uint16_t)c) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	////////////////////////////////////////////////////////////////////
+	// LZ is LZ77 in byte-aligned sequences, quick to expand:
+	//   token			literal length << 4 | (match length - 4), 15 meaning more follows
+	//   [length]		255s then the rest, for a literal length of 15 or more
+	//   literals
+	//   offset			2 bytes back into the output, 1 to 65535
+	//   [length]		as above for the match
+	// The last sequence is just literals.
+	////////////////////////////////////////////////////////////////////
+
+	static void Compress(const BYTE* src, size_t size, std::vector<BYTE>& out) {
+		const size_t MinMatch = 4;
+		const size_t HashBits = 14;
+
+		out.clear();
+		out.reserve(size + size / 255 + 16);
+		std::vector<uint32_t> table((size_t)1 << HashBits, 0);	// last position + 1 of each 4 byte sequence
+		size_t anchor = 0;
+		size_t i = 0;
+		while (i + MinMatch <= size) {
+			uint32_t seq = Read32(src + i);
+			uint32_t h = (seq * 2654435761u) >> (32 - HashBits);
+			size_t candidate = table[h];
+			table[h] = (uint32_t)(i + 1);
+			if (candidate && (i - (candidate - 1) <= 0xffff) && (Read32(src + candidate - 1) == seq)) {
+				size_t match = candidate - 1;
+				size_t length = MinMatch;
+				while ((i + length < size) && (src[match + length] == src[i + length])) {
+					length++;
+				}
+				EmitSequence(out, src + anchor, i - anchor, i - match, length);
+				i += length;
+				anchor = i;
+			}
+			else {
+				i++;
+			}
+		}
+		EmitSequence(out, src + anchor, size - anchor, 0, 0);
+	}
+
+	// false if src isn't exactly rawSize bytes' worth
+	static bool Decompress(const BYTE* src, size_t size, BYTE* dst, size_t rawSize) {
+		size_t ip = 0, op = 0;
+		while (ip < size) {
+			BYTE token = src[ip++];
+			size_t literals = token >> 4;
+			if ((literals == 15) && !ReadLength(src, size, &ip, &literals)) {
+				return false;
+			}
+			if ((literals > size - ip) || (literals > rawSize - op)) {
+				return false;
+			}
+			memcpy(dst + op, src + ip, literals);
+			ip += literals;
+			op += literals;
+			if (ip == size) {
+				break;	// the last sequence
+			}
+
+			if (size - ip < 2) {
+				return false;
+			}
+			size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+			ip += 2;
+			size_t length = token & 15;
+			if ((length == 15) && !ReadLength(src, size, &ip, &length)) {
+				return false;
+			}
+			length += 4;
+			if ((offset == 0) || (offset > op) || (length > rawSize - op)) {
+				return false;
+			}
+			for (size_t n = 0; n < length; n++, op++) {	// may overlap itself
+				dst[op] = dst[op - offset];
+			}
+		}
+		return op == rawSize;
+	}
+
+protected:
+	bool Validate() {
+		const Header* pHeader = (const Header*)m_pView;
+		if ((pHeader->m_magic != Magic) || (pHeader->m_version != Version) || (pHeader->m_size != m_size)) {
+			return false;
+		}
+		if (((uint64_t)pHeader->m_tocOffset + (uint64_t)pHeader->m_count * sizeof(TocEntry) > m_size) ||
+			((uint64_t)pHeader->m_namesOffset + (uint64_t)pHeader->m_namesLength * sizeof(uint16_t) > m_size)) {
+			return false;
+		}
+
+		const TocEntry* pToc = (const TocEntry*)(m_pView + pHeader->m_tocOffset);
+		for (uint32_t n = 0; n < pHeader->m_count; n++) {
+			const TocEntry& e = pToc[n];
+			if ((e.m_offset + e.m_size > m_size) || ((uint64_t)e.m_name + e.m_nameLength > pHeader->m_namesLength) ||
+				((n > 0) && (e.m_hash < pToc[n - 1].m_hash)) ||
+				((e.m_method == Stored) && (e.m_size != e.m_rawSize)) ||
+				((e.m_kind == Pixels) && ((uint64_t)e.m_width * e.m_height * sizeof(uint32_t) != e.m_rawSize))) {
+				return false;
+			}
+		}
+
+		m_pHeader = pHeader;
+		m_pToc = pToc;
+		m_pNames = (const uint16_t*)(m_pView + pHeader->m_namesOffset);
+		return true;
+	}
+
+	bool NameIs(const TocEntry& e, const std::wstring& key) const {
+		if (e.m_nameLength != key.length()) {
+			return false;
+		}
+		const uint16_t* pName = m_pNames + e.m_name;
+		for (size_t n = 0; n < key.length(); n++) {
+			if (pName[n] != (uint16_t)key[n]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Expand(const TocEntry& e, BYTE* dst) const {
+		if (e.m_method == Stored) {
+			memcpy(dst, m_pView + e.m_offset, e.m_size);
+			return true;
+		}
+		return (e.m_method == LZ) && Decompress(m_pView + e.m_offset, e.m_size, dst, e.m_rawSize);
+	}
+
+	static uint32_t Read32(const BYTE* p) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static void WriteLength(std::vector<BYTE>& out, size_t length) {
+		for (; length >= 255; length -= 255) {
+			out.push_back(255);
+		}
+		out.push_back((BYTE)length);
+	}
+
+	static bool ReadLength(const BYTE* src, size_t size, size_t* pIP, size_t* pLength) {
+		BYTE b;
+		do {
+			if (*pIP >= size) {
+				return false;
+			}
+			b = src[(*pIP)++];
+			*pLength += b;
+		} while (b == 255);
+		return true;
+	}
+
+	// A match length of 0 for the last one
+	static void EmitSequence(std::vector<BYTE>& out, const BYTE* literals, size_t literalLength, size_t offset, size_t matchLength) {
+		size_t matchCode = matchLength ? matchLength - 4 : 0;
+		out.push_back((BYTE)(((std::min)(literalLength, (size_t)15) << 4) | (std::min)(matchCode, (size_t)15)));
+		if (literalLength >= 15) {
+			WriteLength(out, literalLength - 15);
+		}
+		out.insert(out.end(), literals, literals + literalLength);
+		if (matchLength) {
+			out.push_back((BYTE)(offset & 0xff));
+			out.push_back((BYTE)(offset >> 8));
+			if (matchCode >= 15) {
+				WriteLength(out, matchCode - 15);
+			}
+		}
+	}
+
+protected:
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+	const BYTE* m_pView;
+	size_t m_size;
+	const Header* m_pHeader;	// NULL until Open() has checked it all
+	const TocEntry* m_pToc;
+	const uint16_t* m_pNames;
+};
+
+////////////////////////////////////////////////////////////////////////
+// SS2DArchiveWriter collects files and pixels and Save()s an archive
+// of them. Compressed payloads are only kept when they come out smaller.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DArchiveWriter
+{
+public:
+	void AddFile(LPCWSTR name, const void* data, size_t size, bool compress = true) {
+		Add(name, SS2DArchive::FileData, (const BYTE*)data, size, 0, 0, compress);
+	}
+
+	void AddPixels(LPCWSTR name, UINT width, UINT height, const uint32_t* pixels, bool compress = true) {
+		Add(name, SS2DArchive::Pixels, (const BYTE*)pixels, (size_t)width * height * sizeof(uint32_t), width, height, compress);
+	}
+
+	size_t GetCount() const { return m_entries.size(); }
+
+	HRESULT Save(LPCWSTR path) {
+		std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+			if (a.m_toc.m_hash != b.m_toc.m_hash)	return a.m_toc.m_hash < b.m_toc.m_hash;
+			if (a.m_toc.m_kind != b.m_toc.m_kind)	return a.m_toc.m_kind < b.m_toc.m_kind;
+			return a.m_key < b.m_key;
+		});
+
+		// Lay it out
+		SS2DArchive::Header header = {};
+		header.m_magic = SS2DArchive::Magic;
+		header.m_version = SS2DArchive::Version;
+		header.m_align = (uint16_t)SS2DArchive::Align;
+		header.m_count = (uint32_t)m_entries.size();
+		header.m_tocOffset = sizeof(SS2DArchive::Header);
+		header.m_namesOffset = header.m_tocOffset + header.m_count * sizeof(SS2DArchive::TocEntry);
+
+		std::vector<uint16_t> names;
+		for (auto& e : m_entries) {
+			e.m_toc.m_name = (uint32_t)names.size();
+			names.insert(names.end(), e.m_key.begin(), e.m_key.end());
+		}
+		header.m_namesLength = (uint32_t)names.size();
+
+		uint64_t offset = AlignUp(header.m_namesOffset + names.size() * sizeof(uint16_t));
+		for (auto& e : m_entries) {
+			e.m_toc.m_offset = offset;
+			offset = AlignUp(offset + e.m_payload.size());
+		}
+		header.m_size = offset;
+
+		// Write it
+		HANDLE h = ::CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (h == INVALID_HANDLE_VALUE) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		std::vector<BYTE> out;
+		Append(out, &header, sizeof(header));
+		for (auto& e : m_entries) {
+			Append(out, &e.m_toc, sizeof(e.m_toc));
+		}
+		Append(out, names.data(), names.size() * sizeof(uint16_t));
+		for (auto& e : m_entries) {
+			out.resize((size_t)e.m_toc.m_offset, 0);
+			Append(out, e.m_payload.data(), e.m_payload.size());
+		}
+		out.resize((size_t)header.m_size, 0);
+
+		DWORD dwWritten = 0;
+		bool ok = ::WriteFile(h, out.data(), (DWORD)out.size(), &dwWritten, NULL) && (dwWritten == out.size());
+		::CloseHandle(h);
+		return ok ? S_OK : E_FAIL;
+	}
+
+protected:
+	struct Entry {
+		std::wstring m_key;
+		SS2DArchive::TocEntry m_toc;
+		std::vector<BYTE> m_payload;
+	};
+
+	void Add(LPCWSTR name, SS2DArchive::Kind kind, const BYTE* data, size_t size, UINT width, UINT height, bool compress) {
+		Entry e;
+		e.m_key = SS2DArchive::Normalise(name);
+		e.m_toc = {};
+		e.m_toc.m_hash = SS2DArchive::Hash(e.m_key);
+		e.m_toc.m_nameLength = (uint16_t)e.m_key.length();
+		e.m_toc.m_kind = kind;
+		e.m_toc.m_method = SS2DArchive::Stored;
+		e.m_toc.m_rawSize = (uint32_t)size;
+		e.m_toc.m_width = width;
+		e.m_toc.m_height = height;
+		if (compress) {
+			SS2DArchive::Compress(data, size, e.m_payload);
+			if (e.m_payload.size() < size) {
+				e.m_toc.m_method = SS2DArchive::LZ;
+			}
+		}
+		if (e.m_toc.m_method == SS2DArchive::Stored) {
+			e.m_payload.assign(data, data + size);
+		}
+		e.m_toc.m_size = (uint32_t)e.m_payload.size();
+		m_entries.push_back(std::move(e));
+	}
+
+	static uint64_t AlignUp(uint64_t offset) {
+		return (offset + SS2DArchive::Align - 1) & ~(uint64_t)(SS2DArchive::Align - 1);
+	}
+
+	static void Append(std::vector<BYTE>& out, const void* p, size_t size) {
+		out.insert(out.end(), (const BYTE*)p, (const BYTE*)p + size);
+	}
+
+protected:
+	std::vector<Entry> m_entries;
+};
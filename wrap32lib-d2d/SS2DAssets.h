@@ -0,0 +1,214 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <CriticalSection.h>
+
+#include "SS2DBitmap.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DAssetCache keeps decoded images for as long as it lives, so a world
+// started again (or another world using the same files) needn't decode
+// them again. D2DWindow owns one for the life of the window and
+// SS2DEssentials::m_pAssets points at it. Worlds use it as they load.
+//
+// Entries are keyed by file path and size (0, 0 for the image as it is).
+// Each one keeps its 32bpp premultiplied BGRA pixels and, until the render
+// target goes (DiscardDevice()), the Direct2D bitmap made from them.
+// Once the pixels come to more than the budget, the least recently used
+// entries go.
+//
+// Bitmap loader workers use it too, so everything is under a lock.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DAssetCache
+{
+public:
+	struct Stats {
+		Stats() : m_hits(0), m_misses(0), m_evictions(0) {}
+
+		size_t m_hits;
+		size_t m_misses;
+		size_t m_evictions;
+	};
+
+	SS2DAssetCache(size_t budgetBytes = 256 * 1024 * 1024) : m_budget(budgetBytes), m_bytes(0) {}
+
+	~SS2DAssetCache() {
+		Clear();
+	}
+
+	void SetBudget(size_t bytes) {
+		CSLocker lock(m_cs);
+		m_budget = bytes;
+		Evict();
+	}
+
+	// Copies the pixels out. false if they aren't here.
+	bool GetPixels(const std::wstring& filePath, UINT width, UINT height, UINT* pWidth, UINT* pHeight, std::vector<uint32_t>& pixels) {
+		CSLocker lock(m_cs);
+		Entry* e = Find(filePath, width, height);
+		if (!e) {
+			m_stats.m_misses++;
+			return false;
+		}
+		m_stats.m_hits++;
+		*pWidth = e->m_width;
+		*pHeight = e->m_height;
+		pixels = e->m_pixels;
+		return true;
+	}
+
+	void AddPixels(const std::wstring& filePath, UINT width, UINT height, UINT pixelsWidth, UINT pixelsHeight, const std::vector<uint32_t>& pixels) {
+		if (filePath.empty() || pixels.empty()) {
+			return;	// made, not loaded (e.g. an atlas page built at load time)
+		}
+
+		CSLocker lock(m_cs);
+		Entry* e = Find(filePath, width, height);
+		if (!e) {
+			m_lru.emplace_front();
+			e = &m_lru.front();
+			e->m_key = Key(filePath, width, height);
+			m_index[e->m_key] = m_lru.begin();
+		}
+		else {
+			m_bytes -= e->m_pixels.size() * sizeof(uint32_t);
+			SafeRelease(&e->m_pDeviceBitmap);
+		}
+		e->m_width = pixelsWidth;
+		e->m_height = pixelsHeight;
+		e->m_pixels = pixels;
+		m_bytes += e->m_pixels.size() * sizeof(uint32_t);
+		Evict();
+	}
+
+	// The same for a bitmap at its own size
+	bool GetPixels(SS2DBitmap* p) {
+		UINT width = 0, height = 0;
+		std::vector<uint32_t> pixels;
+		if (!GetPixels(p->GetFilePath(), 0, 0, &width, &height, pixels)) {
+			return false;
+		}
+		p->SwapPixels(width, height, pixels);
+		return true;
+	}
+
+	void AddPixels(const SS2DBitmap* p) {
+		if (p->HasPixels()) {
+			AddPixels(p->GetFilePath(), 0, 0, p->GetPixelsWidth(), p->GetPixelsHeight(),
+				std::vector<uint32_t>(p->GetPixels(), p->GetPixels() + (size_t)p->GetPixelsWidth() * p->GetPixelsHeight()));
+		}
+	}
+
+	// The Direct2D bitmap made from an entry for pRenderTarget, AddRef()ed. NULL if there isn't one.
+	ID2D1Bitmap* GetDeviceBitmap(const std::wstring& filePath, UINT width, UINT height, ID2D1RenderTarget* pRenderTarget) {
+		CSLocker lock(m_cs);
+		Entry* e = Find(filePath, width, height);
+		if (!e || !e->m_pDeviceBitmap || (e->m_pDeviceTarget != pRenderTarget)) {
+			return NULL;
+		}
+		m_stats.m_hits++;
+		e->m_pDeviceBitmap->AddRef();
+		return e->m_pDeviceBitmap;
+	}
+
+	// Only kept alongside the pixels
+	void SetDeviceBitmap(const std::wstring& filePath, UINT width, UINT height, ID2D1RenderTarget* pRenderTarget, ID2D1Bitmap* pBitmap) {
+		CSLocker lock(m_cs);
+		Entry* e = Find(filePath, width, height);
+		if (e && pBitmap) {
+			SafeRelease(&e->m_pDeviceBitmap);
+			e->m_pDeviceBitmap = pBitmap;
+			e->m_pDeviceBitmap->AddRef();
+			e->m_pDeviceTarget = pRenderTarget;
+		}
+	}
+
+	// The render target is going. Its bitmaps go with it. The pixels stay.
+	void DiscardDevice() {
+		CSLocker lock(m_cs);
+		for (auto& e : m_lru) {
+			SafeRelease(&e.m_pDeviceBitmap);
+			e.m_pDeviceTarget = NULL;
+		}
+	}
+
+	void Clear() {
+		CSLocker lock(m_cs);
+		for (auto& e : m_lru) {
+			SafeRelease(&e.m_pDeviceBitmap);
+		}
+		m_lru.clear();
+		m_index.clear();
+		m_bytes = 0;
+	}
+
+	size_t GetBytes() { CSLocker lock(m_cs); return m_bytes; }
+	size_t GetCount() { CSLocker lock(m_cs); return m_lru.size(); }
+	Stats GetStats() { CSLocker lock(m_cs); return m_stats; }
+
+protected:
+	struct Key {
+		Key() : m_width(0), m_height(0) {}
+		Key(const std::wstring& filePath, UINT width, UINT height) : m_filePath(filePath), m_width(width), m_height(height) {}
+
+		bool operator==(const Key& rhs) const {
+			return (m_width == rhs.m_width) && (m_height == rhs.m_height) && (m_filePath == rhs.m_filePath);
+		}
+
+		std::wstring m_filePath;
+		UINT m_width;		// asked for
+		UINT m_height;
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const {
+			return std::hash<std::wstring>()(k.m_filePath) ^ ((size_t)k.m_width << 16) ^ k.m_height;
+		}
+	};
+
+	struct Entry {
+		Entry() : m_width(0), m_height(0), m_pDeviceBitmap(NULL), m_pDeviceTarget(NULL) {}
+
+		Key m_key;
+		UINT m_width;		// of the pixels
+		UINT m_height;
+		std::vector<uint32_t> m_pixels;
+		ID2D1Bitmap* m_pDeviceBitmap;
+		ID2D1RenderTarget* m_pDeviceTarget;	// m_pDeviceBitmap's. Only compared.
+	};
+
+	// Found entries move to the front
+	Entry* Find(const std::wstring& filePath, UINT width, UINT height) {
+		auto it = m_index.find(Key(filePath, width, height));
+		if (it == m_index.end()) {
+			return NULL;
+		}
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		return &m_lru.front();
+	}
+
+	// Least recently used first until it fits. The newest always stays.
+	void Evict() {
+		while ((m_bytes > m_budget) && (m_lru.size() > 1)) {
+			Entry& e = m_lru.back();
+			m_bytes -= e.m_pixels.size() * sizeof(uint32_t);
+			SafeRelease(&e.m_pDeviceBitmap);
+			m_index.erase(e.m_key);
+			m_lru.pop_back();
+			m_stats.m_evictions++;
+		}
+	}
+
+protected:
+	CriticalSection m_cs;	// everything below
+	std::list<Entry> m_lru;	// most recently used first
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+	size_t m_budget;
+	size_t m_bytes;			// pixels held
+	Stats m_stats;
+};
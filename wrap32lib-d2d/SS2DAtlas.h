@@ -0,0 +1,388 @@
+#pragma once
+
+#include <limits.h>
+#include <wchar.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "SS2DBitmap.h"
+
+////////////////////////////////////////////////////////////////////////
+// Skyline bottom-left rectangle packer. The skyline is the top edge of
+// everything placed so far as a list of horizontal segments. Each new
+// rectangle goes wherever it sits lowest (then on the tightest segment).
+////////////////////////////////////////////////////////////////////////
+
+class SS2DSkylinePacker
+{
+public:
+	SS2DSkylinePacker(UINT width = 0, UINT height = 0) {
+		Reset(width, height);
+	}
+
+	void Reset(UINT width, UINT height) {
+		m_width = width;
+		m_height = height;
+		m_usedWidth = 0;
+		m_usedHeight = 0;
+		m_skyline.assign(1, Segment(0, 0, width));
+	}
+
+	// Extent of everything placed so far
+	UINT GetUsedWidth() const { return m_usedWidth; }
+	UINT GetUsedHeight() const { return m_usedHeight; }
+
+	bool Insert(UINT w, UINT h, UINT* px, UINT* py) {
+		size_t best = m_skyline.size();
+		UINT bestY = UINT_MAX, bestWidth = UINT_MAX;
+		for (size_t i = 0; i < m_skyline.size(); i++) {
+			UINT y;
+			if (Fits(i, w, h, &y) && ((y < bestY) || ((y == bestY) && (m_skyline[i].width < bestWidth)))) {
+				best = i;
+				bestY = y;
+				bestWidth = m_skyline[i].width;
+			}
+		}
+		if (best == m_skyline.size()) {
+			return false;
+		}
+
+		*px = m_skyline[best].x;
+		*py = bestY;
+		AddSegment(best, Segment(*px, bestY + h, w));
+
+		m_usedWidth = (std::max)(m_usedWidth, *px + w);
+		m_usedHeight = (std::max)(m_usedHeight, bestY + h);
+		return true;
+	}
+
+protected:
+	class Segment {
+	public:
+		Segment(UINT _x, UINT _y, UINT _width) : x(_x), y(_y), width(_width) {}
+
+		UINT x, y, width;
+	};
+
+	// Where a w x h rectangle would sit with its left edge at segment i
+	bool Fits(size_t i, UINT w, UINT h, UINT* py) const {
+		if (m_skyline[i].x + w > m_width) {
+			return false;
+		}
+
+		UINT y = 0;
+		UINT left = w;
+		for (size_t j = i; left > 0; j++) {
+			if (j == m_skyline.size()) {
+				return false;
+			}
+			y = (std::max)(y, m_skyline[j].y);
+			if (y + h > m_height) {
+				return false;
+			}
+			left -= (std::min)(left, m_skyline[j].width);
+		}
+		*py = y;
+		return true;
+	}
+
+	void AddSegment(size_t i, const Segment& s) {
+		m_skyline.insert(m_skyline.begin() + i, s);
+
+		// Cut back the segments the new one covers
+		for (size_t j = i + 1; j < m_skyline.size(); ) {
+			Segment& prev = m_skyline[j - 1];
+			Segment& next = m_skyline[j];
+			UINT prevEnd = prev.x + prev.width;
+			if (next.x >= prevEnd) {
+				break;
+			}
+			UINT overlap = prevEnd - next.x;
+			if (next.width <= overlap) {
+				m_skyline.erase(m_skyline.begin() + j);
+			}
+			else {
+				next.x += overlap;
+				next.width -= overlap;
+				break;
+			}
+		}
+
+		// Join neighbours at the same height
+		for (size_t j = 1; j < m_skyline.size(); ) {
+			if (m_skyline[j - 1].y == m_skyline[j].y) {
+				m_skyline[j - 1].width += m_skyline[j].width;
+				m_skyline.erase(m_skyline.begin() + j);
+			}
+			else {
+				j++;
+			}
+		}
+	}
+
+protected:
+	UINT m_width, m_height;
+	UINT m_usedWidth, m_usedHeight;
+	std::vector<Segment> m_skyline;	// left to right
+};
+
+////////////////////////////////////////////////////////////////////////
+// SS2DAtlas packs bitmaps into a few big pages so they can all be drawn
+// with one bitmap (and so in one sprite batch). The bitmaps become
+// regions of their page (SS2DBitmap::SetRegion()) so whatever draws them
+// carries on as before.
+//
+// At load time: Build() the decoded bitmaps (SS2DBitmap::HasPixels())
+// then CreateResources() to make the pages' Direct2D bitmaps.
+// Offline: Build() then Save() the pages and a table of where everything
+// went. Load() that table later instead of packing again.
+//
+// Each image is surrounded by a copy of its edge pixels so filtering at
+// the region's edge doesn't pick up its neighbours.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DAtlas
+{
+public:
+	SS2DAtlas(UINT pageSize = 1024, UINT padding = 1) : m_pageSize(pageSize), m_padding(padding) {}
+
+	~SS2DAtlas() {
+		for (auto p : m_pages) {
+			delete p;
+		}
+	}
+
+	// Where a bitmap went
+	class Entry {
+	public:
+		Entry(const std::wstring& name, size_t page, const D2D1_RECT_U& source) : m_name(name), m_page(page), m_source(source) {}
+
+		std::wstring m_name;	// SS2DBitmap::GetFilePath()
+		size_t m_page;
+		D2D1_RECT_U m_source;
+	};
+
+	size_t GetPageCount() const { return m_pages.size(); }
+	SS2DBitmap* GetPage(size_t n) const { return m_pages[n]; }
+	const std::vector<Entry>& GetEntries() const { return m_entries; }
+
+	// Pack the bitmaps that have CPU pixels into new pages. Tallest first packs tightest.
+	// Ones that don't fit on a page on their own are left alone. Returns how many were packed.
+	size_t Build(const std::vector<SS2DBitmap*>& bitmaps) {
+		std::vector<SS2DBitmap*> todo;
+		for (auto p : bitmaps) {
+			if (p && !p->IsRegion() && p->HasPixels() &&
+				(p->GetPixelsWidth() + m_padding * 2 <= m_pageSize) && (p->GetPixelsHeight() + m_padding * 2 <= m_pageSize)) {
+				todo.push_back(p);
+			}
+		}
+		std::stable_sort(todo.begin(), todo.end(), [](SS2DBitmap* a, SS2DBitmap* b) {
+			return a->GetPixelsHeight() > b->GetPixelsHeight();
+		});
+
+		size_t packed = 0;
+		while (!todo.empty()) {
+			SS2DSkylinePacker packer(m_pageSize, m_pageSize);
+			std::vector<std::pair<SS2DBitmap*, D2D1_RECT_U>> placed;
+			std::vector<SS2DBitmap*> next;
+			for (auto p : todo) {
+				UINT x, y;
+				UINT w = p->GetPixelsWidth(), h = p->GetPixelsHeight();
+				if (packer.Insert(w + m_padding * 2, h + m_padding * 2, &x, &y)) {
+					placed.push_back(std::make_pair(p, D2D1::RectU(x + m_padding, y + m_padding, x + m_padding + w, y + m_padding + h)));
+				}
+				else {
+					next.push_back(p);	// next page
+				}
+			}
+
+			// Only as big as it needs to be
+			UINT width = packer.GetUsedWidth(), height = packer.GetUsedHeight();
+			std::vector<uint32_t> pixels((size_t)width * height, 0);
+			for (auto& pl : placed) {
+				CopyPadded(pl.first, pl.second, pixels.data(), width, height);
+			}
+
+			SS2DBitmap* page = new SS2DBitmap(L"");
+			page->SetPixels(width, height, pixels.data());
+			m_pages.push_back(page);
+
+			for (auto& pl : placed) {
+				m_entries.push_back(Entry(pl.first->GetFilePath(), m_pages.size() - 1, pl.second));
+				pl.first->SetRegion(page, pl.second);
+			}
+			packed += placed.size();
+			todo.swap(next);
+		}
+		return packed;
+	}
+
+	// Direct2D bitmaps for the pages that have pixels
+	void CreateResources(ID2D1RenderTarget* pRenderTarget) {
+		for (auto p : m_pages) {
+			if (p->HasPixels() && !p->GetD2DBitmap()) {
+				p->CreateFromPixels(pRenderTarget);
+			}
+		}
+	}
+
+	void DiscardResources() {
+		for (auto p : m_pages) {
+			p->Clear();
+		}
+	}
+
+	// Write each page as <prefix><n>.png and the table as <prefix>.txt:
+	//   page <n> <file>
+	//   <page> <left> <top> <right> <bottom> <name>
+	HRESULT Save(IWICImagingFactory* pIWICFactory, const std::wstring& prefix) const {
+		std::wofstream f(std::filesystem::path(prefix + L".txt"));
+		if (!f) {
+			return E_FAIL;
+		}
+
+		HRESULT hr = S_OK;
+		for (size_t n = 0; SUCCEEDED(hr) && (n < m_pages.size()); n++) {
+			std::wstring file = prefix + std::to_wstring(n) + L".png";
+			hr = SavePNG(pIWICFactory, m_pages[n], file);
+			f << L"page " << n << L" " << FileName(file) << L"\n";
+		}
+		for (auto& e : m_entries) {
+			f << e.m_page << L" " << e.m_source.left << L" " << e.m_source.top << L" " << e.m_source.right << L" " << e.m_source.bottom << L" " << e.m_name << L"\n";
+		}
+		return (SUCCEEDED(hr) && !f.good()) ? E_FAIL : hr;
+	}
+
+	// Read a table written by Save() and make regions of the bitmaps named in it.
+	// The new pages are returned to be loaded like any other bitmap file. Page files
+	// are found next to the table. Both can come from the mounted SS2DArchive.
+	bool Load(const std::wstring& tablePath, const std::vector<SS2DBitmap*>& bitmaps, std::vector<SS2DBitmap*>& pagesToLoad) {
+		std::string table;
+		if (!SS2DArchive::ReadAsset(tablePath.c_str(), table)) {
+			return false;
+		}
+
+		std::wstring folder = tablePath.substr(0, tablePath.length() - FileName(tablePath).length());
+		size_t firstPage = m_pages.size();
+		for (size_t start = 0; start < table.length();) {
+			size_t end = (std::min)(table.find('\n', start), table.length());
+			std::wstring s;
+			for (size_t i = start; i < end; i++) {
+				s += (wchar_t)(unsigned char)table[i];	// Save() writes plain file names
+			}
+			start = end + 1;
+			while (!s.empty() && (s.back() == L'\r')) {
+				s.pop_back();
+			}
+
+			size_t n;
+			UINT l, t, r, b;
+			int used = 0;
+			if (swscanf(s.c_str(), L"page %zu %n", &n, &used) == 1 && used) {
+				SS2DBitmap* page = new SS2DBitmap((folder + s.substr(used)).c_str());
+				m_pages.push_back(page);
+				pagesToLoad.push_back(page);
+			}
+			else if ((swscanf(s.c_str(), L"%zu %u %u %u %u %n", &n, &l, &t, &r, &b, &used) == 5) && used &&
+				(firstPage + n < m_pages.size())) {
+				std::wstring name = s.substr(used);
+				D2D1_RECT_U source = D2D1::RectU(l, t, r, b);
+				m_entries.push_back(Entry(name, firstPage + n, source));
+				for (auto p : bitmaps) {
+					if (p && !p->IsRegion() && (p->GetFilePath() == name)) {
+						p->SetRegion(m_pages[firstPage + n], source);
+					}
+				}
+			}
+		}
+		return m_pages.size() > firstPage;
+	}
+
+protected:
+	// Copy the bitmap into the page at r, repeating its edges into the padding
+	void CopyPadded(const SS2DBitmap* p, const D2D1_RECT_U& r, uint32_t* dst, UINT width, UINT height) const {
+		const uint32_t* src = p->GetPixels();
+		int w = (int)p->GetPixelsWidth(), h = (int)p->GetPixelsHeight();
+		int pad = (int)m_padding;
+		for (int y = -pad; y < h + pad; y++) {
+			int sy = (std::min)((std::max)(y, 0), h - 1);
+			uint32_t* row = dst + (size_t)(r.top + y) * width + r.left;
+			for (int x = -pad; x < w + pad; x++) {
+				int sx = (std::min)((std::max)(x, 0), w - 1);
+				row[x] = src[(size_t)sy * w + sx];
+			}
+		}
+	}
+
+	static std::wstring FileName(const std::wstring& path) {
+		size_t slash = path.find_last_of(L"\\/");
+		return (slash == std::wstring::npos) ? path : path.substr(slash + 1);
+	}
+
+	// PNG stores straight alpha so the page's premultiplied pixels are converted back
+	static HRESULT SavePNG(IWICImagingFactory* pIWICFactory, const SS2DBitmap* page, const std::wstring& file) {
+		UINT width = page->GetPixelsWidth(), height = page->GetPixelsHeight();
+		std::vector<uint32_t> straight(page->GetPixels(), page->GetPixels() + (size_t)width * height);
+		for (auto& px : straight) {
+			uint32_t a = px >> 24;
+			if (a && (a < 255)) {
+				uint32_t b = (std::min)(255u, ((px & 0xff) * 255 + a / 2) / a);
+				uint32_t g = (std::min)(255u, (((px >> 8) & 0xff) * 255 + a / 2) / a);
+				uint32_t r = (std::min)(255u, (((px >> 16) & 0xff) * 255 + a / 2) / a);
+				px = (a << 24) | (r << 16) | (g << 8) | b;
+			}
+		}
+
+		IWICStream* pStream = NULL;
+		IWICBitmapEncoder* pEncoder = NULL;
+		IWICBitmapFrameEncode* pFrame = NULL;
+		WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
+
+		HRESULT hr = pIWICFactory->CreateStream(&pStream);
+		if (SUCCEEDED(hr)) {
+			hr = pStream->InitializeFromFilename(file.c_str(), GENERIC_WRITE);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pIWICFactory->CreateEncoder(GUID_ContainerFormatPng, NULL, &pEncoder);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pEncoder->Initialize(pStream, WICBitmapEncoderNoCache);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pEncoder->CreateNewFrame(&pFrame, NULL);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pFrame->Initialize(NULL);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pFrame->SetSize(width, height);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pFrame->SetPixelFormat(&format);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pFrame->WritePixels(height, width * 4, (UINT)(straight.size() * 4), (BYTE*)straight.data());
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pFrame->Commit();
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pEncoder->Commit();
+		}
+
+		SafeRelease(&pFrame);
+		SafeRelease(&pEncoder);
+		SafeRelease(&pStream);
+		return hr;
+	}
+
+protected:
+	UINT m_pageSize;
+	UINT m_padding;
+	std::vector<SS2DBitmap*> m_pages;
+	std::vector<Entry> m_entries;
+};
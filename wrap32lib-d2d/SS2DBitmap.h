@@ -2,14 +2,19 @@
 
 #include <wrap32lib.h>
 
+#include <stdint.h>
+#include <vector>
+
 #include "d2dtypes.h"
 #include "SS2DEssentials.h"
+#include "SS2DArchive.h"
 
 #pragma comment(lib, "windowscodecs")
 
 class SS2DBitmap {
 public:
-	SS2DBitmap(LPCWSTR filePath) : m_pBitmap(NULL), m_filePath(filePath) {
+	SS2DBitmap(LPCWSTR filePath) : m_pBitmap(NULL), m_filePath(filePath), m_pixelsWidth(0), m_pixelsHeight(0), m_page(NULL), m_version(0), m_loading(false) {
+		m_source = D2D1::RectU(0, 0, 0, 0);
 	}
 
 	~SS2DBitmap() {
@@ -20,18 +25,187 @@ public:
 		SafeRelease(&m_pBitmap);
 	}
 
-	bool IsValid() const { return m_pBitmap != NULL;  }
+	bool IsValid() const { return GetPage()->m_pBitmap != NULL;  }
+	ID2D1Bitmap* GetD2DBitmap() const { return m_pBitmap; }
+
+	// Takes over the caller's reference e.g. for a layer (SS2DRenderBackend::RenderLayer())
+	void SetD2DBitmap(ID2D1Bitmap* p) {
+		Clear();
+		m_pBitmap = p;
+		m_version++;
+	}
+
+	// Goes up each time the image is replaced so a redrawn layer doesn't look like the old one
+	uint32_t GetVersion() const { return m_version; }
+	const std::wstring& GetFilePath() const { return m_filePath; }
+
+	// A bitmap can be a region of an atlas page (see SS2DAtlas.h). It then has no image
+	// of its own and draws the source rect of the page's.
+	bool IsRegion() const { return m_page != NULL; }
+	const SS2DBitmap* GetPage() const { return m_page ? m_page : this; }
+
+	void SetRegion(const SS2DBitmap* page, const D2D1_RECT_U& source) {
+		Clear();
+		m_pixels.clear();
+		m_pixels.shrink_to_fit();
+		m_page = page;
+		m_source = source;
+	}
+
+	// Pixels of GetPage() this bitmap draws
+	D2D1_RECT_U GetSourceRect() const {
+		if (m_page) {
+			return m_source;
+		}
+		w32Size size = GetSize();
+		return D2D1::RectU(0, 0, size.cx, size.cy);
+	}
 
 	w32Size GetSize() const {
+		if (m_page) {
+			return w32Size(m_source.right - m_source.left, m_source.bottom - m_source.top);
+		}
 		if (m_pBitmap) {
 			D2D1_SIZE_F sf = m_pBitmap->GetSize();
 			return w32Size((long)sf.width, (long)sf.height);
 		}
-		return w32Size(0, 0);
+		return w32Size(m_pixelsWidth, m_pixelsHeight);
+	}
+
+	// CPU copy of the image for the software backend. 32bpp premultiplied BGRA, top down.
+	bool HasPixels() const { return !m_pixels.empty(); }
+	const uint32_t* GetPixels() const { return m_pixels.data(); }
+	UINT GetPixelsWidth() const { return m_pixelsWidth; }
+	UINT GetPixelsHeight() const { return m_pixelsHeight; }
+
+	void SetPixels(UINT width, UINT height, const uint32_t* pixels) {
+		m_pixelsWidth = width;
+		m_pixelsHeight = height;
+		m_pixels.assign(pixels, pixels + (size_t)width * height);
+		m_version++;
+	}
+
+	// SetPixels() without the copy. pixels gets whatever the bitmap had.
+	void SwapPixels(UINT width, UINT height, std::vector<uint32_t>& pixels) {
+		m_pixelsWidth = width;
+		m_pixelsHeight = height;
+		m_pixels.swap(pixels);
+		m_version++;
+	}
+
+	// Being decoded by an SS2DBitmapLoader. Shapes draw a placeholder until it's done.
+	bool IsLoading() const { return GetPage()->m_loading; }
+	void SetLoading(bool b) { m_loading = b; }
+
+	HRESULT LoadPixelsFromFile(IWICImagingFactory* pIWICFactory) {
+		std::vector<uint32_t> pixels;
+		UINT width = 0, height = 0;
+		HRESULT hr = DecodeFile(pIWICFactory, m_filePath.c_str(), &width, &height, pixels);
+		if (SUCCEEDED(hr)) {
+			SwapPixels(width, height, pixels);
+		}
+		return hr;
+	}
+
+	// Decode an image file to 32bpp premultiplied BGRA. Touches no bitmap so any thread can do it.
+	// Pixels packed in the mounted SS2DArchive needn't be decoded at all.
+	static HRESULT DecodeFile(IWICImagingFactory* pIWICFactory, LPCWSTR filePath, UINT* pWidth, UINT* pHeight, std::vector<uint32_t>& pixels) {
+		if (SS2DArchive::Mounted().ReadPixels(filePath, pWidth, pHeight, pixels)) {
+			return S_OK;
+		}
+
+		IWICBitmapDecoder* pDecoder = NULL;
+		IWICBitmapFrameDecode* pSource = NULL;
+		IWICFormatConverter* pConverter = NULL;
+		IWICStream* pStream = NULL;
+		std::vector<BYTE> expanded;
+		UINT width = 0, height = 0;
+
+		HRESULT hr = CreateDecoder(pIWICFactory, filePath, &pDecoder, &pStream, expanded);
+
+		if (SUCCEEDED(hr)) {
+			hr = pDecoder->GetFrame(0, &pSource);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pIWICFactory->CreateFormatConverter(&pConverter);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pConverter->Initialize(
+				pSource,
+				GUID_WICPixelFormat32bppPBGRA,
+				WICBitmapDitherTypeNone,
+				NULL,
+				0.f,
+				WICBitmapPaletteTypeMedianCut
+			);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pConverter->GetSize(&width, &height);
+		}
+		if (SUCCEEDED(hr)) {
+			pixels.resize((size_t)width * height);
+			hr = pConverter->CopyPixels(NULL, width * 4, (UINT)(pixels.size() * 4), (BYTE*)pixels.data());
+		}
+
+		if (SUCCEEDED(hr)) {
+			*pWidth = width;
+			*pHeight = height;
+		}
+		else {
+			pixels.clear();
+		}
+
+		SafeRelease(&pDecoder);
+		SafeRelease(&pSource);
+		SafeRelease(&pConverter);
+		SafeRelease(&pStream);
+		return hr;
+	}
+
+	// A decoder for the file in the mounted SS2DArchive, read from the map, or on disk if it isn't there.
+	// *ppStream and expanded have to outlive the decoder.
+	static HRESULT CreateDecoder(IWICImagingFactory* pIWICFactory, LPCWSTR filePath, IWICBitmapDecoder** ppDecoder, IWICStream** ppStream, std::vector<BYTE>& expanded) {
+		const SS2DArchive& archive = SS2DArchive::Mounted();
+		const BYTE* data = NULL;
+		size_t size = 0;
+		if (!archive.GetFile(filePath, &data, &size) && archive.Read(filePath, expanded)) {
+			data = expanded.data();
+			size = expanded.size();
+		}
+		if (!data) {
+			return pIWICFactory->CreateDecoderFromFilename(
+				filePath,
+				NULL,
+				GENERIC_READ,
+				WICDecodeMetadataCacheOnLoad,
+				ppDecoder
+			);
+		}
+
+		HRESULT hr = pIWICFactory->CreateStream(ppStream);
+		if (SUCCEEDED(hr)) {
+			hr = (*ppStream)->InitializeFromMemory(const_cast<BYTE*>(data), (DWORD)size);	// only read
+		}
+		if (SUCCEEDED(hr)) {
+			hr = pIWICFactory->CreateDecoderFromStream(*ppStream, NULL, WICDecodeMetadataCacheOnLoad, ppDecoder);
+		}
+		return hr;
 	}
 
 	void Render(ID2D1RenderTarget* pRenderTarget, const D2D1_RECT_F& rectBounds, FLOAT opacity) const {
-		if (m_pBitmap) {
+		if (m_page) {
+			if (m_page->m_pBitmap) {
+				D2D1_RECT_F source = D2D1::RectF((FLOAT)m_source.left, (FLOAT)m_source.top, (FLOAT)m_source.right, (FLOAT)m_source.bottom);
+				pRenderTarget->DrawBitmap(
+					m_page->m_pBitmap,
+					rectBounds,
+					opacity,
+					D2D1_BITMAP_INTERPOLATION_MODE_LINEAR,
+					source
+				);
+			}
+		}
+		else if (m_pBitmap) {
 			pRenderTarget->DrawBitmap(
 				m_pBitmap,
 				rectBounds,
@@ -40,6 +214,21 @@ public:
 		}
 	}
 
+	// Make the Direct2D bitmap from the CPU pixels e.g. for an atlas page built at load time
+	HRESULT CreateFromPixels(ID2D1RenderTarget* pRenderTarget) {
+		Clear();
+		if (!HasPixels()) {
+			return E_FAIL;
+		}
+		return pRenderTarget->CreateBitmap(
+			D2D1::SizeU(m_pixelsWidth, m_pixelsHeight),
+			m_pixels.data(),
+			m_pixelsWidth * 4,
+			D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
+			&m_pBitmap
+		);
+	}
+
 	HRESULT LoadFromFile (
 		ID2D1RenderTarget* pRenderTarget,
 		IWICImagingFactory* pIWICFactory,
@@ -49,19 +238,29 @@ public:
 	{
 		HRESULT hr = S_OK;
 
+		// Packed pixels go straight from the map to the device
+		UINT width, height;
+		const uint32_t* pixels;
+		if ((destinationWidth == 0) && (destinationHeight == 0) &&
+			SS2DArchive::Mounted().GetPixels(m_filePath.c_str(), &width, &height, &pixels)) {
+			Clear();
+			return pRenderTarget->CreateBitmap(
+				D2D1::SizeU(width, height),
+				pixels,
+				width * 4,
+				D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
+				&m_pBitmap
+			);
+		}
+
 		IWICBitmapDecoder* pDecoder = NULL;
 		IWICBitmapFrameDecode* pSource = NULL;
 		IWICStream* pStream = NULL;
 		IWICFormatConverter* pConverter = NULL;
 		IWICBitmapScaler* pScaler = NULL;
+		std::vector<BYTE> expanded;
 
-		hr = pIWICFactory->CreateDecoderFromFilename(
-			m_filePath.c_str(),
-			NULL,
-			GENERIC_READ,
-			WICDecodeMetadataCacheOnLoad,
-			&pDecoder
-		);
+		hr = CreateDecoder(pIWICFactory, m_filePath.c_str(), &pDecoder, &pStream, expanded);
 
 		if (SUCCEEDED(hr)) {			// Create the initial frame.
 			hr = pDecoder->GetFrame(0, &pSource);
@@ -137,4 +336,13 @@ public:
 protected:
 	std::wstring m_filePath;
 	ID2D1Bitmap* m_pBitmap;
+
+	std::vector<uint32_t> m_pixels;	// LoadPixelsFromFile() / SetPixels()
+	UINT m_pixelsWidth;
+	UINT m_pixelsHeight;
+
+	const SS2DBitmap* m_page;	// SetRegion()
+	D2D1_RECT_U m_source;
+	uint32_t m_version;
+	bool m_loading;		// SetLoading()
 };
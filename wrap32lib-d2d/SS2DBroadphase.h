@@ -0,0 +1,205 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "Shape.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DSpatialHash is a uniform grid broadphase. Each shape is entered into
+// every cell its bounding box touches so queries only look at shapes in
+// the cells around the query rather than every shape in the world.
+//
+// It only narrows things down. Callers still do their own exact hit test
+// on what comes back.
+//
+// Shapes know they're in it (Shape::SetBroadphase()) and take themselves
+// out when they're deleted, so a query never returns a deleted shape.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DSpatialHash : public SS2DShapeIndex
+{
+protected:
+	class Entry {
+	public:
+		Entry() : m_shape(NULL), m_x0(0), m_y0(0), m_x1(-1), m_y1(-1), m_stamp(0), m_queryStamp(0) {}
+
+		Shape* m_shape;
+		RectF m_rect;
+		int m_x0, m_y0, m_x1, m_y1;	// cell range covered by m_rect
+		unsigned m_stamp;			// refresh pass that last saw this shape
+		mutable unsigned m_queryStamp;	// stops a shape being returned twice by one query
+	};
+
+public:
+	SS2DSpatialHash(FLOAT cellSize = 128.0f) : m_cellSize(cellSize), m_stamp(0), m_queryStamp(0) {}
+
+	~SS2DSpatialHash() {
+		Clear();
+	}
+
+	void SetCellSize(FLOAT cellSize) {
+		Clear();
+		m_cellSize = cellSize;
+	}
+
+	FLOAT GetCellSize() const { return m_cellSize; }
+
+	size_t Size() const { return m_entries.size(); }
+
+	void Clear() {
+		for (auto& it : m_entries) {
+			it.second.m_shape->SetBroadphase(NULL);
+		}
+		m_cells.clear();
+		m_entries.clear();
+	}
+
+	// Insert a shape or move it to its new bounds. Only touches the cells if the cell range changed.
+	void Update(Shape* p, const RectF& r) {
+		Entry& e = m_entries[p];
+		e.m_shape = p;
+		p->SetBroadphase(this);
+		e.m_rect = r;
+		e.m_stamp = m_stamp;
+
+		int x0 = CellCoord(r.left), y0 = CellCoord(r.top);
+		int x1 = CellCoord(r.right), y1 = CellCoord(r.bottom);
+		if ((x0 == e.m_x0) && (y0 == e.m_y0) && (x1 == e.m_x1) && (y1 == e.m_y1)) {
+			return;
+		}
+
+		RemoveFromCells(e);
+		e.m_x0 = x0;	e.m_y0 = y0;
+		e.m_x1 = x1;	e.m_y1 = y1;
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				m_cells[CellKey(x, y)].push_back(&e);
+			}
+		}
+	}
+
+	void Remove(Shape* p) override {
+		auto it = m_entries.find(p);
+		if (it != m_entries.end()) {
+			p->SetBroadphase(NULL);
+			RemoveFromCells(it->second);
+			m_entries.erase(it);
+		}
+	}
+
+	// A refresh pass is BeginRefresh(), Update() for everything still alive, EndRefresh().
+	// Anything not updated in between (inactive, or out of the world) is dropped.
+	void BeginRefresh() {
+		m_stamp++;
+	}
+
+	void EndRefresh() {
+		for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+			if (it->second.m_stamp != m_stamp) {
+				it->second.m_shape->SetBroadphase(NULL);
+				RemoveFromCells(it->second);
+				it = m_entries.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	// All shapes whose bounds overlap r
+	int Query(const RectF& r, std::vector<Shape*>& ret) const {
+		m_queryStamp++;
+
+		int count = 0;
+		int x0 = CellCoord(r.left), y0 = CellCoord(r.top);
+		int x1 = CellCoord(r.right), y1 = CellCoord(r.bottom);
+		RectF rQuery = r;
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				auto it = m_cells.find(CellKey(x, y));
+				if (it == m_cells.end()) {
+					continue;
+				}
+
+				for (auto e : it->second) {
+					if (e->m_queryStamp != m_queryStamp) {
+						e->m_queryStamp = m_queryStamp;
+						if (rQuery.hitTest(e->m_rect)) {
+							ret.push_back(e->m_shape);
+							count++;
+						}
+					}
+				}
+			}
+		}
+		return count;
+	}
+
+	// Every pair of shapes whose bounds overlap, each pair reported once
+	int QueryPairs(std::vector<std::pair<Shape*, Shape*>>& ret) const {
+		int count = 0;
+		for (auto& cell : m_cells) {
+			auto& entries = cell.second;
+			for (size_t i = 0; i < entries.size(); i++) {
+				RectF r = entries[i]->m_rect;
+				for (size_t j = i + 1; j < entries.size(); j++) {
+					const RectF& rOther = entries[j]->m_rect;
+					if (!r.hitTest(rOther)) {
+						continue;
+					}
+
+					// A pair can share several cells. Only report it from the cell holding the top left of the overlap.
+					FLOAT left = (r.left > rOther.left) ? r.left : rOther.left;
+					FLOAT top = (r.top > rOther.top) ? r.top : rOther.top;
+					if (CellKey(CellCoord(left), CellCoord(top)) == cell.first) {
+						ret.push_back(std::make_pair(entries[i]->m_shape, entries[j]->m_shape));
+						count++;
+					}
+				}
+			}
+		}
+		return count;
+	}
+
+protected:
+	int CellCoord(FLOAT f) const {
+		return (int)floor(f / m_cellSize);
+	}
+
+	static ULONGLONG CellKey(int x, int y) {
+		return ((ULONGLONG)(uint32_t)x << 32) | (ULONGLONG)(uint32_t)y;
+	}
+
+	void RemoveFromCells(Entry& e) {
+		for (int y = e.m_y0; y <= e.m_y1; y++) {
+			for (int x = e.m_x0; x <= e.m_x1; x++) {
+				auto it = m_cells.find(CellKey(x, y));
+				if (it == m_cells.end()) {
+					continue;
+				}
+
+				auto& entries = it->second;
+				for (size_t i = 0; i < entries.size(); i++) {
+					if (entries[i] == &e) {
+						entries[i] = entries.back();	// order within a cell doesn't matter
+						entries.pop_back();
+						break;
+					}
+				}
+				if (entries.empty()) {
+					m_cells.erase(it);
+				}
+			}
+		}
+		e.m_x0 = e.m_y0 = 0;
+		e.m_x1 = e.m_y1 = -1;
+	}
+
+protected:
+	FLOAT m_cellSize;
+	std::unordered_map<ULONGLONG, std::vector<Entry*>> m_cells;
+	std::unordered_map<Shape*, Entry> m_entries;	// node based so Entry pointers in m_cells stay valid
+	unsigned m_stamp;
+	mutable unsigned m_queryStamp;
+};
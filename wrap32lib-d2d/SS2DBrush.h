@@ -4,9 +4,11 @@
 
 #include <d2d1.h>
 
+// Worlds share one brush between everyone asking for the same colour (SS2DWorld::NewResourceBrush()).
+// m_refs counts the askers.
 class SS2DBrush {
 public:
-	SS2DBrush(COLORREF cr, FLOAT alpha = 1.0f) : m_pBrush(NULL), m_cr(cr), m_alpha(alpha)
+	SS2DBrush(COLORREF cr, FLOAT alpha = 1.0f) : m_pBrush(NULL), m_cr(cr), m_alpha(alpha), m_refs(1)
 	{}
 
 	~SS2DBrush() {
@@ -14,14 +16,19 @@ public:
 	}
 
 	COLORREF GetColor() { return m_cr;  }
+	FLOAT GetAlpha() const { return m_alpha; }
 
 	void Clear() {
 		SafeRelease(&m_pBrush);
 	}
 
+	void AddRef() { m_refs++; }
+	UINT Release() { return --m_refs; }	// the owner deletes it at 0
+
 	operator ID2D1SolidColorBrush* () { return m_pBrush;  }
 
 	void Create(ID2D1HwndRenderTarget* pRenderTarget) {
+		Clear();
 		UINT32 rgb =
 			(m_cr & 0x000000ff) << 16 |
 			(m_cr & 0x0000ff00) |
@@ -34,4 +41,5 @@ protected:
 	ID2D1SolidColorBrush* m_pBrush;
 	COLORREF m_cr;
 	FLOAT m_alpha;
+	UINT m_refs;
 };
@@ -0,0 +1,595 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SS2DRenderBackend.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DRenderCommand is one drawing operation as plain data. Resources
+// are ids into the owning SS2DCommandList's tables rather than pointers
+// so a list can be copied, sorted, compared with last frame's or handed
+// to another thread without touching the shapes that made it.
+////////////////////////////////////////////////////////////////////////
+
+struct SS2DRenderCommand
+{
+	enum : uint8_t { clear, fillRect, drawRect, fillEllipse, bitmap, text };
+
+	uint64_t m_key;			// Sort key. Layer in the top 32 bits, order recorded in the bottom.
+	uint8_t m_kind;
+	uint8_t m_align;		// text - DWRITE_TEXT_ALIGNMENT
+	uint16_t m_version;		// bitmap - SS2DBitmap::GetVersion(), low bits
+	uint32_t m_resource;	// Brush id, or bitmap id for bitmap. 0 is none.
+	uint32_t m_format;		// text - format id
+	uint32_t m_string;		// text - index into the list's strings
+	uint32_t m_page;		// bitmap - id of the bitmap it's drawn from (its atlas page, or itself)
+	FLOAT m_opacity;		// bitmap
+	union {
+		D2D1_RECT_F m_rect;			// fillRect, drawRect, bitmap, text
+		D2D1_ELLIPSE m_ellipse;		// fillEllipse
+		D2D1_COLOR_F m_color;		// clear
+	};
+};
+
+////////////////////////////////////////////////////////////////////////
+// SS2DCommandList records what shapes draw instead of drawing it.
+// Point SS2DEssentials::m_pBackend at one during the draw pass, then
+// Replay() it into the real backend. Reset() starts a new frame but
+// keeps the resource ids so they stay the same from frame to frame,
+// and keeps the frame before so GetChanges() can say what moved.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DCommandList : public SS2DRenderBackend
+{
+public:
+	SS2DCommandList() : m_layer(0), m_pOutput(NULL) {
+		ResetResources();
+	}
+
+	// Start a new frame. The one just recorded becomes the previous frame.
+	void Reset() {
+		m_commands.swap(m_previous);
+		m_strings.swap(m_previousStrings);
+		m_commands.clear();
+		m_strings.clear();
+		m_layer = 0;
+	}
+
+	// Forget the resource ids too. Do this when the resources themselves go.
+	void ResetResources() {
+		Reset();
+		m_previous.clear();			// its ids mean nothing now
+		m_previousStrings.clear();
+		m_brushes.assign(1, NULL);		// id 0 is no resource
+		m_bitmaps.assign(1, NULL);
+		m_formats.assign(1, NULL);
+		m_brushIds.clear();
+		m_bitmapIds.clear();
+		m_formatIds.clear();
+	}
+
+	// The brush is being deleted. Its id isn't handed out again, so a new brush that
+	// happens to get the same address can't be mistaken for it by GetChanges().
+	void ForgetBrush(SS2DBrush* p) {
+		auto it = m_brushIds.find(p);
+		if (it != m_brushIds.end()) {
+			m_brushes[it->second] = NULL;
+			m_brushIds.erase(it);
+		}
+	}
+
+	// Commands recorded from now on sort after those on lower layers (see Sort())
+	void SetLayer(uint32_t layer) { m_layer = layer; }
+
+	// The backend this list will be replayed into. RenderLayer() goes straight there as
+	// the layer has to exist by the time it's drawn.
+	void SetOutput(SS2DRenderBackend* p) { m_pOutput = p; }
+
+	// Move everything recorded this frame by (dx, dy)
+	void Offset(FLOAT dx, FLOAT dy) {
+		for (auto& c : m_commands) {
+			switch (c.m_kind) {
+			case SS2DRenderCommand::clear:
+				break;
+			case SS2DRenderCommand::fillEllipse:
+				c.m_ellipse.point.x += dx;
+				c.m_ellipse.point.y += dy;
+				break;
+			default:
+				c.m_rect.left += dx;
+				c.m_rect.right += dx;
+				c.m_rect.top += dy;
+				c.m_rect.bottom += dy;
+				break;
+			}
+		}
+	}
+
+	// Order by key. Equal keys keep the order they were recorded in.
+	void Sort() {
+		std::stable_sort(m_commands.begin(), m_commands.end(),
+			[](const SS2DRenderCommand& a, const SS2DRenderCommand& b) { return a.m_key < b.m_key; });
+	}
+
+	size_t Size() const { return m_commands.size(); }
+	bool Empty() const { return m_commands.empty(); }
+	const std::vector<SS2DRenderCommand>& GetCommands() const { return m_commands; }
+	std::vector<SS2DRenderCommand>& GetCommands() { return m_commands; }
+
+	SS2DBrush* GetBrush(uint32_t id) const { return m_brushes[id]; }
+	const SS2DBitmap* GetBitmap(uint32_t id) const { return m_bitmaps[id]; }
+	IDWriteTextFormat* GetFormat(uint32_t id) const { return m_formats[id]; }
+	const std::wstring& GetString(uint32_t index) const { return m_strings[index]; }
+
+	// What the last Replay() did
+	class Stats {
+	public:
+		Stats() : m_commands(0), m_calls(0), m_batches(0), m_opaqueRuns(0) {}
+
+		size_t m_commands;	// Commands replayed
+		size_t m_calls;		// Backend calls they took
+		size_t m_batches;	// Calls that drew more than one command
+		size_t m_opaqueRuns;	// BeginOpaqueRun()s
+	};
+
+	const Stats& GetStats() const { return m_stats; }
+	void ResetStats() const { m_stats = Stats(); }
+
+	// Submit the frame to a real backend. Runs of fillRect, fillEllipse or bitmap commands
+	// in a row with the same brush, or bitmaps from the same atlas page, go to the backend
+	// as one batch. Runs of clears and opaque fills are bracketed with BeginOpaqueRun() and
+	// EndOpaqueRun().
+	void Replay(SS2DRenderBackend& backend) const {
+		ResetStats();
+		m_replay.resize(m_commands.size());
+		for (size_t i = 0; i < m_commands.size(); i++) {
+			m_replay[i] = (uint32_t)i;
+		}
+		ReplaySelected(backend);
+	}
+
+	// Just the commands that could draw inside clip, e.g. to redraw a dirty rect with the
+	// backend clipped to it. Adds to GetStats() so the rects of a frame can be totalled.
+	void Replay(SS2DRenderBackend& backend, const D2D1_RECT_F& clip) const {
+		m_replay.clear();
+		for (size_t i = 0; i < m_commands.size(); i++) {
+			if (Overlaps(Bounds(m_commands[i], m_strings), clip)) {
+				m_replay.push_back((uint32_t)i);
+			}
+		}
+		ReplaySelected(backend);
+	}
+
+	void Replay(SS2DRenderBackend& backend, const SS2DRenderCommand& c) const {
+		switch (c.m_kind) {
+		case SS2DRenderCommand::clear:
+			backend.Clear(D2D1::ColorF(c.m_color.r, c.m_color.g, c.m_color.b, c.m_color.a));
+			break;
+		case SS2DRenderCommand::fillRect:
+			backend.FillRectangle(c.m_rect, m_brushes[c.m_resource]);
+			break;
+		case SS2DRenderCommand::drawRect:
+			backend.DrawRectangle(c.m_rect, m_brushes[c.m_resource]);
+			break;
+		case SS2DRenderCommand::fillEllipse:
+			backend.FillEllipse(c.m_ellipse, m_brushes[c.m_resource]);
+			break;
+		case SS2DRenderCommand::bitmap:
+			backend.DrawBitmap(m_bitmaps[c.m_resource], c.m_rect, c.m_opacity);
+			break;
+		case SS2DRenderCommand::text:
+			backend.DrawString(m_strings[c.m_string], m_formats[c.m_format], (DWRITE_TEXT_ALIGNMENT)c.m_align, c.m_rect, m_brushes[c.m_resource]);
+			break;
+		}
+	}
+
+	// Add another list's commands (e.g. recorded on another thread) after ours, on their own layers
+	void Append(const SS2DCommandList& rhs) {
+		m_commands.reserve(m_commands.size() + rhs.m_commands.size());
+		for (auto c : rhs.m_commands) {
+			c.m_key = ((uint64_t)(c.m_key >> 32) << 32) | (uint32_t)m_commands.size();
+			switch (c.m_kind) {
+			case SS2DRenderCommand::bitmap:
+				c.m_resource = BitmapId(rhs.m_bitmaps[c.m_resource]);
+				c.m_page = BitmapId(rhs.m_bitmaps[c.m_page]);
+				break;
+			case SS2DRenderCommand::text:
+				c.m_format = FormatId(rhs.m_formats[c.m_format]);
+				c.m_string = AddString(rhs.m_strings[c.m_string]);
+				// fall through for the brush
+			default:
+				c.m_resource = BrushId(rhs.m_brushes[c.m_resource]);
+				break;
+			}
+			m_commands.push_back(c);
+		}
+	}
+
+	// Where this frame differs from the previous one. Commands in one frame but not the other
+	// (moved, shown, hidden, recoloured, new text...) add the rect they cover in that frame.
+	// So do commands that changed their order with others. Redrawing everything inside the
+	// rects gives the same picture as redrawing everything.
+	void GetChanges(std::vector<D2D1_RECT_F>& changed) const {
+		Fingerprint(m_commands, m_strings, m_changeThis);
+		Fingerprint(m_previous, m_previousStrings, m_changePrev);
+
+		// Pair up equal commands. Anything left over has changed.
+		m_changeMatch.assign(m_commands.size(), NoMatch);
+		size_t i = 0, j = 0;
+		while ((i < m_changeThis.size()) && (j < m_changePrev.size())) {
+			if (m_changeThis[i].first < m_changePrev[j].first) {
+				changed.push_back(Bounds(m_commands[m_changeThis[i++].second], m_strings));
+			}
+			else if (m_changePrev[j].first < m_changeThis[i].first) {
+				changed.push_back(Bounds(m_previous[m_changePrev[j++].second], m_previousStrings));
+			}
+			else {
+				uint32_t a = m_changeThis[i++].second;
+				uint32_t b = m_changePrev[j++].second;
+				if (Same(m_commands[a], m_strings, m_previous[b], m_previousStrings)) {
+					m_changeMatch[a] = b;
+				}
+				else {
+					changed.push_back(Bounds(m_commands[a], m_strings));
+					changed.push_back(Bounds(m_previous[b], m_previousStrings));
+				}
+			}
+		}
+		for (; i < m_changeThis.size(); i++) {
+			changed.push_back(Bounds(m_commands[m_changeThis[i].second], m_strings));
+		}
+		for (; j < m_changePrev.size(); j++) {
+			changed.push_back(Bounds(m_previous[m_changePrev[j].second], m_previousStrings));
+		}
+
+		// A command now drawn before one it used to be drawn after has changed places
+		uint32_t latest = 0;
+		for (size_t n = 0; n < m_changeMatch.size(); n++) {
+			uint32_t b = m_changeMatch[n];
+			if (b == NoMatch) {
+				continue;
+			}
+			if (b < latest) {
+				changed.push_back(Bounds(m_commands[n], m_strings));
+			}
+			else {
+				latest = b;
+			}
+		}
+	}
+
+	// The target rect a command can draw in. Anti-aliasing can spill a pixel past any
+	// shape. Clear covers everything.
+	static D2D1_RECT_F Bounds(const SS2DRenderCommand& c, const std::vector<std::wstring>& strings) {
+		switch (c.m_kind) {
+		case SS2DRenderCommand::clear:
+			return D2D1::RectF(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX);
+		case SS2DRenderCommand::fillEllipse:
+			return D2D1::RectF(c.m_ellipse.point.x - c.m_ellipse.radiusX - 1, c.m_ellipse.point.y - c.m_ellipse.radiusY - 1,
+				c.m_ellipse.point.x + c.m_ellipse.radiusX + 1, c.m_ellipse.point.y + c.m_ellipse.radiusY + 1);
+		case SS2DRenderCommand::text:
+			return TextBounds(c, strings[c.m_string]);
+		default:
+			return D2D1::RectF(c.m_rect.left - 1, c.m_rect.top - 1, c.m_rect.right + 1, c.m_rect.bottom + 1);
+		}
+	}
+
+	static bool Overlaps(const D2D1_RECT_F& a, const D2D1_RECT_F& b) {
+		return (a.left < b.right) && (b.left < a.right) && (a.top < b.bottom) && (b.top < a.bottom);
+	}
+
+	// Index of the first command that differs from rhs, or Size() of the longer list if one
+	// is the start of the other. -1 if they're the same. Both lists must share resource ids
+	// (i.e. be the same list on different frames, or copies of one) for this to mean anything.
+	int FirstDifference(const SS2DCommandList& rhs) const {
+		size_t n = (std::min)(m_commands.size(), rhs.m_commands.size());
+		for (size_t i = 0; i < n; i++) {
+			const SS2DRenderCommand& a = m_commands[i];
+			const SS2DRenderCommand& b = rhs.m_commands[i];
+			bool same = (a.m_kind == SS2DRenderCommand::text) ? SameText(a, b, rhs) : (memcmp(&a, &b, sizeof(a)) == 0);
+			if (!same) {
+				return (int)i;
+			}
+		}
+		return (m_commands.size() == rhs.m_commands.size()) ? -1 : (int)n;
+	}
+
+	// SS2DRenderBackend. Recording.
+	void Clear(const D2D1::ColorF& c) override {
+		SS2DRenderCommand& cmd = Add(SS2DRenderCommand::clear, 0);
+		cmd.m_color = c;
+	}
+
+	void FillEllipse(const D2D1_ELLIPSE& e, SS2DBrush* brush) override {
+		SS2DRenderCommand& cmd = Add(SS2DRenderCommand::fillEllipse, BrushId(brush));
+		cmd.m_ellipse = e;
+	}
+
+	void FillRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		SS2DRenderCommand& cmd = Add(SS2DRenderCommand::fillRect, BrushId(brush));
+		cmd.m_rect = r;
+	}
+
+	void DrawRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		SS2DRenderCommand& cmd = Add(SS2DRenderCommand::drawRect, BrushId(brush));
+		cmd.m_rect = r;
+	}
+
+	void DrawBitmap(const SS2DBitmap* bitmap, const D2D1_RECT_F& r, FLOAT opacity) override {
+		SS2DRenderCommand& cmd = Add(SS2DRenderCommand::bitmap, BitmapId(bitmap));
+		cmd.m_page = BitmapId(bitmap->GetPage());
+		cmd.m_version = (uint16_t)bitmap->GetPage()->GetVersion();
+		cmd.m_rect = r;
+		cmd.m_opacity = opacity;
+	}
+
+	void DrawString(const std::wstring& text, IDWriteTextFormat* format, DWRITE_TEXT_ALIGNMENT ta, const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		uint32_t string = AddString(text);
+		SS2DRenderCommand& cmd = Add(SS2DRenderCommand::text, BrushId(brush));
+		cmd.m_rect = r;
+		cmd.m_align = (uint8_t)ta;
+		cmd.m_format = FormatId(format);
+		cmd.m_string = string;
+	}
+
+	// Clips aren't recorded. Replay(backend, clip) clips on the way out.
+	void PushClip(const D2D1_RECT_F& r) override {}
+	void PopClip() override {}
+
+	bool RenderLayer(SS2DBitmap* layer, UINT width, UINT height, const std::function<void(SS2DRenderBackend&)>& draw) override {
+		return m_pOutput ? m_pOutput->RenderLayer(layer, width, height, draw) : false;
+	}
+
+protected:
+	SS2DRenderCommand& Add(uint8_t kind, uint32_t resource) {
+		m_commands.emplace_back();
+		SS2DRenderCommand& cmd = m_commands.back();
+		memset(&cmd, 0, sizeof(cmd));	// padding too, so lists compare with memcmp
+		cmd.m_key = ((uint64_t)m_layer << 32) | (uint32_t)(m_commands.size() - 1);
+		cmd.m_kind = kind;
+		cmd.m_resource = resource;
+		return cmd;
+	}
+
+	static bool SameBatch(const SS2DRenderCommand& a, const SS2DRenderCommand& b) {
+		if (a.m_kind != b.m_kind) {
+			return false;
+		}
+		return (a.m_kind == SS2DRenderCommand::bitmap) ? (a.m_page == b.m_page) : (a.m_resource == b.m_resource);
+	}
+
+	// Draws over whatever's under it
+	bool Covers(const SS2DRenderCommand& c) const {
+		switch (c.m_kind) {
+		case SS2DRenderCommand::clear:
+			return true;
+		case SS2DRenderCommand::fillRect:
+		case SS2DRenderCommand::fillEllipse:
+			return m_brushes[c.m_resource] && (m_brushes[c.m_resource]->GetAlpha() >= 1.0f);
+		default:
+			return false;
+		}
+	}
+
+	// Replay the commands indexed by m_replay, in batches where they can be
+	void ReplaySelected(SS2DRenderBackend& backend) const {
+		m_stats.m_commands += m_replay.size();
+
+		size_t i = 0;
+		while (i < m_replay.size()) {
+			bool covers = Covers(m_commands[m_replay[i]]);
+			size_t end = i + 1;
+			while ((end < m_replay.size()) && (Covers(m_commands[m_replay[end]]) == covers)) {
+				end++;
+			}
+
+			if (covers && (end - i > 1)) {
+				backend.BeginOpaqueRun();
+				ReplayRange(backend, i, end);
+				backend.EndOpaqueRun();
+				m_stats.m_opaqueRuns++;
+			}
+			else {
+				ReplayRange(backend, i, end);
+			}
+			i = end;
+		}
+	}
+
+	// m_replay[first, last) in batches where they can be
+	void ReplayRange(SS2DRenderBackend& backend, size_t first, size_t last) const {
+		size_t i = first;
+		while (i < last) {
+			const SS2DRenderCommand& c = m_commands[m_replay[i]];
+			size_t end = i + 1;
+			if ((c.m_kind == SS2DRenderCommand::fillRect) ||
+				(c.m_kind == SS2DRenderCommand::fillEllipse) ||
+				(c.m_kind == SS2DRenderCommand::bitmap)) {
+				while ((end < last) && SameBatch(c, m_commands[m_replay[end]])) {
+					end++;
+				}
+			}
+
+			if (end - i == 1) {
+				Replay(backend, c);
+			}
+			else {
+				ReplayBatch(backend, i, end);
+				m_stats.m_batches++;
+			}
+			m_stats.m_calls++;
+			i = end;
+		}
+	}
+
+	// m_replay[first, end) all go together (SameBatch())
+	void ReplayBatch(SS2DRenderBackend& backend, size_t first, size_t end) const {
+		const SS2DRenderCommand& c = m_commands[m_replay[first]];
+		size_t count = end - first;
+		switch (c.m_kind) {
+		case SS2DRenderCommand::fillRect:
+			m_batchRects.clear();
+			for (size_t i = first; i < end; i++) {
+				m_batchRects.push_back(m_commands[m_replay[i]].m_rect);
+			}
+			backend.FillRectangles(m_batchRects.data(), count, m_brushes[c.m_resource]);
+			break;
+		case SS2DRenderCommand::fillEllipse:
+			m_batchEllipses.clear();
+			for (size_t i = first; i < end; i++) {
+				m_batchEllipses.push_back(m_commands[m_replay[i]].m_ellipse);
+			}
+			backend.FillEllipses(m_batchEllipses.data(), count, m_brushes[c.m_resource]);
+			break;
+		case SS2DRenderCommand::bitmap:
+			m_batchBitmaps.clear();
+			m_batchRects.clear();
+			m_batchOpacity.clear();
+			for (size_t i = first; i < end; i++) {
+				const SS2DRenderCommand& cmd = m_commands[m_replay[i]];
+				m_batchBitmaps.push_back(m_bitmaps[cmd.m_resource]);
+				m_batchRects.push_back(cmd.m_rect);
+				m_batchOpacity.push_back(cmd.m_opacity);
+			}
+			backend.DrawSprites(m_batchBitmaps.data(), m_batchRects.data(), m_batchOpacity.data(), count);
+			break;
+		}
+	}
+
+	uint32_t AddString(const std::wstring& s) {
+		m_strings.push_back(s);
+		return (uint32_t)(m_strings.size() - 1);
+	}
+
+	bool SameText(const SS2DRenderCommand& a, const SS2DRenderCommand& b, const SS2DCommandList& rhs) const {
+		SS2DRenderCommand bb = b;
+		bb.m_string = a.m_string;
+		return (memcmp(&a, &bb, sizeof(a)) == 0) && (m_strings[a.m_string] == rhs.m_strings[b.m_string]);
+	}
+
+	// Text too long for its layout rect spills out of the ends (which ends depends on the
+	// alignment) and out of the bottom if DirectWrite wraps it. The font size is the rect
+	// height. No character is wider than that.
+	static D2D1_RECT_F TextBounds(const SS2DRenderCommand& c, const std::wstring& text) {
+		FLOAT h = c.m_rect.bottom - c.m_rect.top;
+		FLOAT w = c.m_rect.right - c.m_rect.left;
+		FLOAT widest = (FLOAT)text.length() * h;
+		FLOAT over = (widest > w) ? widest - w : 0.0f;
+		FLOAT lines = ((over > 0) && (w > 0)) ? ceilf(widest / w) : 1.0f;
+
+		D2D1_RECT_F r = D2D1::RectF(c.m_rect.left - 1, c.m_rect.top - 1, c.m_rect.right + 1, c.m_rect.top + (lines + 0.5f) * h);
+		switch (c.m_align) {
+		case DWRITE_TEXT_ALIGNMENT_TRAILING:
+			r.left -= over;
+			break;
+		case DWRITE_TEXT_ALIGNMENT_CENTER:
+			r.left -= over / 2;
+			r.right += over / 2;
+			break;
+		default:
+			r.right += over;
+			break;
+		}
+		return r;
+	}
+
+	static constexpr uint32_t NoMatch = 0xffffffff;
+
+	// Draws the same thing, wherever it comes in the frame
+	static bool Same(const SS2DRenderCommand& a, const std::vector<std::wstring>& aStrings,
+		const SS2DRenderCommand& b, const std::vector<std::wstring>& bStrings) {
+		SS2DRenderCommand bb = b;
+		bb.m_key = a.m_key;
+		if (a.m_kind == SS2DRenderCommand::text) {
+			bb.m_string = a.m_string;
+			if (aStrings[a.m_string] != bStrings[b.m_string]) {
+				return false;
+			}
+		}
+		return memcmp(&a, &bb, sizeof(a)) == 0;
+	}
+
+	// (hash of what each command draws, its index) sorted by hash. FNV-1a over the
+	// command bar its key, and over the string rather than its index for text.
+	static void Fingerprint(const std::vector<SS2DRenderCommand>& commands, const std::vector<std::wstring>& strings,
+		std::vector<std::pair<uint64_t, uint32_t>>& out) {
+		out.resize(commands.size());
+		for (size_t i = 0; i < commands.size(); i++) {
+			SS2DRenderCommand c = commands[i];
+			c.m_key = 0;
+			uint64_t h = 14695981039346656037ull;
+			if (c.m_kind == SS2DRenderCommand::text) {
+				const std::wstring& s = strings[c.m_string];
+				h = Hash(h, s.data(), s.length() * sizeof(wchar_t));
+				c.m_string = 0;
+			}
+			out[i] = std::make_pair(Hash(h, &c, sizeof(c)), (uint32_t)i);
+		}
+		std::sort(out.begin(), out.end());
+	}
+
+	static uint64_t Hash(uint64_t h, const void* p, size_t size) {
+		const uint8_t* b = (const uint8_t*)p;
+		for (size_t i = 0; i < size; i++) {
+			h = (h ^ b[i]) * 1099511628211ull;
+		}
+		return h;
+	}
+
+	template<class T>
+	static uint32_t Intern(T* p, std::vector<T*>& table, std::unordered_map<T*, uint32_t>& ids) {
+		if (!p) {
+			return 0;
+		}
+		auto it = ids.find(p);
+		if (it != ids.end()) {
+			return it->second;
+		}
+		uint32_t id = (uint32_t)table.size();
+		table.push_back(p);
+		ids[p] = id;
+		return id;
+	}
+
+	uint32_t BrushId(SS2DBrush* p) { return Intern(p, m_brushes, m_brushIds); }
+	uint32_t BitmapId(const SS2DBitmap* p) { return Intern(p, m_bitmaps, m_bitmapIds); }
+	uint32_t FormatId(IDWriteTextFormat* p) { return Intern(p, m_formats, m_formatIds); }
+
+protected:
+	std::vector<SS2DRenderCommand> m_commands;
+	std::vector<std::wstring> m_strings;		// text, this frame
+	uint32_t m_layer;
+	SS2DRenderBackend* m_pOutput;	// SetOutput()
+
+	std::vector<SS2DRenderCommand> m_previous;	// the frame before, for GetChanges()
+	std::vector<std::wstring> m_previousStrings;
+
+	// id -> resource. Kept between frames.
+	std::vector<SS2DBrush*> m_brushes;
+	std::vector<const SS2DBitmap*> m_bitmaps;
+	std::vector<IDWriteTextFormat*> m_formats;
+	std::unordered_map<SS2DBrush*, uint32_t> m_brushIds;
+	std::unordered_map<const SS2DBitmap*, uint32_t> m_bitmapIds;
+	std::unordered_map<IDWriteTextFormat*, uint32_t> m_formatIds;
+
+	// Replay()
+	mutable Stats m_stats;
+	mutable std::vector<D2D1_RECT_F> m_batchRects;
+	mutable std::vector<D2D1_ELLIPSE> m_batchEllipses;
+	mutable std::vector<FLOAT> m_batchOpacity;
+	mutable std::vector<const SS2DBitmap*> m_batchBitmaps;
+	mutable std::vector<uint32_t> m_replay;		// indexes of the commands being replayed
+
+	// GetChanges()
+	mutable std::vector<std::pair<uint64_t, uint32_t>> m_changeThis;
+	mutable std::vector<std::pair<uint64_t, uint32_t>> m_changePrev;
+	mutable std::vector<uint32_t> m_changeMatch;	// this frame's index -> previous frame's, or NoMatch
+};
@@ -11,14 +11,25 @@
 #define SS2D_SHOW_BITMAP_BOUNDS		0x0002
 #define SS2D_SHOW_STATS				0x0004
 
+class SS2DRenderBackend;	// SS2DRenderBackend.h
+class SS2DBrush;			// SS2DBrush.h
+class SS2DTextFormats;		// SS2DText.h
+class SS2DAssetCache;		// SS2DAssets.h
+
 class SS2DEssentials {
 public:
 	SS2DEssentials() :
 		m_pDWriteFactory(NULL),
 		m_pRenderTarget(NULL),
 		m_pIWICFactory(NULL),
+		m_pBackend(NULL),
+		m_pTextFormats(NULL),
+		m_pAssets(NULL),
 		m_rsFAR(0, 0),
-		m_ss2dFlags(0)
+		m_ss2dFlags(0),
+		m_pBrushLoading(NULL),
+		m_cull(false),
+		m_culled(0)
 	{
 	}
 
@@ -31,7 +42,16 @@ public:
 
 	IDWriteFactory* m_pDWriteFactory;
 	IWICImagingFactory* m_pIWICFactory;
-	ID2D1HwndRenderTarget* m_pRenderTarget;
+	ID2D1HwndRenderTarget* m_pRenderTarget;	// NULL when running headless
+	SS2DRenderBackend* m_pBackend;			// What shapes draw with
+	SS2DTextFormats* m_pTextFormats;		// Shared by the shapes. NULL when running headless.
+	SS2DAssetCache* m_pAssets;				// Decoded images kept across worlds. NULL to decode every time.
 	SS2DRectScaler m_rsFAR;
 	DWORD m_ss2dFlags;
+
+	// Set by the world for its draw pass
+	SS2DBrush* m_pBrushLoading;	// What a bitmap still loading draws instead (SS2DUseAsyncLoading())
+	bool m_cull;				// See Shape::DrawIfVisible()
+	RectF m_rectCull;			// The world coordinates that end up in the user rect
+	mutable size_t m_culled;	// Shapes skipped. A group counts once.
 };
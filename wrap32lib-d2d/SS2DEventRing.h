@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#include "d2dtypes.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DEventRing is a bounded queue with no lock for exactly one producer
+// thread and one consumer thread, e.g. window messages in and the update
+// thread taking them out. Neither side ever waits for the other. When it's
+// full new items are dropped (and counted) rather than blocking the producer.
+// Push() says so, so it can keep any it can't lose some other way.
+////////////////////////////////////////////////////////////////////////
+
+template <class T, size_t Capacity = 256>
+class SS2DEventRing
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+	SS2DEventRing() : m_head(0), m_tailSeen(0), m_tail(0), m_headSeen(0), m_dropped(0) {}
+
+	// Producer only. false if it's full.
+	bool Push(const T& item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_headSeen >= Capacity) {
+			m_headSeen = m_head.load(std::memory_order_acquire);
+			if (tail - m_headSeen >= Capacity) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+		m_items[tail & (Capacity - 1)] = item;
+		m_tail.store(tail + 1, std::memory_order_release);	// publishes the item
+		return true;
+	}
+
+	// Consumer only. false if it's empty.
+	bool Pop(T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tailSeen) {
+			m_tailSeen = m_tail.load(std::memory_order_acquire);
+			if (head == m_tailSeen) {
+				return false;
+			}
+		}
+		item = m_items[head & (Capacity - 1)];
+		m_head.store(head + 1, std::memory_order_release);	// hands the slot back
+		return true;
+	}
+
+	size_t GetDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+protected:
+	// Each side's index on its own cache line along with its last look at the other's
+	alignas(64) std::atomic<size_t> m_head;		// written by the consumer
+	size_t m_tailSeen;
+	alignas(64) std::atomic<size_t> m_tail;		// written by the producer
+	size_t m_headSeen;
+	alignas(64) T m_items[Capacity];
+	std::atomic<size_t> m_dropped;
+};
+
+////////////////////////////////////////////////////////////////////////
+// SS2DLatestPoint hands the most recent point from one thread to another
+// with no lock. Anything set in between reads is simply replaced so a
+// burst of mouse moves costs the reader one load.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DLatestPoint
+{
+public:
+	SS2DLatestPoint() : m_packed(0) {}
+
+	void Set(const Point2F& pt) {
+		uint32_t x, y;
+		memcpy(&x, &pt.x, sizeof(x));
+		memcpy(&y, &pt.y, sizeof(y));
+		m_packed.store(((uint64_t)y << 32) | x, std::memory_order_relaxed);
+	}
+
+	Point2F Get() const {
+		uint64_t packed = m_packed.load(std::memory_order_relaxed);
+		uint32_t x = (uint32_t)packed, y = (uint32_t)(packed >> 32);
+		Point2F pt;
+		memcpy(&pt.x, &x, sizeof(x));
+		memcpy(&pt.y, &y, sizeof(y));
+		return pt;
+	}
+
+protected:
+	std::atomic<uint64_t> m_packed;	// x and y together so they're never torn
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+class Shape;
+
+////////////////////////////////////////////////////////////////////////
+// SS2DHandle is a 32 bit reference to a shape that can be held onto
+// safely. The low 20 bits index a slot in an SS2DHandleTable and the top
+// 12 bits hold the slot's generation. Releasing a slot bumps the
+// generation so old handles to it stop resolving instead of dangling.
+//
+// Handle 0 is never given out so it can be used as "no shape".
+////////////////////////////////////////////////////////////////////////
+
+typedef uint32_t SS2DHandle;
+
+class SS2DHandleTable
+{
+public:
+	static const SS2DHandle InvalidHandle = 0;
+
+	static const uint32_t IndexBits = 20;
+	static const uint32_t IndexMask = (1u << IndexBits) - 1;
+	static const uint32_t GenerationMask = (1u << (32 - IndexBits)) - 1;
+
+	SS2DHandleTable() : m_freeHead(NoSlot), m_live(0) {}
+
+	SS2DHandle Create(Shape* p) {
+		uint32_t index;
+		if (m_freeHead != NoSlot) {
+			index = m_freeHead;
+			m_freeHead = m_slots[index].m_nextFree;
+		}
+		else {
+			if (m_slots.size() > IndexMask) {
+				return InvalidHandle;	// out of slots
+			}
+			index = (uint32_t)m_slots.size();
+			m_slots.push_back(Slot());
+		}
+
+		Slot& slot = m_slots[index];
+		slot.m_shape = p;
+		slot.m_nextFree = NoSlot;
+		m_live++;
+		return Make(index, slot.m_generation);
+	}
+
+	void Release(SS2DHandle h) {
+		uint32_t index = h & IndexMask;
+		if (!IsValid(h)) {
+			return;
+		}
+
+		Slot& slot = m_slots[index];
+		slot.m_shape = NULL;
+		// Skip generation 0 when wrapping so a slot 0 handle is never 0
+		slot.m_generation = (slot.m_generation + 1) & GenerationMask;
+		if (slot.m_generation == 0) {
+			slot.m_generation = 1;
+		}
+		slot.m_nextFree = m_freeHead;
+		m_freeHead = index;
+		m_live--;
+	}
+
+	// NULL if the handle has been released (or was never valid)
+	Shape* Get(SS2DHandle h) const {
+		return IsValid(h) ? m_slots[h & IndexMask].m_shape : NULL;
+	}
+
+	bool IsValid(SS2DHandle h) const {
+		uint32_t index = h & IndexMask;
+		return (index < m_slots.size()) &&
+			(m_slots[index].m_shape != NULL) &&
+			(m_slots[index].m_generation == (h >> IndexBits));
+	}
+
+	// Point a live handle at a different object, e.g. after relocating it
+	void Rebind(SS2DHandle h, Shape* p) {
+		if (IsValid(h)) {
+			m_slots[h & IndexMask].m_shape = p;
+		}
+	}
+
+	size_t Live() const { return m_live; }
+
+protected:
+	static const uint32_t NoSlot = 0xffffffff;
+
+	static SS2DHandle Make(uint32_t index, uint32_t generation) {
+		return (generation << IndexBits) | index;
+	}
+
+	struct Slot {
+		Slot() : m_shape(NULL), m_generation(1), m_nextFree(NoSlot) {}
+
+		Shape* m_shape;
+		uint32_t m_generation;
+		uint32_t m_nextFree;
+	};
+
+protected:
+	std::vector<Slot> m_slots;
+	uint32_t m_freeHead;
+	size_t m_live;
+};
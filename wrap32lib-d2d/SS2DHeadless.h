@@ -0,0 +1,191 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <queue>
+
+#include "SS2DWorld.h"
+#include "SS2DRenderBackend.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DHeadless runs a world with no window, render target or timer.
+// It drives the same Init -> (Update, PreRender, Render)* -> DeInit
+// sequence as D2DWindow, as fast as it can, feeding in scripted input,
+// and times each phase. Drawing goes to an SS2DNullBackend unless
+// another backend (e.g. SS2DSoftwareBackend) is given.
+//
+// Ticks are simulated: tick n is reported to the world as n * msPerTick
+// after the start so TickDelta timers fire as they would in a real run.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DHeadless
+{
+public:
+	class Timings {
+	public:
+		Timings() : m_ticks(0), m_initMS(0), m_updateMS(0), m_preRenderMS(0), m_recordMS(0), m_renderMS(0), m_firstFrameMS(0), m_loadedMS(0), m_drawCalls(0), m_drawCallsCounted(false), m_quit(false) {}
+
+		double TotalMS() const { return m_updateMS + m_preRenderMS + m_recordMS + m_renderMS; }
+		double PerTickMS(double ms) const { return m_ticks ? ms / m_ticks : 0; }
+		double TicksPerSecond() const { return (TotalMS() > 0) ? m_ticks * 1000.0 / TotalMS() : 0; }
+
+		size_t m_ticks;			// Ticks actually run
+		double m_initMS;		// SS2DInit() + SS2DCreateResources()
+		double m_updateMS;		// SS2DUpdate() - the game logic and the move
+		double m_preRenderMS;	// D2DPreRender() - adding queued shapes
+		double m_recordMS;		// SS2DRecordFrame() - building the command list
+		double m_renderMS;		// SS2DSubmitFrame() - drawing it with the backend
+		double m_firstFrameMS;	// SS2DCreateResources() to the end of the first frame
+		double m_loadedMS;		// and to the last bitmap decoded. -1 if it never was.
+		size_t m_drawCalls;		// Backend calls the command list's replays made, or the null backend saw
+		bool m_drawCallsCounted;	// false if neither (the command list off and another backend)
+		bool m_quit;			// The world asked to stop before the end
+	};
+
+	SS2DHeadless(SS2DWorld& world, SS2DRenderBackend* backend = NULL) : m_world(world), m_targetSize(0, 0) {
+		m_ess.m_pBackend = backend ? backend : &m_backendNull;
+	}
+
+	// Size of what the backend draws into (e.g. an SS2DSoftwareBackend's framebuffer).
+	// The world is scaled to fit as it would be in a window. Defaults to the world's size.
+	void SetTargetSize(const w32Size& size) { m_targetSize = size; }
+
+	// Give the world a WIC factory to decode bitmaps into CPU pixels for the software backend
+	void SetWICFactory(IWICImagingFactory* pIWICFactory) { m_ess.m_pIWICFactory = pIWICFactory; }
+
+	// Keep decoded bitmaps in pAssets for the next run (as a window does). It has to outlive the runs.
+	void SetAssetCache(SS2DAssetCache* pAssets) { m_ess.m_pAssets = pAssets; }
+
+	// SS2D_SHOW_* flags, as toggled with Ctrl+G/B/S in a window
+	void SetFlags(DWORD flags) { m_ess.m_ss2dFlags = flags; }
+
+	// Scripted input. Events are delivered to SS2DUpdate() on the given tick.
+	void AddEvent(size_t tick, UINT msg, WPARAM wParam = 0, LPARAM lParam = 0) {
+		m_script.insert(std::make_pair(tick, WindowEvent(msg, wParam, lParam)));
+	}
+
+	void KeyPress(size_t tick, WPARAM vk, size_t holdTicks = 1) {
+		AddEvent(tick, WM_KEYDOWN, vk);
+		AddEvent(tick + holdTicks, WM_KEYUP, vk);
+	}
+
+	// The mouse stays where it's put until it's moved again
+	void MouseTo(size_t tick, const Point2F& pt) {
+		m_mouse[tick] = pt;
+	}
+
+	void Click(size_t tick, const Point2F& pt) {
+		MouseTo(tick, pt);
+		AddEvent(tick, WM_LBUTTONDOWN, MK_LBUTTON, MAKELPARAM((int)pt.x, (int)pt.y));
+		AddEvent(tick + 1, WM_LBUTTONUP, 0, MAKELPARAM((int)pt.x, (int)pt.y));
+	}
+
+	void ClearScript() {
+		m_script.clear();
+		m_mouse.clear();
+	}
+
+	Timings Run(size_t ticks, ULONGLONG msPerTick = 20) {
+		Timings t;
+		m_backendNull.ResetDrawCalls();
+
+		w32Size size = m_world.SS2DGetScreenSize();
+		w32Size target = (m_targetSize.cx > 0) ? m_targetSize : size;
+		m_ess.m_rsFAR.SetBaseSize(size);
+		m_ess.m_rsFAR.SetBounds(D2D1::SizeF((FLOAT)target.cx, (FLOAT)target.cy));
+
+		Clock::time_point start = Clock::now();
+		bool ok = m_world.SS2DInit();
+		m_world.SS2DCreateResources(m_ess);
+		t.m_initMS = Elapsed(start);
+
+		ULONGLONG tickStart = GetTickCount64();
+		Point2F mouse;
+		std::queue<WindowEvent> events;
+		SS2DInput input;	// as D2DWindow would make it
+		auto itScript = m_script.begin();
+
+		for (size_t n = 0; ok && (n < ticks); n++) {
+			auto itMouse = m_mouse.find(n);
+			if (itMouse != m_mouse.end()) {
+				mouse = itMouse->second;
+			}
+			ULONGLONG tick = tickStart + n * msPerTick;
+			input.BeginFrame();
+			input.SetMouse(mouse);
+			for (; (itScript != m_script.end()) && (itScript->first <= n); ++itScript) {
+				const WindowEvent& ev = itScript->second;
+				input.Apply(ev.m_msg, ev.m_wParam, ev.m_lParam);
+				events.push(ev);
+				events.back().m_time = tick;
+			}
+
+			start = Clock::now();
+			m_world.SS2DSetInput(input);
+			if (!m_world.SS2DUpdate(tick, mouse, events)) {
+				t.m_quit = true;
+				break;
+			}
+			t.m_updateMS += Elapsed(start);
+			events = std::queue<WindowEvent>();
+
+			start = Clock::now();
+			m_world.D2DPreRender(m_ess);
+			t.m_preRenderMS += Elapsed(start);
+
+			// D2DRender() in two halves. With the command list off the shapes draw
+			// as they're recorded so the clear has to come first. With dirty rects
+			// the world does its own clearing.
+			bool recording = m_world.SS2DUsingCommandList();
+			bool clear = !m_world.SS2DUsingDirtyRects();
+			start = Clock::now();
+			if (clear && !recording) {
+				m_ess.m_pBackend->Clear(m_world.m_colorBackground);
+			}
+			m_world.SS2DRecordFrame(m_ess);
+			t.m_recordMS += Elapsed(start);
+
+			start = Clock::now();
+			if (clear && recording) {
+				m_ess.m_pBackend->Clear(m_world.m_colorBackground);
+			}
+			m_world.SS2DSubmitFrame(m_ess);
+			t.m_renderMS += Elapsed(start);
+			if (recording) {
+				t.m_drawCalls += m_world.GetCommandList().GetStats().m_calls;
+				t.m_drawCallsCounted = true;
+			}
+
+			t.m_ticks++;
+		}
+
+		t.m_firstFrameMS = m_world.SS2DGetFirstFrameMS();
+		t.m_loadedMS = m_world.SS2DGetLoadedMS();
+
+		// Same order as D2DWindow::ThreadShutdown()
+		m_world.SS2DDiscardResources();
+		m_world.DeInit();
+
+		if (!t.m_drawCallsCounted && (m_ess.m_pBackend == &m_backendNull)) {
+			t.m_drawCalls = m_backendNull.GetDrawCalls();
+			t.m_drawCallsCounted = true;
+		}
+		return t;
+	}
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	static double Elapsed(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+protected:
+	SS2DWorld& m_world;
+	SS2DEssentials m_ess;
+	SS2DNullBackend m_backendNull;
+	w32Size m_targetSize;
+
+	std::multimap<size_t, WindowEvent> m_script;	// tick -> event, in the order added
+	std::map<size_t, Point2F> m_mouse;				// tick -> mouse position from then on
+};
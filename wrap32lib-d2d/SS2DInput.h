@@ -0,0 +1,138 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+
+#include "d2dtypes.h"
+
+// A window message as queued for the update thread (D2DWindow) or scripted (SS2DHeadless)
+class WindowEvent
+{
+public:
+	WindowEvent(UINT msg = 0, WPARAM wParam = 0, LPARAM lParam = 0, ULONGLONG time = 0) : m_msg(msg), m_wParam(wParam), m_lParam(lParam), m_time(time) {}
+
+	UINT m_msg;
+	WPARAM m_wParam;
+	LPARAM m_lParam;
+	ULONGLONG m_time;	// GetTickCount64() when it happened, to compare with SS2DUpdate()'s tick
+};
+
+////////////////////////////////////////////////////////////////////////
+// SS2DInput is the state of the keyboard and mouse for one frame, built
+// from window messages in the order they arrived and then left alone for
+// the frame so every question asked of it gets the same answer.
+// D2DWindow makes one per update (SS2DGetInput()) and SS2DHeadless makes
+// one from its script. The world gets a copy (SS2DWorld::SS2DSetInput()).
+//
+// Keys are virtual key codes, mouse buttons included (VK_LBUTTON etc.).
+// Left and right Ctrl, Shift and Alt are told apart as well as being
+// reported as VK_CONTROL, VK_SHIFT and VK_MENU.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DInput
+{
+public:
+	SS2DInput() {}
+
+	bool KeyDown(UINT vk) const { return (vk < Keys) && m_down.test(vk); }
+	bool KeyPressed(UINT vk) const { return (vk < Keys) && m_pressed.test(vk); }	// went down this frame
+	bool KeyReleased(UINT vk) const { return (vk < Keys) && m_released.test(vk); }	// came up this frame
+
+	const Point2F& GetMouse() const { return m_ptMouse; }
+	const std::wstring& GetText() const { return m_text; }	// typed this frame (WM_CHAR)
+
+	// Start a new frame. What's down stays down.
+	void BeginFrame() {
+		m_pressed.reset();
+		m_released.reset();
+		m_text.clear();
+	}
+
+	void SetMouse(const Point2F& pt) { m_ptMouse = pt; }
+
+	// Anything else is ignored
+	void Apply(UINT msg, WPARAM wParam, LPARAM lParam) {
+		switch (msg) {
+		case WM_KEYDOWN:
+		case WM_SYSKEYDOWN:
+			Press(Sided((UINT)wParam, lParam));
+			Press((UINT)wParam);
+			break;
+
+		case WM_KEYUP:
+		case WM_SYSKEYUP:
+		{
+			UINT vk = (UINT)wParam;
+			UINT sided = Sided(vk, lParam);
+			Release(sided);
+			if ((sided == vk) || !KeyDown(Other(sided))) {
+				Release(vk);	// e.g. VK_SHIFT stays down while the other shift is
+			}
+		}
+		break;
+
+		case WM_LBUTTONDOWN:	Press(VK_LBUTTON);		break;
+		case WM_LBUTTONUP:		Release(VK_LBUTTON);	break;
+		case WM_RBUTTONDOWN:	Press(VK_RBUTTON);		break;
+		case WM_RBUTTONUP:		Release(VK_RBUTTON);	break;
+		case WM_MBUTTONDOWN:	Press(VK_MBUTTON);		break;
+		case WM_MBUTTONUP:		Release(VK_MBUTTON);	break;
+
+		case WM_CHAR:
+			m_text += (wchar_t)wParam;
+			break;
+
+		case WM_KILLFOCUS:	// the key ups are going elsewhere
+			m_released |= m_down;
+			m_down.reset();
+			break;
+		}
+	}
+
+protected:
+	static const size_t Keys = 256;
+
+	void Press(UINT vk) {
+		if ((vk < Keys) && !m_down.test(vk)) {	// not auto repeat
+			m_down.set(vk);
+			m_pressed.set(vk);
+		}
+	}
+
+	void Release(UINT vk) {
+		if ((vk < Keys) && m_down.test(vk)) {
+			m_down.reset(vk);
+			m_released.set(vk);
+		}
+	}
+
+	// Which side a modifier's on, from the extended key flag (or scan code for shift)
+	static UINT Sided(UINT vk, LPARAM lParam) {
+		bool extended = (lParam & 0x01000000) != 0;
+		switch (vk) {
+		case VK_CONTROL:	return extended ? VK_RCONTROL : VK_LCONTROL;
+		case VK_MENU:		return extended ? VK_RMENU : VK_LMENU;
+		case VK_SHIFT:		return (((lParam >> 16) & 0xff) == 0x36) ? VK_RSHIFT : VK_LSHIFT;
+		default:			return vk;
+		}
+	}
+
+	static UINT Other(UINT sided) {
+		switch (sided) {
+		case VK_LCONTROL:	return VK_RCONTROL;
+		case VK_RCONTROL:	return VK_LCONTROL;
+		case VK_LMENU:		return VK_RMENU;
+		case VK_RMENU:		return VK_LMENU;
+		case VK_LSHIFT:		return VK_RSHIFT;
+		case VK_RSHIFT:		return VK_LSHIFT;
+		default:			return sided;
+		}
+	}
+
+protected:
+	std::bitset<Keys> m_down;
+	std::bitset<Keys> m_pressed;
+	std::bitset<Keys> m_released;
+	Point2F m_ptMouse;
+	std::wstring m_text;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Thread.h>
+#include <CriticalSection.h>
+
+#include "SS2DBitmap.h"
+#include "SS2DAssets.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DBitmapLoader decodes image files on worker threads so a world's
+// first frame doesn't wait for all of them.
+// The workers only make pixels (see SS2DBitmap::DecodeFile()) and never
+// touch a bitmap. Collect() hands the pixels over on the caller's thread,
+// which does any upload to the device itself.
+// Workers are started as files are queued and finish when there's
+// nothing left to decode. Files already in an SS2DAssetCache aren't decoded.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DBitmapLoader
+{
+public:
+	SS2DBitmapLoader(UINT maxWorkers = 4) : m_pIWICFactory(NULL), m_next(0), m_decoded(0), m_idle(0) {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		m_maxWorkers = (std::min)(maxWorkers, (std::max)((UINT)si.dwNumberOfProcessors - 1, 1u));	// leave one for the render thread
+	}
+
+	~SS2DBitmapLoader() {
+		Cancel();
+	}
+
+	// Queue bitmaps to be decoded with pIWICFactory (which has to be free-threaded, as WIC's own is).
+	// Each one is SetLoading() until Collect() hands it its pixels.
+	// pAssets (if any) is asked first and gets whatever has to be decoded. It has to outlive the loader.
+	void Load(IWICImagingFactory* pIWICFactory, const std::vector<SS2DBitmap*>& bitmaps, SS2DAssetCache* pAssets = NULL) {
+		if (bitmaps.empty()) {
+			return;
+		}
+
+		CSLocker lock(m_cs);
+		if (m_pIWICFactory != pIWICFactory) {
+			SafeRelease(&m_pIWICFactory);
+			m_pIWICFactory = pIWICFactory;
+			m_pIWICFactory->AddRef();
+		}
+		for (auto p : bitmaps) {
+			p->SetLoading(true);
+			m_jobs.push_back(Job(p, pAssets));
+		}
+
+		ReapWorkers();
+		size_t waiting = m_jobs.size() - m_next;
+		size_t running = m_workers.size() - m_idle;
+		while ((running < m_maxWorkers) && (running < waiting)) {
+			m_workers.emplace_back(new Worker(*this));
+			if (!m_workers.back()->Start()) {
+				m_workers.pop_back();
+				break;
+			}
+			running++;
+		}
+	}
+
+	// Hand over whatever has been decoded since the last call. Failed bitmaps come back
+	// too, with no pixels. Returns the number still being decoded.
+	size_t Collect(std::vector<SS2DBitmap*>& loaded) {
+		CSLocker lock(m_cs);
+		size_t loading = 0;
+		for (size_t n = 0; n < m_jobs.size(); n++) {
+			Job& j = m_jobs[n];
+			if (!j.m_done) {
+				loading++;
+			}
+			else if (j.m_bitmap) {
+				if (SUCCEEDED(j.m_hr)) {
+					j.m_bitmap->SwapPixels(j.m_width, j.m_height, j.m_pixels);
+				}
+				j.m_bitmap->SetLoading(false);
+				loaded.push_back(j.m_bitmap);
+				j.m_bitmap = NULL;
+			}
+		}
+
+		// The workers index from the front so only collected jobs there can go
+		while (!m_jobs.empty() && !m_jobs.front().m_bitmap) {
+			m_jobs.pop_front();
+			m_next--;
+			m_decoded--;
+		}
+		return loading;
+	}
+
+	// Until everything queued has been decoded. Doesn't Collect().
+	void Wait() {
+		for (;;) {
+			{
+				CSLocker lock(m_cs);
+				if (m_decoded == m_jobs.size()) {
+					return;
+				}
+			}
+			Sleep(1);
+		}
+	}
+
+	bool Busy() {
+		CSLocker lock(m_cs);
+		return !m_jobs.empty();	// collected jobs only stay behind one that isn't
+	}
+
+	// Stop the workers and forget anything not yet collected
+	void Cancel() {
+		for (auto& w : m_workers) {
+			w->Stop(false);
+		}
+		for (auto& w : m_workers) {
+			w->WaitForStopped();
+		}
+
+		CSLocker lock(m_cs);
+		for (auto& j : m_jobs) {
+			if (j.m_bitmap) {
+				j.m_bitmap->SetLoading(false);
+			}
+		}
+		m_jobs.clear();
+		m_workers.clear();
+		m_next = m_decoded = m_idle = 0;
+		SafeRelease(&m_pIWICFactory);
+	}
+
+protected:
+	struct Job {
+		Job(SS2DBitmap* p, SS2DAssetCache* pAssets) : m_bitmap(p), m_filePath(p->GetFilePath()), m_pAssets(pAssets), m_hr(E_FAIL), m_width(0), m_height(0), m_done(false) {}
+
+		SS2DBitmap* m_bitmap;			// only touched by Collect(). NULL once collected.
+		std::wstring m_filePath;
+		SS2DAssetCache* m_pAssets;
+		HRESULT m_hr;
+		UINT m_width;
+		UINT m_height;
+		std::vector<uint32_t> m_pixels;
+		bool m_done;
+	};
+
+	class Worker : public Thread
+	{
+	public:
+		Worker(SS2DBitmapLoader& loader) : m_loader(loader) {}
+		~Worker() { Stop(); }
+
+	protected:
+		void ThreadProc() override {
+			CoInitializeEx(NULL, COINIT_MULTITHREADED);
+			m_loader.Work(*this);
+			CoUninitialize();
+		}
+
+		SS2DBitmapLoader& m_loader;
+	};
+
+	// A worker's life. Decode until there's nothing left (or it's told to stop).
+	void Work(Worker& worker) {
+		m_cs.Enter();
+		while ((m_next < m_jobs.size()) && !worker.ShouldStop()) {
+			Job& j = m_jobs[m_next++];	// deque references survive push_back()
+			IWICImagingFactory* pIWICFactory = m_pIWICFactory;
+			pIWICFactory->AddRef();
+			m_cs.Leave();
+
+			if (j.m_pAssets && j.m_pAssets->GetPixels(j.m_filePath, 0, 0, &j.m_width, &j.m_height, j.m_pixels)) {
+				j.m_hr = S_OK;
+			}
+			else {
+				j.m_hr = SS2DBitmap::DecodeFile(pIWICFactory, j.m_filePath.c_str(), &j.m_width, &j.m_height, j.m_pixels);
+				if (SUCCEEDED(j.m_hr) && j.m_pAssets) {
+					j.m_pAssets->AddPixels(j.m_filePath, 0, 0, j.m_width, j.m_height, j.m_pixels);
+				}
+			}
+			pIWICFactory->Release();
+
+			m_cs.Enter();
+			j.m_done = true;
+			m_decoded++;
+		}
+		m_idle++;	// under the lock so Load() knows to start another
+		m_cs.Leave();
+	}
+
+	// Forget the workers that have finished
+	void ReapWorkers() {
+		for (size_t n = 0; n < m_workers.size();) {
+			if (!m_workers[n]->Running()) {	// so it's been through Work()
+				m_workers.erase(m_workers.begin() + n);
+				m_idle--;
+			}
+			else {
+				n++;
+			}
+		}
+	}
+
+protected:
+	CriticalSection m_cs;				// everything below
+	IWICImagingFactory* m_pIWICFactory;
+	std::deque<Job> m_jobs;				// in the order queued. Collect() takes them off the front.
+	size_t m_next;						// next job for a worker
+	size_t m_decoded;					// jobs done, collected or not
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	size_t m_idle;						// workers that have run out of jobs
+	UINT m_maxWorkers;
+};
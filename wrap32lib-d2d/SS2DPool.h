@@ -0,0 +1,95 @@
+#pragma once
+
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Shape.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DSlabPool hands out shapes of one type from fixed size slabs.
+// Freed slots go on a free list and are reused by the next Allocate() so
+// shapes that come and go every frame (bullets, snow) don't hit the heap.
+//
+// Pooled shapes remember their pool. Shape::Destroy() gives them back to
+// it, so anything that deletes shapes must go through Shape::Destroy().
+////////////////////////////////////////////////////////////////////////
+
+template<class T> class SS2DSlabPool : public SS2DShapePool
+{
+public:
+	SS2DSlabPool(size_t slabSize = 64) : m_slabSize(slabSize), m_free(NULL), m_freeCount(0), m_live(0), m_peak(0), m_misses(0) {}
+
+	~SS2DSlabPool() {
+		for (auto slab : m_slabs) {
+			delete[] slab;
+		}
+	}
+
+	template<class... Args> T* Allocate(Args&&... args) {
+		if (!m_free) {
+			m_misses++;	// nothing to reuse
+			AddSlab();
+		}
+
+		Slot* slot = m_free;
+		m_free = slot->m_next;
+		m_freeCount--;
+
+		T* p = new (slot->m_storage) T(std::forward<Args>(args)...);
+		p->m_pool = this;
+
+		if (++m_live > m_peak) {
+			m_peak = m_live;
+		}
+		return p;
+	}
+
+	void Free(Shape* p) override {
+		static_cast<T*>(p)->~T();
+
+		Slot* slot = reinterpret_cast<Slot*>(p);
+		slot->m_next = m_free;
+		m_free = slot;
+		m_freeCount++;
+		m_live--;
+	}
+
+	// Make sure there are at least n free slots so the first n allocations don't allocate
+	void Prewarm(size_t n) {
+		while (m_freeCount < n) {
+			AddSlab();
+		}
+	}
+
+	size_t Live() const { return m_live; }			// shapes currently allocated
+	size_t Peak() const { return m_peak; }			// most ever allocated at once
+	size_t Misses() const { return m_misses; }		// allocations that needed a new slab
+	size_t Capacity() const { return m_slabs.size() * m_slabSize; }
+
+protected:
+	union Slot {
+		Slot* m_next;	// while free
+		alignas(T) unsigned char m_storage[sizeof(T)];
+	};
+
+	void AddSlab() {
+		Slot* slab = new Slot[m_slabSize];
+		m_slabs.push_back(slab);
+		for (size_t i = m_slabSize; i-- > 0; ) {
+			slab[i].m_next = m_free;
+			m_free = &slab[i];
+		}
+		m_freeCount += m_slabSize;
+	}
+
+protected:
+	size_t m_slabSize;
+	std::vector<Slot*> m_slabs;
+	Slot* m_free;
+	size_t m_freeCount;
+
+	size_t m_live;
+	size_t m_peak;
+	size_t m_misses;
+};
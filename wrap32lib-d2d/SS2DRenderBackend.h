@@ -0,0 +1,303 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <d2d1_3.h>	// ID2D1SpriteBatch
+
+#include "SS2DEssentials.h"
+#include "SS2DBrush.h"
+#include "SS2DBitmap.h"
+#include "SS2DText.h"
+
+////////////////////////////////////////////////////////////////////////
+// SS2DRenderBackend is everything a shape needs to draw itself.
+// Shapes draw through SS2DEssentials::m_pBackend rather than the render
+// target so a world can run with no window at all (see SS2DHeadless.h).
+// All coordinates are already scaled to the target.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DRenderBackend
+{
+public:
+	virtual ~SS2DRenderBackend() {}
+
+	virtual void Clear(const D2D1::ColorF& c) = 0;
+	virtual void FillEllipse(const D2D1_ELLIPSE& e, SS2DBrush* brush) = 0;
+	virtual void FillRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) = 0;
+	virtual void DrawRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) = 0;
+	virtual void DrawBitmap(const SS2DBitmap* bitmap, const D2D1_RECT_F& r, FLOAT opacity) = 0;
+	virtual void DrawString(const std::wstring& text, IDWriteTextFormat* format, DWRITE_TEXT_ALIGNMENT ta, const D2D1_RECT_F& r, SS2DBrush* brush) = 0;
+
+	// Nothing (Clear() included) draws outside r until PopClip(). Clips nest.
+	virtual void PushClip(const D2D1_RECT_F& r) = 0;
+	virtual void PopClip() = 0;
+
+	// Run draw() against a transparent width x height offscreen backend of the same kind and
+	// keep what it drew in layer (replacing what was there) to DrawBitmap() from then on.
+	// false if this backend can't, and layer is left alone.
+	virtual bool RenderLayer(SS2DBitmap* layer, UINT width, UINT height, const std::function<void(SS2DRenderBackend&)>& draw) {
+		return false;
+	}
+
+	// Batches of the same brush or bitmap (see SS2DCommandList::Replay()). They must look exactly
+	// like drawing each one in turn. By default they are.
+	virtual void FillRectangles(const D2D1_RECT_F* r, size_t count, SS2DBrush* brush) {
+		for (size_t i = 0; i < count; i++) {
+			FillRectangle(r[i], brush);
+		}
+	}
+
+	virtual void FillEllipses(const D2D1_ELLIPSE* e, size_t count, SS2DBrush* brush) {
+		for (size_t i = 0; i < count; i++) {
+			FillEllipse(e[i], brush);
+		}
+	}
+
+	// The bitmaps may differ but are all drawn from the same page (SS2DBitmap::GetPage())
+	virtual void DrawSprites(const SS2DBitmap* const* bitmaps, const D2D1_RECT_F* r, const FLOAT* opacity, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			DrawBitmap(bitmaps[i], r[i], opacity[i]);
+		}
+	}
+
+	// Everything drawn between these covers what's under it: clears and fills with opaque
+	// brushes (see SS2DCommandList::Replay()). Only what's still showing at the end counts,
+	// so a backend can hold on to them and draw them front to back. The clip stays the same.
+	virtual void BeginOpaqueRun() {}
+	virtual void EndOpaqueRun() {}
+};
+
+// Draws with Direct2D. D2DWindow owns one and points it at its render target.
+// Large opaque rectangle and ellipse batches are filled as one geometry group, which
+// costs count + 1 geometries but one fill. Smaller ones aren't worth making them for
+// and translucent ones can't be (the overlaps would only be blended once), so they're
+// filled one by one. Sprite batches need ID2D1DeviceContext3 (Windows 10) and a page
+// with a Direct2D bitmap, and fall back to DrawBitmap() without them. Text keeps its
+// layouts between frames and numbers are drawn as glyph runs (see SS2DText.h) once
+// there's a DirectWrite factory to make them with.
+class SS2DD2DBackend : public SS2DRenderBackend
+{
+public:
+	SS2DD2DBackend() : m_pRenderTarget(NULL), m_pDC3(NULL), m_pSpriteBatch(NULL), m_pDWriteFactory(NULL) {}
+
+	~SS2DD2DBackend() {
+		SetRenderTarget(NULL);
+		SetDWriteFactory(NULL);
+	}
+
+	void SetDWriteFactory(IDWriteFactory* pFactory) {
+		m_layouts.Clear();
+		m_numbers.Clear();
+		m_pDWriteFactory = pFactory;
+	}
+
+	void SetRenderTarget(ID2D1RenderTarget* pRenderTarget) {
+		SafeRelease(&m_pSpriteBatch);
+		SafeRelease(&m_pDC3);
+		m_pRenderTarget = pRenderTarget;
+		if (m_pRenderTarget) {
+			m_pRenderTarget->QueryInterface(__uuidof(ID2D1DeviceContext3), reinterpret_cast<void**>(&m_pDC3));
+		}
+	}
+
+	void Clear(const D2D1::ColorF& c) override {
+		m_pRenderTarget->Clear(c);
+	}
+
+	void FillEllipse(const D2D1_ELLIPSE& e, SS2DBrush* brush) override {
+		m_pRenderTarget->FillEllipse(&e, *brush);
+	}
+
+	void FillRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		m_pRenderTarget->FillRectangle(&r, *brush);
+	}
+
+	void DrawRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		m_pRenderTarget->DrawRectangle(&r, *brush);
+	}
+
+	void DrawBitmap(const SS2DBitmap* bitmap, const D2D1_RECT_F& r, FLOAT opacity) override {
+		bitmap->Render(m_pRenderTarget, r, opacity);
+	}
+
+	void DrawString(const std::wstring& text, IDWriteTextFormat* format, DWRITE_TEXT_ALIGNMENT ta, const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		if (m_pDWriteFactory && format) {
+			if (SS2DTextNumbers::IsNumber(text) && m_numbers.Draw(m_pRenderTarget, m_pDWriteFactory, text, format, r, *brush)) {
+				return;
+			}
+
+			IDWriteTextLayout* pLayout = m_layouts.Get(m_pDWriteFactory, text, format, r.right - r.left, r.bottom - r.top);
+			if (pLayout) {
+				m_pRenderTarget->DrawTextLayout(D2D1::Point2F(r.left, r.top), pLayout, *brush);
+				return;
+			}
+		}
+		m_pRenderTarget->DrawTextW(text.c_str(), (UINT32)text.length(), format, r, *brush);
+	}
+
+	void PushClip(const D2D1_RECT_F& r) override {
+		m_pRenderTarget->PushAxisAlignedClip(r, D2D1_ANTIALIAS_MODE_ALIASED);
+	}
+
+	void PopClip() override {
+		m_pRenderTarget->PopAxisAlignedClip();
+	}
+
+	// Drawn with a compatible render target, so the layer stays on the GPU
+	bool RenderLayer(SS2DBitmap* layer, UINT width, UINT height, const std::function<void(SS2DRenderBackend&)>& draw) override {
+		ID2D1BitmapRenderTarget* pLayerTarget = NULL;
+		if (FAILED(m_pRenderTarget->CreateCompatibleRenderTarget(D2D1::SizeF((FLOAT)width, (FLOAT)height), &pLayerTarget))) {
+			return false;
+		}
+
+		SS2DD2DBackend backend;
+		backend.SetRenderTarget(pLayerTarget);
+		backend.SetDWriteFactory(m_pDWriteFactory);
+		pLayerTarget->BeginDraw();
+		pLayerTarget->Clear(D2D1::ColorF(0.0f, 0.0f, 0.0f, 0.0f));
+		draw(backend);
+		HRESULT hr = pLayerTarget->EndDraw();
+		backend.SetRenderTarget(NULL);
+
+		ID2D1Bitmap* pBitmap = NULL;
+		if (SUCCEEDED(hr)) {
+			hr = pLayerTarget->GetBitmap(&pBitmap);
+		}
+		SafeRelease(&pLayerTarget);
+		if (FAILED(hr)) {
+			return false;
+		}
+		layer->SetD2DBitmap(pBitmap);
+		return true;
+	}
+
+	// Where two edges of the group cross inside a pixel it's antialiased once rather than
+	// twice, which is as near as a group can get to drawing them in turn.
+	void FillRectangles(const D2D1_RECT_F* r, size_t count, SS2DBrush* brush) override {
+		if ((count < GroupMin) || (brush->GetAlpha() < 1.0f)) {
+			SS2DRenderBackend::FillRectangles(r, count, brush);
+			return;
+		}
+
+		ID2D1Factory* pFactory = NULL;
+		m_pRenderTarget->GetFactory(&pFactory);
+		for (size_t i = 0; i < count; i++) {
+			ID2D1RectangleGeometry* p = NULL;
+			if (SUCCEEDED(pFactory->CreateRectangleGeometry(r[i], &p))) {
+				m_geometries.push_back(p);
+			}
+		}
+		FillGeometries(pFactory, brush);
+	}
+
+	void FillEllipses(const D2D1_ELLIPSE* e, size_t count, SS2DBrush* brush) override {
+		if ((count < GroupMin) || (brush->GetAlpha() < 1.0f)) {
+			SS2DRenderBackend::FillEllipses(e, count, brush);
+			return;
+		}
+
+		ID2D1Factory* pFactory = NULL;
+		m_pRenderTarget->GetFactory(&pFactory);
+		for (size_t i = 0; i < count; i++) {
+			ID2D1EllipseGeometry* p = NULL;
+			if (SUCCEEDED(pFactory->CreateEllipseGeometry(e[i], &p))) {
+				m_geometries.push_back(p);
+			}
+		}
+		FillGeometries(pFactory, brush);
+	}
+
+	void DrawSprites(const SS2DBitmap* const* bitmaps, const D2D1_RECT_F* r, const FLOAT* opacity, size_t count) override {
+		ID2D1Bitmap* pBitmap = bitmaps[0]->GetPage()->GetD2DBitmap();
+		if ((count < 2) || !pBitmap || !m_pDC3 ||
+			(!m_pSpriteBatch && FAILED(m_pDC3->CreateSpriteBatch(&m_pSpriteBatch)))) {
+			SS2DRenderBackend::DrawSprites(bitmaps, r, opacity, count);
+			return;
+		}
+
+		m_sources.resize(count);
+		m_colors.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			m_sources[i] = bitmaps[i]->GetSourceRect();
+			m_colors[i] = D2D1::ColorF(1.0f, 1.0f, 1.0f, opacity[i]);	// opacity is the sprite's alpha
+		}
+
+		m_pSpriteBatch->Clear();
+		m_pSpriteBatch->AddSprites((UINT32)count, r, m_sources.data(), m_colors.data(), NULL,
+			sizeof(D2D1_RECT_F), sizeof(D2D1_RECT_U), sizeof(D2D1_COLOR_F), 0);
+
+		// Sprite batches only draw aliased
+		D2D1_ANTIALIAS_MODE mode = m_pDC3->GetAntialiasMode();
+		m_pDC3->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+		m_pDC3->DrawSpriteBatch(m_pSpriteBatch, pBitmap);
+		m_pDC3->SetAntialiasMode(mode);
+	}
+
+protected:
+	static const size_t GroupMin = 64;	// smallest batch filled as a geometry group
+
+	// Fill everything in m_geometries in one go and let it all go. If the group can't be
+	// made they're filled one by one so nothing goes missing.
+	void FillGeometries(ID2D1Factory* pFactory, SS2DBrush* brush) {
+		ID2D1GeometryGroup* pGroup = NULL;
+		if (SUCCEEDED(pFactory->CreateGeometryGroup(D2D1_FILL_MODE_WINDING, m_geometries.data(), (UINT32)m_geometries.size(), &pGroup))) {
+			m_pRenderTarget->FillGeometry(pGroup, *brush);
+			SafeRelease(&pGroup);
+		}
+		else {
+			for (auto p : m_geometries) {
+				m_pRenderTarget->FillGeometry(p, *brush);
+			}
+		}
+
+		for (auto p : m_geometries) {
+			p->Release();
+		}
+		m_geometries.clear();
+		SafeRelease(&pFactory);
+	}
+
+protected:
+	ID2D1RenderTarget* m_pRenderTarget;
+	ID2D1DeviceContext3* m_pDC3;			// NULL before Windows 10
+	ID2D1SpriteBatch* m_pSpriteBatch;
+
+	std::vector<ID2D1Geometry*> m_geometries;	// scratch space for the fill batches
+	std::vector<D2D1_RECT_U> m_sources;			// and the sprite batches
+	std::vector<D2D1_COLOR_F> m_colors;
+
+	IDWriteFactory* m_pDWriteFactory;	// not ours
+	SS2DTextLayouts m_layouts;
+	SS2DTextNumbers m_numbers;
+};
+
+// Draws nothing. Just counts the calls it gets. A batch is one call.
+class SS2DNullBackend : public SS2DRenderBackend
+{
+public:
+	SS2DNullBackend() : m_drawCalls(0) {}
+
+	void Clear(const D2D1::ColorF& c) override {}
+	void FillEllipse(const D2D1_ELLIPSE& e, SS2DBrush* brush) override { m_drawCalls++; }
+	void FillRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override { m_drawCalls++; }
+	void DrawRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override { m_drawCalls++; }
+	void DrawBitmap(const SS2DBitmap* bitmap, const D2D1_RECT_F& r, FLOAT opacity) override { m_drawCalls++; }
+	void DrawString(const std::wstring& text, IDWriteTextFormat* format, DWRITE_TEXT_ALIGNMENT ta, const D2D1_RECT_F& r, SS2DBrush* brush) override { m_drawCalls++; }
+	void PushClip(const D2D1_RECT_F& r) override {}
+	void PopClip() override {}
+	bool RenderLayer(SS2DBitmap* layer, UINT width, UINT height, const std::function<void(SS2DRenderBackend&)>& draw) override {
+		draw(*this);	// counts what goes into it
+		return true;
+	}
+	void FillRectangles(const D2D1_RECT_F* r, size_t count, SS2DBrush* brush) override { m_drawCalls++; }
+	void FillEllipses(const D2D1_ELLIPSE* e, size_t count, SS2DBrush* brush) override { m_drawCalls++; }
+	void DrawSprites(const SS2DBitmap* const* bitmaps, const D2D1_RECT_F* r, const FLOAT* opacity, size_t count) override { m_drawCalls++; }
+
+	size_t GetDrawCalls() const { return m_drawCalls; }
+	void ResetDrawCalls() { m_drawCalls = 0; }
+
+protected:
+	size_t m_drawCalls;
+};
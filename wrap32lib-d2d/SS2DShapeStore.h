@@ -0,0 +1,360 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+// MoveActive() is vectorised with SSE2 on x86/x64 and AVX2 when the compiler targets it.
+// Define SS2D_STORE_SCALAR to force the plain loop.
+#if !defined(SS2D_STORE_SCALAR)
+#if defined(__AVX2__)
+#define SS2D_STORE_AVX2
+#define SS2D_STORE_SSE2
+#include <immintrin.h>
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define SS2D_STORE_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// SS2DShapeStore keeps the per-frame hot data for shapes - position, step,
+// bounds and an active flag - in contiguous arrays so the Move/bounds pass
+// is one linear sweep rather than a pointer chase per shape.
+//
+// Entries are addressed by a stable handle. Internally the arrays are kept
+// dense (swap and pop on removal) and the handle maps to the dense index.
+//
+// Bounds are kept for both the current position and the next frame's
+// (position + step) so lookahead bounds checks don't have to recalculate them.
+//
+// Only standard and compiler intrinsic headers are used so the store can be
+// built and benchmarked without Windows.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DShapeStore
+{
+public:
+	typedef uint32_t Handle;
+	static const Handle InvalidHandle = 0xffffffff;
+
+	// Which edge of a bounds rect an entry will be over after its next step. Same order of precedence as Shape::WillHitBounds.
+	enum class BoundsCode {
+		ok,
+		left,
+		right,
+		top,
+		bottom
+	};
+
+	class BoundsHit {
+	public:
+		Handle h;
+		void* user;
+		BoundsCode code;
+	};
+
+	SS2DShapeStore() {}
+
+	size_t Size() const { return m_x.size(); }
+
+	void Reserve(size_t n) {
+		m_x.reserve(n);			m_y.reserve(n);
+		m_dx.reserve(n);		m_dy.reserve(n);
+		m_ex0.reserve(n);		m_ey0.reserve(n);
+		m_ex1.reserve(n);		m_ey1.reserve(n);
+		m_left.reserve(n);		m_top.reserve(n);
+		m_right.reserve(n);		m_bottom.reserve(n);
+		m_nextLeft.reserve(n);	m_nextTop.reserve(n);
+		m_nextRight.reserve(n);	m_nextBottom.reserve(n);
+		m_active.reserve(n);	m_denseToHandle.reserve(n);
+		m_user.reserve(n);
+	}
+
+	Handle Add(float x, float y, float dx, float dy, bool active = true, void* user = NULL) {
+		Handle h;
+		if (m_freeHandles.empty()) {
+			h = (Handle)m_handleToDense.size();
+			m_handleToDense.push_back(0);
+		}
+		else {
+			h = m_freeHandles.back();
+			m_freeHandles.pop_back();
+		}
+
+		m_handleToDense[h] = (uint32_t)m_x.size();
+		m_denseToHandle.push_back(h);
+
+		m_x.push_back(x);		m_y.push_back(y);
+		m_dx.push_back(dx);		m_dy.push_back(dy);
+		m_ex0.push_back(0.0f);	m_ey0.push_back(0.0f);
+		m_ex1.push_back(0.0f);	m_ey1.push_back(0.0f);
+		m_left.push_back(x);	m_top.push_back(y);
+		m_right.push_back(x);	m_bottom.push_back(y);
+		m_nextLeft.push_back(x + dx);	m_nextTop.push_back(y + dy);
+		m_nextRight.push_back(x + dx);	m_nextBottom.push_back(y + dy);
+		m_active.push_back(active ? ActiveMask : 0);
+		m_user.push_back(user);
+		return h;
+	}
+
+	void Remove(Handle h) {
+		uint32_t i = m_handleToDense[h];
+		uint32_t last = (uint32_t)m_x.size() - 1;
+		if (i != last) {	// Move the last entry into the gap
+			m_x[i] = m_x[last];				m_y[i] = m_y[last];
+			m_dx[i] = m_dx[last];			m_dy[i] = m_dy[last];
+			m_ex0[i] = m_ex0[last];			m_ey0[i] = m_ey0[last];
+			m_ex1[i] = m_ex1[last];			m_ey1[i] = m_ey1[last];
+			m_left[i] = m_left[last];		m_top[i] = m_top[last];
+			m_right[i] = m_right[last];		m_bottom[i] = m_bottom[last];
+			m_nextLeft[i] = m_nextLeft[last];	m_nextTop[i] = m_nextTop[last];
+			m_nextRight[i] = m_nextRight[last];	m_nextBottom[i] = m_nextBottom[last];
+			m_active[i] = m_active[last];
+			m_user[i] = m_user[last];
+
+			Handle moved = m_denseToHandle[last];
+			m_denseToHandle[i] = moved;
+			m_handleToDense[moved] = i;
+		}
+
+		m_x.pop_back();			m_y.pop_back();
+		m_dx.pop_back();		m_dy.pop_back();
+		m_ex0.pop_back();		m_ey0.pop_back();
+		m_ex1.pop_back();		m_ey1.pop_back();
+		m_left.pop_back();		m_top.pop_back();
+		m_right.pop_back();		m_bottom.pop_back();
+		m_nextLeft.pop_back();	m_nextTop.pop_back();
+		m_nextRight.pop_back();	m_nextBottom.pop_back();
+		m_active.pop_back();
+		m_user.pop_back();
+		m_denseToHandle.pop_back();
+
+		m_freeHandles.push_back(h);
+	}
+
+	void Clear() {
+		m_x.clear();		m_y.clear();
+		m_dx.clear();		m_dy.clear();
+		m_ex0.clear();		m_ey0.clear();
+		m_ex1.clear();		m_ey1.clear();
+		m_left.clear();		m_top.clear();
+		m_right.clear();	m_bottom.clear();
+		m_nextLeft.clear();	m_nextTop.clear();
+		m_nextRight.clear();	m_nextBottom.clear();
+		m_active.clear();
+		m_user.clear();
+		m_denseToHandle.clear();
+		m_handleToDense.clear();
+		m_freeHandles.clear();
+	}
+
+	// Per entry accessors
+	float X(Handle h) const { return m_x[m_handleToDense[h]]; }
+	float Y(Handle h) const { return m_y[m_handleToDense[h]]; }
+	float StepX(Handle h) const { return m_dx[m_handleToDense[h]]; }
+	float StepY(Handle h) const { return m_dy[m_handleToDense[h]]; }
+	bool IsActive(Handle h) const { return m_active[m_handleToDense[h]] != 0; }
+	void* User(Handle h) const { return m_user[m_handleToDense[h]]; }
+
+	void SetPos(Handle h, float x, float y) {
+		uint32_t i = m_handleToDense[h];
+		m_x[i] = x;
+		m_y[i] = y;
+		UpdateBounds(i);
+	}
+
+	void OffsetPos(Handle h, float x, float y) {
+		uint32_t i = m_handleToDense[h];
+		m_x[i] += x;
+		m_y[i] += y;
+		UpdateBounds(i);
+	}
+
+	void SetStep(Handle h, float dx, float dy) {
+		uint32_t i = m_handleToDense[h];
+		m_dx[i] = dx;
+		m_dy[i] = dy;
+		UpdateBounds(i);
+	}
+
+	void SetActive(Handle h, bool b) { m_active[m_handleToDense[h]] = b ? ActiveMask : 0; }
+
+	// The bounding box relative to the position e.g. (-r, -r, r - 1, r - 1) for a circle
+	void SetExtent(Handle h, float x0, float y0, float x1, float y1) {
+		uint32_t i = m_handleToDense[h];
+		m_ex0[i] = x0;	m_ey0[i] = y0;
+		m_ex1[i] = x1;	m_ey1[i] = y1;
+		UpdateBounds(i);
+	}
+
+	void GetBounds(Handle h, float* left, float* top, float* right, float* bottom) const {
+		uint32_t i = m_handleToDense[h];
+		*left = m_left[i];		*top = m_top[i];
+		*right = m_right[i];	*bottom = m_bottom[i];
+	}
+
+	// Bounds after the next step
+	void GetNextBounds(Handle h, float* left, float* top, float* right, float* bottom) const {
+		uint32_t i = m_handleToDense[h];
+		*left = m_nextLeft[i];		*top = m_nextTop[i];
+		*right = m_nextRight[i];	*bottom = m_nextBottom[i];
+	}
+
+	// The bulk pass. Advance every active entry by its step and refresh its bounds.
+	// Bounds are relative to the entry's parent i.e. they're screen bounds for root shapes.
+	void MoveActive() {
+		size_t n = m_x.size();
+		size_t i = 0;
+#if defined(SS2D_STORE_AVX2)
+		for (; i + 8 <= n; i += 8) {
+			__m256 mask = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&m_active[i]));
+			MoveAxis8(i, mask, &m_x[0], &m_dx[0], &m_ex0[0], &m_ex1[0], &m_left[0], &m_right[0], &m_nextLeft[0], &m_nextRight[0]);
+			MoveAxis8(i, mask, &m_y[0], &m_dy[0], &m_ey0[0], &m_ey1[0], &m_top[0], &m_bottom[0], &m_nextTop[0], &m_nextBottom[0]);
+		}
+#endif
+#if defined(SS2D_STORE_SSE2)
+		for (; i + 4 <= n; i += 4) {
+			__m128 mask = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&m_active[i]));
+			MoveAxis4(i, mask, &m_x[0], &m_dx[0], &m_ex0[0], &m_ex1[0], &m_left[0], &m_right[0], &m_nextLeft[0], &m_nextRight[0]);
+			MoveAxis4(i, mask, &m_y[0], &m_dy[0], &m_ey0[0], &m_ey1[0], &m_top[0], &m_bottom[0], &m_nextTop[0], &m_nextBottom[0]);
+		}
+#endif
+		MoveScalar(i, n);	// whatever's left over
+	}
+
+	// MoveActive() with the plain loop whatever the build, to check and time the SIMD paths against
+	void MoveActiveScalar() {
+		MoveScalar(0, m_x.size());
+	}
+
+	// Check the next step bounds of every active entry against (left, top) - (right, bottom) and return only
+	// the ones that will be over an edge. Left/top are hit if less than the bound, right/bottom if equal or over.
+	size_t ClassifyActive(float left, float top, float right, float bottom, std::vector<BoundsHit>& ret) const {
+		size_t first = ret.size();
+		size_t n = m_x.size();
+		size_t i = 0;
+#if defined(SS2D_STORE_SSE2)
+		__m128 l = _mm_set1_ps(left), t = _mm_set1_ps(top);
+		__m128 r = _mm_set1_ps(right), b = _mm_set1_ps(bottom);
+		for (; i + 4 <= n; i += 4) {
+			__m128 out = _mm_or_ps(
+				_mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&m_nextLeft[i]), l), _mm_cmpge_ps(_mm_loadu_ps(&m_nextRight[i]), r)),
+				_mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&m_nextTop[i]), t), _mm_cmpge_ps(_mm_loadu_ps(&m_nextBottom[i]), b)));
+			out = _mm_and_ps(out, _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&m_active[i])));
+			int bits = _mm_movemask_ps(out);
+			while (bits) {	// Only the exceptions get looked at individually
+				int lane = 0;
+				while (!(bits & (1 << lane))) {
+					lane++;
+				}
+				bits &= ~(1 << lane);
+				ClassifyOne(i + lane, left, top, right, bottom, ret);
+			}
+		}
+#endif
+		for (; i < n; i++) {
+			if (m_active[i]) {
+				ClassifyOne(i, left, top, right, bottom, ret);
+			}
+		}
+		return ret.size() - first;
+	}
+
+protected:
+	static const uint32_t ActiveMask = 0xffffffff;	// all bits set so it can be used as a SIMD select mask
+
+	void ClassifyOne(size_t i, float left, float top, float right, float bottom, std::vector<BoundsHit>& ret) const {
+		BoundsCode code = BoundsCode::ok;
+		if (m_nextLeft[i] < left)				code = BoundsCode::left;
+		else if (m_nextRight[i] >= right)		code = BoundsCode::right;
+		else if (m_nextTop[i] < top)			code = BoundsCode::top;
+		else if (m_nextBottom[i] >= bottom)		code = BoundsCode::bottom;
+
+		if (code != BoundsCode::ok) {
+			BoundsHit hit;
+			hit.h = m_denseToHandle[i];
+			hit.user = m_user[i];
+			hit.code = code;
+			ret.push_back(hit);
+		}
+	}
+
+	void MoveScalar(size_t i, size_t n) {
+		for (; i < n; i++) {
+			if (m_active[i]) {
+				m_x[i] += m_dx[i];
+				m_y[i] += m_dy[i];
+			}
+			UpdateBounds((uint32_t)i);
+		}
+	}
+
+	void UpdateBounds(uint32_t i) {
+		m_left[i] = m_x[i] + m_ex0[i];
+		m_top[i] = m_y[i] + m_ey0[i];
+		m_right[i] = m_x[i] + m_ex1[i];
+		m_bottom[i] = m_y[i] + m_ey1[i];
+
+		float nx = m_x[i] + m_dx[i];
+		float ny = m_y[i] + m_dy[i];
+		m_nextLeft[i] = nx + m_ex0[i];
+		m_nextTop[i] = ny + m_ey0[i];
+		m_nextRight[i] = nx + m_ex1[i];
+		m_nextBottom[i] = ny + m_ey1[i];
+	}
+
+#if defined(SS2D_STORE_SSE2)
+	// One axis of MoveActive() for 4 entries: pos += step & mask, then current and next bounds
+	static void MoveAxis4(size_t i, __m128 mask, float* pos, const float* step, const float* e0, const float* e1,
+		float* lo, float* hi, float* nextLo, float* nextHi)
+	{
+		__m128 d = _mm_loadu_ps(step + i);
+		__m128 p = _mm_add_ps(_mm_loadu_ps(pos + i), _mm_and_ps(d, mask));
+		__m128 l = _mm_add_ps(p, _mm_loadu_ps(e0 + i));
+		__m128 h = _mm_add_ps(p, _mm_loadu_ps(e1 + i));
+		_mm_storeu_ps(pos + i, p);
+		_mm_storeu_ps(lo + i, l);
+		_mm_storeu_ps(hi + i, h);
+		__m128 np = _mm_add_ps(p, d);
+		_mm_storeu_ps(nextLo + i, _mm_add_ps(np, _mm_loadu_ps(e0 + i)));
+		_mm_storeu_ps(nextHi + i, _mm_add_ps(np, _mm_loadu_ps(e1 + i)));
+	}
+#endif
+
+#if defined(SS2D_STORE_AVX2)
+	static void MoveAxis8(size_t i, __m256 mask, float* pos, const float* step, const float* e0, const float* e1,
+		float* lo, float* hi, float* nextLo, float* nextHi)
+	{
+		__m256 d = _mm256_loadu_ps(step + i);
+		__m256 p = _mm256_add_ps(_mm256_loadu_ps(pos + i), _mm256_and_ps(d, mask));
+		__m256 l = _mm256_add_ps(p, _mm256_loadu_ps(e0 + i));
+		__m256 h = _mm256_add_ps(p, _mm256_loadu_ps(e1 + i));
+		_mm256_storeu_ps(pos + i, p);
+		_mm256_storeu_ps(lo + i, l);
+		_mm256_storeu_ps(hi + i, h);
+		__m256 np = _mm256_add_ps(p, d);
+		_mm256_storeu_ps(nextLo + i, _mm256_add_ps(np, _mm256_loadu_ps(e0 + i)));
+		_mm256_storeu_ps(nextHi + i, _mm256_add_ps(np, _mm256_loadu_ps(e1 + i)));
+	}
+#endif
+
+protected:
+	// Dense arrays - all the same length
+	std::vector<float> m_x, m_y;			// Position
+	std::vector<float> m_dx, m_dy;			// Step per Move()
+	std::vector<float> m_ex0, m_ey0;		// Bounding box extent relative to the position
+	std::vector<float> m_ex1, m_ey1;
+	std::vector<float> m_left, m_top;		// Bounding box at the current position
+	std::vector<float> m_right, m_bottom;
+	std::vector<float> m_nextLeft, m_nextTop;	// Bounding box after the next step
+	std::vector<float> m_nextRight, m_nextBottom;
+	std::vector<uint32_t> m_active;			// Moved by MoveActive()? 0 or ActiveMask
+	std::vector<void*> m_user;				// Owner e.g. the Shape
+	std::vector<Handle> m_denseToHandle;
+
+	// Handle -> dense index
+	std::vector<uint32_t> m_handleToDense;
+	std::vector<Handle> m_freeHandles;
+};
@@ -0,0 +1,692 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "SS2DRenderBackend.h"
+
+// Span fills are vectorised with SSE2 on x86/x64.
+// Define SS2D_RASTER_SCALAR to force the plain loops.
+#if !defined(SS2D_RASTER_SCALAR)
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define SS2D_RASTER_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>	// _BitScanForward64
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// SS2DSoftwareBackend rasterises on the CPU into a 32bpp BGRA framebuffer
+// (0xAARRGGBB per pixel). Use it with SS2DHeadless for off-screen renders,
+// golden images and thumbnails.
+//
+// No anti-aliasing: a pixel is covered if its centre is inside the shape.
+// Bitmaps need CPU pixels (SS2DBitmap::LoadPixelsFromFile()/SetPixels())
+// and are scaled nearest neighbour. Text uses a built in 5x8 pixel font
+// scaled to the text height, so it won't match DirectWrite's layout.
+//
+// Opaque runs (BeginOpaqueRun()) are held back and drawn front to back,
+// each fill only where nothing in front of it has drawn, so a crowded
+// scene writes each pixel once rather than once per shape over it.
+////////////////////////////////////////////////////////////////////////
+
+class SS2DSoftwareBackend : public SS2DRenderBackend
+{
+public:
+	SS2DSoftwareBackend(int width, int height) : m_width(0), m_height(0), m_runOpen(false), m_frontToBack(false), m_coverWords(0) {
+		Resize(width, height);
+	}
+
+	void Resize(int width, int height) {
+		m_width = width;
+		m_height = height;
+		m_pixels.assign((size_t)width * height, 0xff000000);
+		m_clips.clear();
+		m_clip = Clip{ 0, 0, width, height };
+		m_coverWords = ((size_t)width + 63) / 64;
+		m_covered.assign(m_coverWords * height, 0);
+	}
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	const uint32_t* GetPixels() const { return m_pixels.data(); }
+	uint32_t GetPixel(int x, int y) const { return m_pixels[(size_t)y * m_width + x]; }
+
+	void Clear(const D2D1::ColorF& c) override {
+		uint32_t pixel =
+			(ToByte(c.a) << 24) | (ToByte(c.r) << 16) | (ToByte(c.g) << 8) | ToByte(c.b);
+		if (m_runOpen) {
+			HoldBox(m_clip.x0, m_clip.y0, m_clip.x1, m_clip.y1, pixel);
+			return;
+		}
+		if (m_clip.x1 <= m_clip.x0) {
+			return;
+		}
+		for (int y = m_clip.y0; y < m_clip.y1; y++) {
+			FillSpanOpaque(Row(y) + m_clip.x0, m_clip.x1 - m_clip.x0, pixel);
+		}
+	}
+
+	// Pixels whose centres are in r, and in any clip already pushed
+	void PushClip(const D2D1_RECT_F& r) override {
+		FlushRun();
+		m_clips.push_back(m_clip);
+		m_clip.x0 = (std::max)(m_clip.x0, Edge(r.left));
+		m_clip.y0 = (std::max)(m_clip.y0, Edge(r.top));
+		m_clip.x1 = (std::min)(m_clip.x1, Edge(r.right));
+		m_clip.y1 = (std::min)(m_clip.y1, Edge(r.bottom));
+		if (m_clip.y1 < m_clip.y0) {
+			m_clip.y1 = m_clip.y0;
+		}
+	}
+
+	void PopClip() override {
+		FlushRun();
+		m_clip = m_clips.back();
+		m_clips.pop_back();
+	}
+
+	bool RenderLayer(SS2DBitmap* layer, UINT width, UINT height, const std::function<void(SS2DRenderBackend&)>& draw) override {
+		SS2DSoftwareBackend backend((int)width, (int)height);
+		backend.Clear(D2D1::ColorF(0.0f, 0.0f, 0.0f, 0.0f));
+		draw(backend);
+		layer->SetPixels(width, height, backend.GetPixels());
+		return true;
+	}
+
+	void FillRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		uint32_t color, alpha;
+		BrushColor(brush, &color, &alpha);
+		FillRect(r, color, alpha);
+	}
+
+	// 1 pixel outline just inside r
+	void DrawRectangle(const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		uint32_t color, alpha;
+		BrushColor(brush, &color, &alpha);
+		FlushRun();
+		int x0 = Edge(r.left), y0 = Edge(r.top), x1 = Edge(r.right), y1 = Edge(r.bottom);
+		if ((x1 <= x0) || (y1 <= y0)) {
+			return;
+		}
+		FillBox(x0, y0, x1, y0 + 1, color, alpha);
+		if (y1 - 1 > y0) {
+			FillBox(x0, y1 - 1, x1, y1, color, alpha);
+		}
+		FillBox(x0, y0 + 1, x0 + 1, y1 - 1, color, alpha);
+		if (x1 - 1 > x0) {
+			FillBox(x1 - 1, y0 + 1, x1, y1 - 1, color, alpha);
+		}
+	}
+
+	void FillEllipse(const D2D1_ELLIPSE& e, SS2DBrush* brush) override {
+		uint32_t color, alpha;
+		BrushColor(brush, &color, &alpha);
+		FillEllipseOrHold(e, color, alpha);
+	}
+
+	void DrawBitmap(const SS2DBitmap* bitmap, const D2D1_RECT_F& r, FLOAT opacity) override {
+		FlushRun();
+		const SS2DBitmap* page = bitmap->GetPage();
+		if (page->HasPixels()) {
+			Blit(page->GetPixels(), page->GetPixelsWidth(), bitmap->GetSourceRect(), r, opacity);
+		}
+	}
+
+	void DrawString(const std::wstring& text, IDWriteTextFormat* format, DWRITE_TEXT_ALIGNMENT ta, const D2D1_RECT_F& r, SS2DBrush* brush) override {
+		uint32_t color, alpha;
+		BrushColor(brush, &color, &alpha);
+		FlushRun();
+
+		// DirectWrite's font size is the rect height. Capitals are about 0.7 of that.
+		int scale = (int)((r.bottom - r.top) * 0.7f / GlyphHeight + 0.5f);
+		if (scale < 1) {
+			scale = 1;
+		}
+
+		int width = (int)text.length() * GlyphAdvance * scale;
+		int x = Edge(r.left);
+		if (ta == DWRITE_TEXT_ALIGNMENT_CENTER) {
+			x = Edge((r.left + r.right - width) / 2);
+		}
+		else if (ta == DWRITE_TEXT_ALIGNMENT_TRAILING) {
+			x = Edge(r.right) - width;
+		}
+		int y = Edge(r.top);
+
+		for (auto ch : text) {
+			DrawGlyph(x, y, scale, ch, color, alpha);
+			x += GlyphAdvance * scale;
+		}
+	}
+
+	// Batches. The brush colour or the bitmap is only looked up once.
+	void FillRectangles(const D2D1_RECT_F* r, size_t count, SS2DBrush* brush) override {
+		uint32_t color, alpha;
+		BrushColor(brush, &color, &alpha);
+		for (size_t i = 0; i < count; i++) {
+			FillRect(r[i], color, alpha);
+		}
+	}
+
+	void FillEllipses(const D2D1_ELLIPSE* e, size_t count, SS2DBrush* brush) override {
+		uint32_t color, alpha;
+		BrushColor(brush, &color, &alpha);
+		for (size_t i = 0; i < count; i++) {
+			FillEllipseOrHold(e[i], color, alpha);
+		}
+	}
+
+	void DrawSprites(const SS2DBitmap* const* bitmaps, const D2D1_RECT_F* r, const FLOAT* opacity, size_t count) override {
+		FlushRun();
+		const SS2DBitmap* page = bitmaps[0]->GetPage();
+		if (!page->HasPixels()) {
+			return;
+		}
+
+		const uint32_t* src = page->GetPixels();
+		UINT stride = page->GetPixelsWidth();
+		for (size_t i = 0; i < count; i++) {
+			Blit(src, stride, bitmaps[i]->GetSourceRect(), r[i], opacity[i]);
+		}
+	}
+
+	void BeginOpaqueRun() override {
+		FlushRun();
+		m_runOpen = true;
+	}
+
+	void EndOpaqueRun() override {
+		FlushRun();
+		m_runOpen = false;
+	}
+
+	// Uncompressed 32bpp top down BMP of the framebuffer
+	void WriteBMP(std::vector<uint8_t>& out) const {
+		uint32_t imageSize = (uint32_t)(m_pixels.size() * 4);
+		out.clear();
+		out.reserve(54 + imageSize);
+
+		// BITMAPFILEHEADER
+		Put16(out, 0x4d42);	// "BM"
+		Put32(out, 54 + imageSize);
+		Put32(out, 0);
+		Put32(out, 54);
+
+		// BITMAPINFOHEADER
+		Put32(out, 40);
+		Put32(out, (uint32_t)m_width);
+		Put32(out, (uint32_t)-m_height);	// negative = top down
+		Put16(out, 1);
+		Put16(out, 32);
+		Put32(out, 0);	// BI_RGB
+		Put32(out, imageSize);
+		Put32(out, 2835);	// 72 dpi
+		Put32(out, 2835);
+		Put32(out, 0);
+		Put32(out, 0);
+
+		const uint8_t* p = (const uint8_t*)m_pixels.data();
+		out.insert(out.end(), p, p + imageSize);
+	}
+
+	bool SaveBMP(LPCWSTR filePath) const {
+		std::vector<uint8_t> bmp;
+		WriteBMP(bmp);
+
+		std::ofstream f(std::filesystem::path(filePath), std::ios::binary);	// a wide path on Windows and Linux alike
+		f.write((const char*)bmp.data(), bmp.size());
+		return f.good();
+	}
+
+protected:
+	// [x0, x1) x [y0, y1) in pixels
+	struct Clip {
+		int x0, y0, x1, y1;
+	};
+
+	// A fill held back in an opaque run. A box in pixels or an ellipse and the rows it's on.
+	struct HeldFill {
+		bool m_ellipse;
+		D2D1_ELLIPSE m_e;
+		int m_x0, m_y0, m_x1, m_y1;
+		uint32_t m_color;
+	};
+
+	static const int RunBand = 32;	// rows FlushRun() draws at a time
+
+	static const int GlyphWidth = 5;
+	static const int GlyphHeight = 8;
+	static const int GlyphAdvance = GlyphWidth + 1;
+
+	uint32_t* Row(int y) { return &m_pixels[(size_t)y * m_width]; }
+
+	// First pixel whose centre is at or beyond f. ceil() without the library call.
+	static int Edge(FLOAT f) {
+		f -= 0.5f;
+		int i = (int)f;
+		return i + (f > (FLOAT)i);
+	}
+
+	static FLOAT Sqrt(FLOAT f) {
+#if defined(SS2D_RASTER_SSE2)
+		return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(f)));	// no errno handling
+#else
+		return sqrtf(f);
+#endif
+	}
+
+	static uint32_t ToByte(FLOAT f) {
+		if (f <= 0)	return 0;
+		if (f >= 1)	return 255;
+		return (uint32_t)(f * 255.0f + 0.5f);
+	}
+
+	static void BrushColor(SS2DBrush* brush, uint32_t* color, uint32_t* alpha) {
+		COLORREF cr = brush ? brush->GetColor() : RGB(255, 255, 255);
+		*color = 0xff000000 | ((cr & 0x0000ff) << 16) | (cr & 0x00ff00) | ((cr & 0xff0000) >> 16);	// RGB => BGRA
+		*alpha = brush ? ToByte(brush->GetAlpha()) : 255;
+	}
+
+	// (x * y) / 255 rounded, for x, y in 0..255
+	static uint32_t Mul255(uint32_t x, uint32_t y) {
+		uint32_t t = x * y + 128;
+		return (t + (t >> 8)) >> 8;
+	}
+
+	static uint32_t BlendPremultiplied(uint32_t dst, uint32_t src, uint32_t opacity) {
+		uint32_t sa = Mul255(src >> 24, opacity);
+		if (sa == 0) {
+			return dst;
+		}
+		if (sa == 255) {
+			return src;		// opaque, so opacity was 255 too
+		}
+		uint32_t inv = 255 - sa;
+		uint32_t ret = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			uint32_t s = Mul255((src >> shift) & 0xff, opacity);
+			uint32_t d = Mul255((dst >> shift) & 0xff, inv);
+			uint32_t c = s + d;
+			ret |= ((c > 255) ? 255 : c) << shift;
+		}
+		return ret;
+	}
+
+	void FillEllipse(const D2D1_ELLIPSE& e, uint32_t color, uint32_t alpha) {
+		if ((e.radiusX <= 0) || (e.radiusY <= 0)) {
+			return;
+		}
+
+		int y0 = Edge(e.point.y - e.radiusY);
+		int y1 = Edge(e.point.y + e.radiusY);
+		if (y0 < m_clip.y0)		y0 = m_clip.y0;
+		if (y1 > m_clip.y1)		y1 = m_clip.y1;
+
+		// Half width of the ellipse at each pixel row's centre: rx * sqrt(1 - (dy / ry)^2)
+		FLOAT scale = e.radiusX / e.radiusY;
+		FLOAT ry2 = e.radiusY * e.radiusY;
+		for (int y = y0; y < y1; y++) {
+			FLOAT dy = (FLOAT)y + 0.5f - e.point.y;	// not stepped, so a clipped ellipse has the same rows
+			FLOAT h = ry2 - dy * dy;
+			if (h > 0) {
+				FLOAT dx = scale * Sqrt(h);
+				FillRow(y, Edge(e.point.x - dx), Edge(e.point.x + dx), color, alpha);
+			}
+		}
+	}
+
+	// Nearest neighbour scale of the source rect of src (stride pixels wide) into r
+	void Blit(const uint32_t* src, UINT stride, const D2D1_RECT_U& source, const D2D1_RECT_F& r, FLOAT opacity) {
+		if (opacity <= 0) {
+			return;
+		}
+
+		int x0 = Edge(r.left), y0 = Edge(r.top), x1 = Edge(r.right), y1 = Edge(r.bottom);
+		if ((x1 <= x0) || (y1 <= y0)) {
+			return;
+		}
+
+		src += (size_t)source.top * stride + source.left;
+		UINT srcWidth = source.right - source.left;
+		UINT srcHeight = source.bottom - source.top;
+
+		// 16.16 fixed point source steps per destination pixel
+		uint32_t stepX = (uint32_t)(((uint64_t)srcWidth << 16) / (uint32_t)(x1 - x0));
+		uint32_t stepY = (uint32_t)(((uint64_t)srcHeight << 16) / (uint32_t)(y1 - y0));
+		uint32_t op = ToByte(opacity);
+
+		int cx0 = (x0 < m_clip.x0) ? m_clip.x0 : x0;
+		int cx1 = (x1 > m_clip.x1) ? m_clip.x1 : x1;
+		int cy0 = (y0 < m_clip.y0) ? m_clip.y0 : y0;
+		int cy1 = (y1 > m_clip.y1) ? m_clip.y1 : y1;
+
+		for (int y = cy0; y < cy1; y++) {
+			const uint32_t* srcRow = src + (size_t)(((uint32_t)(y - y0) * stepY) >> 16) * stride;
+			uint32_t* dst = Row(y);
+			uint32_t sx = (uint32_t)(cx0 - x0) * stepX;
+			for (int x = cx0; x < cx1; x++, sx += stepX) {
+				dst[x] = BlendPremultiplied(dst[x], srcRow[sx >> 16], op);
+			}
+		}
+	}
+
+	void FillRect(const D2D1_RECT_F& r, uint32_t color, uint32_t alpha) {
+		int x0 = Edge(r.left), y0 = Edge(r.top), x1 = Edge(r.right), y1 = Edge(r.bottom);
+		if (m_runOpen && (alpha == 255)) {
+			HoldBox(x0, y0, x1, y1, color);
+			return;
+		}
+		FlushRun();
+		FillBox(x0, y0, x1, y1, color, alpha);
+	}
+
+	void FillEllipseOrHold(const D2D1_ELLIPSE& e, uint32_t color, uint32_t alpha) {
+		if (m_runOpen && (alpha == 255)) {
+			HeldFill f;
+			f.m_ellipse = true;
+			f.m_e = e;
+			f.m_x0 = Edge(e.point.x - e.radiusX);
+			f.m_x1 = Edge(e.point.x + e.radiusX);
+			f.m_y0 = Edge(e.point.y - e.radiusY);
+			f.m_y1 = Edge(e.point.y + e.radiusY);
+			f.m_color = color;
+			m_run.push_back(f);
+			return;
+		}
+		FlushRun();
+		FillEllipse(e, color, alpha);
+	}
+
+	void HoldBox(int x0, int y0, int x1, int y1, uint32_t color) {
+		HeldFill f;
+		f.m_ellipse = false;
+		f.m_x0 = x0;	f.m_y0 = y0;
+		f.m_x1 = x1;	f.m_y1 = y1;
+		f.m_color = color;
+		m_run.push_back(f);
+	}
+
+	// Draw the fills held back so far, frontmost first, each only where nothing in front of it has.
+	// A band of rows at a time so the pixels being drawn stay in the cache, and fills over
+	// nothing but fully covered tiles (64 pixels by the band) aren't rasterised at all.
+	void FlushRun() {
+		if (m_run.empty()) {
+			return;
+		}
+
+		Clip clip = m_clip;
+		if ((clip.x1 <= clip.x0) || (clip.y1 <= clip.y0)) {
+			m_run.clear();	// all clipped away
+			return;
+		}
+		int bands = (clip.y1 - clip.y0 + RunBand - 1) / RunBand;
+		BinRun(clip, bands);
+		std::fill(m_covered.begin() + clip.y0 * m_coverWords, m_covered.begin() + clip.y1 * m_coverWords, 0);
+
+		m_frontToBack = true;
+		for (int band = 0; band < bands; band++) {
+			m_clip.y0 = clip.y0 + band * RunBand;
+			m_clip.y1 = (std::min)(m_clip.y0 + RunBand, clip.y1);
+			m_tileRows.assign(m_coverWords, 0);
+			int full = m_clip.y1 - m_clip.y0;
+			for (uint32_t k = m_bandStart[band]; k < m_bandStart[band + 1]; k++) {
+				const HeldFill& f = m_run[m_bandFills[k]];
+				int w0 = (std::max)(f.m_x0, clip.x0) >> 6;
+				int w1 = ((std::min)(f.m_x1, clip.x1) - 1) >> 6;
+				int w = w0;
+				while ((w <= w1) && (m_tileRows[w] == full)) {
+					w++;
+				}
+				if (w > w1) {
+					continue;	// hidden here
+				}
+				if (f.m_ellipse) {
+					FillEllipse(f.m_e, f.m_color, 255);
+				}
+				else {
+					FillBox(f.m_x0, f.m_y0, f.m_x1, f.m_y1, f.m_color, 255);
+				}
+			}
+		}
+		m_clip = clip;
+		m_frontToBack = false;
+		m_run.clear();
+	}
+
+	// m_bandFills[m_bandStart[b], m_bandStart[b + 1]) = the fills on band b, frontmost first
+	void BinRun(const Clip& clip, int bands) {
+		m_bandStart.assign(bands + 1, 0);
+		for (auto& f : m_run) {
+			if (InClip(f, clip)) {
+				for (int b = Band(f.m_y0, clip); b <= Band(f.m_y1 - 1, clip); b++) {
+					m_bandStart[b + 1]++;
+				}
+			}
+		}
+		for (int b = 1; b <= bands; b++) {
+			m_bandStart[b] += m_bandStart[b - 1];
+		}
+
+		m_bandFills.resize(m_bandStart[bands]);
+		m_bandNext.assign(m_bandStart.begin(), m_bandStart.end());
+		for (size_t i = m_run.size(); i-- > 0; ) {
+			const HeldFill& f = m_run[i];
+			if (InClip(f, clip)) {
+				for (int b = Band(f.m_y0, clip); b <= Band(f.m_y1 - 1, clip); b++) {
+					m_bandFills[m_bandNext[b]++] = (uint32_t)i;
+				}
+			}
+		}
+	}
+
+	static bool InClip(const HeldFill& f, const Clip& clip) {
+		return (f.m_x1 > f.m_x0) && (f.m_y1 > f.m_y0) &&
+			(f.m_x1 > clip.x0) && (f.m_x0 < clip.x1) && (f.m_y1 > clip.y0) && (f.m_y0 < clip.y1);
+	}
+
+	static int Band(int y, const Clip& clip) {
+		y = (std::max)((std::min)(y, clip.y1 - 1), clip.y0);
+		return (y - clip.y0) / RunBand;
+	}
+
+	// Fill [x0, x1) x [y0, y1) clipped to m_clip
+	void FillBox(int x0, int y0, int x1, int y1, uint32_t color, uint32_t alpha) {
+		if (y0 < m_clip.y0)		y0 = m_clip.y0;
+		if (y1 > m_clip.y1)		y1 = m_clip.y1;
+		for (int y = y0; y < y1; y++) {
+			FillRow(y, x0, x1, color, alpha);
+		}
+	}
+
+	void FillRow(int y, int x0, int x1, uint32_t color, uint32_t alpha) {
+		if (x0 < m_clip.x0)		x0 = m_clip.x0;
+		if (x1 > m_clip.x1)		x1 = m_clip.x1;
+		if ((x1 <= x0) || (alpha == 0)) {
+			return;
+		}
+
+		if (m_frontToBack) {
+			FillRowUncovered(y, x0, x1, color);
+		}
+		else if (alpha == 255) {
+			FillSpanOpaque(Row(y) + x0, x1 - x0, color);
+		}
+		else {
+			FillSpanBlend(Row(y) + x0, x1 - x0, color, alpha);
+		}
+	}
+
+	// The pixels of [x0, x1) on row y that nothing in front has drawn. 64 to a coverage word.
+	void FillRowUncovered(int y, int x0, int x1, uint32_t color) {
+		uint64_t* covered = &m_covered[(size_t)y * m_coverWords];
+		uint32_t* row = Row(y);
+		for (int x = x0; x < x1; ) {
+			int word = x >> 6;
+			int bit = x & 63;
+			int n = (std::min)(64 - bit, x1 - x);
+			uint64_t mask = ((n == 64) ? ~0ull : ((1ull << n) - 1)) << bit;
+			uint64_t was = covered[word];
+			uint64_t todo = mask & ~was;
+			covered[word] = was | mask;
+			if ((was != ~0ull) && ((was | mask) == ~0ull)) {
+				m_tileRows[word]++;
+			}
+			while (todo) {	// each run of uncovered pixels
+				int first = LowestBit(todo);
+				uint64_t rest = ~(todo >> first);
+				int len = rest ? LowestBit(rest) : 64 - first;
+				FillSpanOpaque(row + (word << 6) + first, len, color);
+				todo &= ~(((len == 64) ? ~0ull : ((1ull << len) - 1)) << first);
+			}
+			x += n;
+		}
+	}
+
+	static int LowestBit(uint64_t v) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+		unsigned long i;
+		_BitScanForward64(&i, v);
+		return (int)i;
+#elif defined(__GNUC__)
+		return __builtin_ctzll(v);
+#else
+		int i = 0;
+		while (!(v & 1)) {
+			v >>= 1;
+			i++;
+		}
+		return i;
+#endif
+	}
+
+	static void FillSpanOpaque(uint32_t* p, int n, uint32_t color) {
+		int i = 0;
+#if defined(SS2D_RASTER_SSE2)
+		// Spans are short and all different lengths, so no lead in or tail loops to mispredict.
+		// The last 4 pixels are written with one store that can overlap the ones before.
+		if (n >= 4) {
+			__m128i c = _mm_set1_epi32((int)color);
+			for (; i + 4 < n; i += 4) {
+				_mm_storeu_si128((__m128i*)(p + i), c);
+			}
+			_mm_storeu_si128((__m128i*)(p + n - 4), c);
+			return;
+		}
+#endif
+		for (; i < n; i++) {
+			p[i] = color;
+		}
+	}
+
+	// dst = color * alpha + dst * (1 - alpha), alpha channel included
+	static void FillSpanBlend(uint32_t* p, int n, uint32_t color, uint32_t alpha) {
+		uint32_t inv = 255 - alpha;
+		int i = 0;
+#if defined(SS2D_RASTER_SSE2)
+		__m128i zero = _mm_setzero_si128();
+		__m128i c16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+		__m128i src = _mm_add_epi16(_mm_mullo_epi16(c16, _mm_set1_epi16((short)alpha)), _mm_set1_epi16(128));
+		__m128i vinv = _mm_set1_epi16((short)inv);
+		for (; i + 4 <= n; i += 4) {
+			__m128i d = _mm_loadu_si128((const __m128i*)(p + i));
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), vinv), src);
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), vinv), src);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);	// / 255
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+			_mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(lo, hi));
+		}
+#endif
+		for (; i < n; i++) {
+			uint32_t d = p[i];
+			uint32_t ret = 0;
+			for (int shift = 0; shift < 32; shift += 8) {
+				uint32_t t = ((color >> shift) & 0xff) * alpha + ((d >> shift) & 0xff) * inv + 128;
+				ret |= ((t + (t >> 8)) >> 8) << shift;
+			}
+			p[i] = ret;
+		}
+	}
+
+	void DrawGlyph(int x, int y, int scale, wchar_t ch, uint32_t color, uint32_t alpha) {
+		if ((ch < 0x20) || (ch > 0x7e)) {
+			ch = L'?';
+		}
+		const uint8_t* columns = Font()[ch - 0x20];
+		for (int col = 0; col < GlyphWidth; col++) {
+			uint8_t bits = columns[col];
+			for (int row = 0; row < GlyphHeight; row++) {
+				if (bits & (1 << row)) {
+					FillBox(x + col * scale, y + row * scale, x + (col + 1) * scale, y + (row + 1) * scale, color, alpha);
+				}
+			}
+		}
+	}
+
+	// 5x8 glyphs for ' ' to '~'. One byte per column, bit 0 at the top.
+	static const uint8_t (*Font())[GlyphWidth] {
+		static const uint8_t font[][GlyphWidth] = {
+			{ 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5f, 0x00, 0x00 }, { 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7f, 0x14, 0x7f, 0x14 },	//  !"#
+			{ 0x24, 0x2a, 0x7f, 0x2a, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 }, { 0x36, 0x49, 0x56, 0x20, 0x50 }, { 0x00, 0x08, 0x07, 0x03, 0x00 },	// $%&'
+			{ 0x00, 0x1c, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1c, 0x00 }, { 0x2a, 0x1c, 0x7f, 0x1c, 0x2a }, { 0x08, 0x08, 0x3e, 0x08, 0x08 },	// ()*+
+			{ 0x00, 0x80, 0x70, 0x30, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, { 0x00, 0x00, 0x60, 0x60, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 },	// ,-./
+			{ 0x3e, 0x51, 0x49, 0x45, 0x3e }, { 0x00, 0x42, 0x7f, 0x40, 0x00 }, { 0x72, 0x49, 0x49, 0x49, 0x46 }, { 0x21, 0x41, 0x49, 0x4d, 0x33 },	// 0123
+			{ 0x18, 0x14, 0x12, 0x7f, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 }, { 0x3c, 0x4a, 0x49, 0x49, 0x31 }, { 0x41, 0x21, 0x11, 0x09, 0x07 },	// 4567
+			{ 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x46, 0x49, 0x49, 0x29, 0x1e }, { 0x00, 0x00, 0x14, 0x00, 0x00 }, { 0x00, 0x40, 0x34, 0x00, 0x00 },	// 89:;
+			{ 0x00, 0x08, 0x14, 0x22, 0x41 }, { 0x14, 0x14, 0x14, 0x14, 0x14 }, { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x59, 0x09, 0x06 },	// <=>?
+			{ 0x3e, 0x41, 0x5d, 0x59, 0x4e }, { 0x7c, 0x12, 0x11, 0x12, 0x7c }, { 0x7f, 0x49, 0x49, 0x49, 0x36 }, { 0x3e, 0x41, 0x41, 0x41, 0x22 },	// @ABC
+			{ 0x7f, 0x41, 0x41, 0x41, 0x3e }, { 0x7f, 0x49, 0x49, 0x49, 0x41 }, { 0x7f, 0x09, 0x09, 0x09, 0x01 }, { 0x3e, 0x41, 0x41, 0x51, 0x73 },	// DEFG
+			{ 0x7f, 0x08, 0x08, 0x08, 0x7f }, { 0x00, 0x41, 0x7f, 0x41, 0x00 }, { 0x20, 0x40, 0x41, 0x3f, 0x01 }, { 0x7f, 0x08, 0x14, 0x22, 0x41 },	// HIJK
+			{ 0x7f, 0x40, 0x40, 0x40, 0x40 }, { 0x7f, 0x02, 0x1c, 0x02, 0x7f }, { 0x7f, 0x04, 0x08, 0x10, 0x7f }, { 0x3e, 0x41, 0x41, 0x41, 0x3e },	// LMNO
+			{ 0x7f, 0x09, 0x09, 0x09, 0x06 }, { 0x3e, 0x41, 0x51, 0x21, 0x5e }, { 0x7f, 0x09, 0x19, 0x29, 0x46 }, { 0x26, 0x49, 0x49, 0x49, 0x32 },	// PQRS
+			{ 0x03, 0x01, 0x7f, 0x01, 0x03 }, { 0x3f, 0x40, 0x40, 0x40, 0x3f }, { 0x1f, 0x20, 0x40, 0x20, 0x1f }, { 0x3f, 0x40, 0x38, 0x40, 0x3f },	// TUVW
+			{ 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x03, 0x04, 0x78, 0x04, 0x03 }, { 0x61, 0x59, 0x49, 0x4d, 0x43 }, { 0x00, 0x7f, 0x41, 0x41, 0x41 },	// XYZ[
+			{ 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x41, 0x7f }, { 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 },	// \]^_
+			{ 0x00, 0x03, 0x07, 0x08, 0x00 }, { 0x20, 0x54, 0x54, 0x78, 0x40 }, { 0x7f, 0x28, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x28 },	// `abc
+			{ 0x38, 0x44, 0x44, 0x28, 0x7f }, { 0x38, 0x54, 0x54, 0x54, 0x18 }, { 0x00, 0x08, 0x7e, 0x09, 0x02 }, { 0x18, 0xa4, 0xa4, 0x9c, 0x78 },	// defg
+			{ 0x7f, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7d, 0x40, 0x00 }, { 0x20, 0x40, 0x40, 0x3d, 0x00 }, { 0x7f, 0x10, 0x28, 0x44, 0x00 },	// hijk
+			{ 0x00, 0x41, 0x7f, 0x40, 0x00 }, { 0x7c, 0x04, 0x78, 0x04, 0x78 }, { 0x7c, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 },	// lmno
+			{ 0xfc, 0x18, 0x24, 0x24, 0x18 }, { 0x18, 0x24, 0x24, 0x18, 0xfc }, { 0x7c, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x24 },	// pqrs
+			{ 0x04, 0x04, 0x3f, 0x44, 0x24 }, { 0x3c, 0x40, 0x40, 0x20, 0x7c }, { 0x1c, 0x20, 0x40, 0x20, 0x1c }, { 0x3c, 0x40, 0x30, 0x40, 0x3c },	// tuvw
+			{ 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x4c, 0x90, 0x90, 0x90, 0x7c }, { 0x44, 0x64, 0x54, 0x4c, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 },	// xyz{
+			{ 0x00, 0x00, 0x77, 0x00, 0x00 }, { 0x00, 0x41, 0x36, 0x08, 0x00 }, { 0x02, 0x01, 0x02, 0x04, 0x02 },									// |}~
+		};
+		return font;
+	}
+
+	static void Put16(std::vector<uint8_t>& out, uint16_t v) {
+		out.push_back((uint8_t)v);
+		out.push_back((uint8_t)(v >> 8));
+	}
+
+	static void Put32(std::vector<uint8_t>& out, uint32_t v) {
+		Put16(out, (uint16_t)v);
+		Put16(out, (uint16_t)(v >> 16));
+	}
+
+protected:
+	int m_width;
+	int m_height;
+	std::vector<uint32_t> m_pixels;	// top down rows of m_width
+	Clip m_clip;					// the framebuffer unless a clip has been pushed
+	std::vector<Clip> m_clips;		// PushClip() stack
+
+	bool m_runOpen;					// Between BeginOpaqueRun() and EndOpaqueRun()
+	bool m_frontToBack;				// FlushRun() is drawing
+	std::vector<HeldFill> m_run;	// in the order they came
+	std::vector<uint64_t> m_covered;	// a bit per pixel drawn by FlushRun() so far, m_coverWords a row
+	size_t m_coverWords;
+	std::vector<uint32_t> m_bandStart;	// BinRun()
+	std::vector<uint32_t> m_bandFills;
+	std::vector<uint32_t> m_bandNext;
+	std::vector<uint16_t> m_tileRows;	// rows of each coverage word in the band that are full
+};
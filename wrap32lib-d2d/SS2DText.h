@@ -0,0 +1,352 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <dwrite.h>
+#include <d2d1.h>
+
+#include <wrap32lib.h>
+
+////////////////////////////////////////////////////////////////////////
+// Text resources that are worth keeping between frames.
+// SS2DTextFormats is shared by the shapes in a window (SS2DEssentials::m_pTextFormats).
+// SS2DTextLayouts and SS2DTextNumbers belong to the Direct2D backend.
+////////////////////////////////////////////////////////////////////////
+
+// One IDWriteTextFormat per family, size, weight and alignment. Shapes borrow the
+// formats (no AddRef) and ask again after a resize. The ones nobody asked for since
+// the last Trim() go then.
+class SS2DTextFormats
+{
+public:
+	SS2DTextFormats() {}
+	~SS2DTextFormats() { Clear(); }
+
+	IDWriteTextFormat* Get(IDWriteFactory* pFactory, LPCWSTR family, FLOAT size,
+		DWRITE_FONT_WEIGHT weight = DWRITE_FONT_WEIGHT_REGULAR, DWRITE_TEXT_ALIGNMENT ta = DWRITE_TEXT_ALIGNMENT_LEADING) {
+		for (auto& f : m_formats) {
+			if ((f.m_size == size) && (f.m_weight == weight) && (f.m_ta == ta) && (f.m_family == family)) {
+				f.m_used = true;
+				return f.m_pFormat;
+			}
+		}
+
+		Format f;
+		f.m_family = family;
+		f.m_size = size;
+		f.m_weight = weight;
+		f.m_ta = ta;
+		f.m_used = true;
+		f.m_pFormat = NULL;
+		if (FAILED(pFactory->CreateTextFormat(family, NULL, weight, DWRITE_FONT_STYLE_NORMAL,
+			DWRITE_FONT_STRETCH_NORMAL, size, L"en-us", &f.m_pFormat))) {
+			return NULL;
+		}
+		f.m_pFormat->SetTextAlignment(ta);
+		m_formats.push_back(f);
+		return f.m_pFormat;
+	}
+
+	// Call once every user has had the chance to Get() again
+	void Trim() {
+		size_t count = 0;
+		for (auto& f : m_formats) {
+			if (f.m_used) {
+				f.m_used = false;
+				m_formats[count++] = f;
+			}
+			else {
+				SafeRelease(&f.m_pFormat);
+			}
+		}
+		m_formats.resize(count);
+	}
+
+	void Clear() {
+		for (auto& f : m_formats) {
+			SafeRelease(&f.m_pFormat);
+		}
+		m_formats.clear();
+	}
+
+	size_t Size() const { return m_formats.size(); }
+
+protected:
+	struct Format {
+		std::wstring m_family;
+		FLOAT m_size;
+		DWRITE_FONT_WEIGHT m_weight;
+		DWRITE_TEXT_ALIGNMENT m_ta;
+		IDWriteTextFormat* m_pFormat;
+		bool m_used;	// since the last Trim()
+	};
+	std::vector<Format> m_formats;	// only ever a handful
+};
+
+// IDWriteTextLayouts for the strings drawn lately. DrawText() lays its text out again
+// on every call. A layout is only made when the string, format or box changes.
+// The least recently used layout goes when there are too many.
+class SS2DTextLayouts
+{
+public:
+	SS2DTextLayouts(size_t capacity = 64) : m_capacity(capacity), m_clock(0) {}
+	~SS2DTextLayouts() { Clear(); }
+
+	IDWriteTextLayout* Get(IDWriteFactory* pFactory, const std::wstring& text, IDWriteTextFormat* format, FLOAT width, FLOAT height) {
+		Key k = { format, width, height, text };
+		auto it = m_layouts.find(k);
+		if (it != m_layouts.end()) {
+			it->second.m_lastUsed = ++m_clock;
+			return it->second.m_pLayout;
+		}
+
+		Layout l;
+		l.m_pLayout = NULL;
+		l.m_lastUsed = ++m_clock;
+		if (FAILED(pFactory->CreateTextLayout(text.c_str(), (UINT32)text.length(), format, width, height, &l.m_pLayout))) {
+			return NULL;
+		}
+		if (m_layouts.size() >= m_capacity) {
+			Evict();
+		}
+		format->AddRef();	// the pointer is part of the key so it mustn't be reused
+		m_layouts[k] = l;
+		return l.m_pLayout;
+	}
+
+	void Clear() {
+		for (auto& l : m_layouts) {
+			l.first.m_pFormat->Release();
+			l.second.m_pLayout->Release();
+		}
+		m_layouts.clear();
+	}
+
+protected:
+	void Evict() {
+		auto oldest = m_layouts.begin();
+		for (auto it = m_layouts.begin(); it != m_layouts.end(); ++it) {
+			if (it->second.m_lastUsed < oldest->second.m_lastUsed) {
+				oldest = it;
+			}
+		}
+		oldest->first.m_pFormat->Release();
+		oldest->second.m_pLayout->Release();
+		m_layouts.erase(oldest);
+	}
+
+	struct Key {
+		IDWriteTextFormat* m_pFormat;
+		FLOAT m_width;
+		FLOAT m_height;
+		std::wstring m_text;
+
+		bool operator==(const Key& rhs) const {
+			return (m_pFormat == rhs.m_pFormat) && (m_width == rhs.m_width) && (m_height == rhs.m_height) && (m_text == rhs.m_text);
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const {
+			size_t h = std::hash<std::wstring>()(k.m_text);
+			h = h * 31 + std::hash<IDWriteTextFormat*>()(k.m_pFormat);
+			h = h * 31 + std::hash<FLOAT>()(k.m_width);
+			return h * 31 + std::hash<FLOAT>()(k.m_height);
+		}
+	};
+
+	struct Layout {
+		IDWriteTextLayout* m_pLayout;
+		UINT64 m_lastUsed;
+	};
+
+	std::unordered_map<Key, Layout, KeyHash> m_layouts;
+	size_t m_capacity;
+	UINT64 m_clock;
+};
+
+// Numbers (scores, timers) change every frame so a layout cache doesn't help them.
+// They're drawn as a single glyph run instead. The glyphs and advances for the
+// characters below are looked up once per format, and the line's height and baseline
+// come from laying out one digit, so the run lands where DrawText() would put it.
+// Anything that might need wrapping is left to DrawText().
+class SS2DTextNumbers
+{
+public:
+	SS2DTextNumbers() {}
+	~SS2DTextNumbers() { Clear(); }
+
+	static bool IsNumber(const std::wstring& text) {
+		if (text.empty()) {
+			return false;
+		}
+		for (auto c : text) {
+			if (!c || !wcschr(Chars, c)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// false if the number couldn't be drawn this way
+	bool Draw(ID2D1RenderTarget* pRenderTarget, IDWriteFactory* pFactory, const std::wstring& text,
+		IDWriteTextFormat* format, const D2D1_RECT_F& r, ID2D1Brush* brush) {
+		const Font* f = Lookup(pFactory, format);
+		if (!f->m_pFace) {
+			return false;
+		}
+
+		FLOAT width = 0.0f;
+		m_glyphs.resize(text.length());
+		m_advances.resize(text.length());
+		for (size_t i = 0; i < text.length(); i++) {
+			size_t n = wcschr(Chars, text[i]) - Chars;
+			m_glyphs[i] = f->m_glyphs[n];
+			m_advances[i] = f->m_advances[n];
+			width += f->m_advances[n];
+		}
+		if (width > r.right - r.left) {
+			return false;
+		}
+
+		D2D1_POINT_2F pt;
+		switch (format->GetTextAlignment()) {
+		case DWRITE_TEXT_ALIGNMENT_TRAILING:	pt.x = r.right - width;	break;
+		case DWRITE_TEXT_ALIGNMENT_CENTER:		pt.x = (r.left + r.right - width) / 2;	break;
+		default:								pt.x = r.left;	break;
+		}
+		switch (format->GetParagraphAlignment()) {
+		case DWRITE_PARAGRAPH_ALIGNMENT_FAR:	pt.y = r.bottom - f->m_lineHeight;	break;
+		case DWRITE_PARAGRAPH_ALIGNMENT_CENTER:	pt.y = (r.top + r.bottom - f->m_lineHeight) / 2;	break;
+		default:								pt.y = r.top;	break;
+		}
+		pt.y += f->m_baseline;
+
+		DWRITE_GLYPH_RUN run = {};
+		run.fontFace = f->m_pFace;
+		run.fontEmSize = format->GetFontSize();
+		run.glyphCount = (UINT32)text.length();
+		run.glyphIndices = m_glyphs.data();
+		run.glyphAdvances = m_advances.data();
+		pRenderTarget->DrawGlyphRun(pt, &run, brush);
+		return true;
+	}
+
+	void Clear() {
+		for (auto& f : m_fonts) {
+			f.first->Release();
+			SafeRelease(&f.second.m_pFace);
+		}
+		m_fonts.clear();
+	}
+
+protected:
+	static constexpr wchar_t Chars[] = L"0123456789 +-.,:/%";
+	static constexpr size_t CharCount = _countof(Chars) - 1;
+	static constexpr size_t MaxFonts = 16;
+
+	struct Font {
+		IDWriteFontFace* m_pFace;	// NULL if the format's font couldn't be found
+		UINT16 m_glyphs[CharCount];
+		FLOAT m_advances[CharCount];
+		FLOAT m_lineHeight;
+		FLOAT m_baseline;
+	};
+
+	const Font* Lookup(IDWriteFactory* pFactory, IDWriteTextFormat* format) {
+		auto it = m_fonts.find(format);
+		if (it != m_fonts.end()) {
+			return &it->second;
+		}
+
+		if (m_fonts.size() >= MaxFonts) {
+			Clear();
+		}
+		format->AddRef();	// keyed on the pointer, like SS2DTextLayouts
+		Font& f = m_fonts[format];
+		f.m_pFace = NULL;
+		if (!CreateFace(pFactory, format, &f)) {
+			SafeRelease(&f.m_pFace);
+		}
+		return &f;
+	}
+
+	static bool CreateFace(IDWriteFactory* pFactory, IDWriteTextFormat* format, Font* f) {
+		// The line, as DirectWrite lays it out
+		IDWriteTextLayout* pLayout = NULL;
+		if (FAILED(pFactory->CreateTextLayout(L"0", 1, format, 1000.0f, 1000.0f, &pLayout))) {
+			return false;
+		}
+		DWRITE_LINE_METRICS line;
+		UINT32 lines = 0;
+		HRESULT hr = pLayout->GetLineMetrics(&line, 1, &lines);
+		SafeRelease(&pLayout);
+		if (FAILED(hr) || (lines != 1)) {
+			return false;
+		}
+		f->m_lineHeight = line.height;
+		f->m_baseline = line.baseline;
+
+		// The face
+		IDWriteFontCollection* pCollection = NULL;
+		if (FAILED(format->GetFontCollection(&pCollection)) || !pCollection) {
+			SafeRelease(&pCollection);
+			if (FAILED(pFactory->GetSystemFontCollection(&pCollection))) {
+				return false;
+			}
+		}
+
+		std::wstring family(format->GetFontFamilyNameLength() + 1, L'\0');
+		UINT32 index = 0;
+		BOOL exists = FALSE;
+		IDWriteFontFamily* pFamily = NULL;
+		IDWriteFont* pFont = NULL;
+		hr = format->GetFontFamilyName(&family[0], (UINT32)family.length());
+		if (SUCCEEDED(hr)) {
+			hr = pCollection->FindFamilyName(family.c_str(), &index, &exists);
+		}
+		if (SUCCEEDED(hr) && exists) {
+			hr = pCollection->GetFontFamily(index, &pFamily);
+		}
+		if (SUCCEEDED(hr) && pFamily) {
+			hr = pFamily->GetFirstMatchingFont(format->GetFontWeight(), format->GetFontStretch(), format->GetFontStyle(), &pFont);
+		}
+		if (SUCCEEDED(hr) && pFont) {
+			hr = pFont->CreateFontFace(&f->m_pFace);
+		}
+		SafeRelease(&pFont);
+		SafeRelease(&pFamily);
+		SafeRelease(&pCollection);
+		if (FAILED(hr) || !f->m_pFace) {
+			return false;
+		}
+
+		// The glyphs
+		UINT32 codePoints[CharCount];
+		for (size_t i = 0; i < CharCount; i++) {
+			codePoints[i] = Chars[i];
+		}
+		DWRITE_GLYPH_METRICS metrics[CharCount];
+		if (FAILED(f->m_pFace->GetGlyphIndices(codePoints, CharCount, f->m_glyphs)) ||
+			FAILED(f->m_pFace->GetDesignGlyphMetrics(f->m_glyphs, CharCount, metrics))) {
+			return false;
+		}
+
+		DWRITE_FONT_METRICS fm;
+		f->m_pFace->GetMetrics(&fm);
+		FLOAT scale = format->GetFontSize() / fm.designUnitsPerEm;
+		for (size_t i = 0; i < CharCount; i++) {
+			if (f->m_glyphs[i] == 0) {
+				return false;	// the font doesn't have it. Let DrawText() fall back.
+			}
+			f->m_advances[i] = metrics[i].advanceWidth * scale;
+		}
+		return true;
+	}
+
+	std::unordered_map<IDWriteTextFormat*, Font> m_fonts;
+	std::vector<UINT16> m_glyphs;	// scratch space for Draw()
+	std::vector<FLOAT> m_advances;
+};
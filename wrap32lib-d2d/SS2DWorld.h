@@ -2,6 +2,16 @@
 
 #include "MovingShapes.h"
 #include "SS2DBrush.h"
+#include "SS2DBroadphase.h"
+#include "SS2DPool.h"
+#include "SS2DCommandList.h"
+#include "SS2DAtlas.h"
+#include "SS2DLoader.h"
+#include "SS2DAssets.h"
+#include "SS2DInput.h"
+
+#include <chrono>
+#include <unordered_set>
 
 class TickDelta {
 public:
@@ -49,59 +59,164 @@ protected:
 
 class SS2DWorld
 {
+protected:
+	typedef std::chrono::steady_clock Clock;
+
 public:
 	SS2DWorld() :
 		m_colorBackground(D2D1::ColorF::Black),
 		m_screenSize(1920, 1080),
-		m_resizeHappened(false)
+		m_resizeHappened(false),
+		m_removedCount(0),
+		m_useShapeStore(false),
+		m_useBroadphase(false),
+		m_useCommandList(false),
+		m_pStatsFormat(NULL),
+		m_useAtlas(false),
+		m_useCulling(false),
+		m_culled(0),
+		m_useDirtyRects(false),
+		m_fullRedraw(0.5f),
+		m_redrawAll(true),
+		m_useAsyncLoading(false),
+		m_loading(0),
+		m_firstFrameMS(-1),
+		m_loadedMS(-1)
 	{
 		m_brushDefault = new SS2DBrush(RGB(255, 255, 255));
+		m_brushLoading = new SS2DBrush(RGB(128, 128, 128), 0.25f);
 	}
 
 	~SS2DWorld() {
+		delete m_brushLoading;	// kept through DeInit() as the world can be started again
+		delete m_brushDefault;
 	}
 
+	// With no render target (headless) the brushes are accounted for but not created and
+	// bitmaps are only decoded (into CPU pixels) if there's a WIC factory
 	void SS2DCreateResources(const SS2DEssentials& ess) {
-		m_brushDefault->Create(ess.m_pRenderTarget);
-		m_brushes.push_back(m_brushDefault);
+		m_redrawAll = true;	// whatever's on the target isn't ours
+		m_timeCreated = Clock::now();
+		m_firstFrameMS = m_loadedMS = -1;
 
-		while (!m_brushQueue.empty()) {
-			auto p = m_brushQueue.front();
-			p->Create(ess.m_pRenderTarget);
-			m_brushes.push_back(p);
-			m_brushQueue.pop();
+		CreateStatsFormat(ess);
+
+		// The brushes kept from before a device loss are made again along with the new ones
+		m_brushes.insert(m_brushQueue.begin(), m_brushQueue.end());
+		m_brushQueue.clear();
+		if (ess.m_pRenderTarget) {
+			m_brushDefault->Create(ess.m_pRenderTarget);
+			m_brushLoading->Create(ess.m_pRenderTarget);
+			for (auto p : m_brushes) {
+				p->Create(ess.m_pRenderTarget);
+			}
 		}
 
+		std::vector<SS2DBitmap*> bitmaps;
 		while (!m_bitmapQueue.empty()) {
-			auto p = m_bitmapQueue.front();
-			p->LoadFromFile(ess.m_pRenderTarget, ess.m_pIWICFactory);
+			bitmaps.push_back(m_bitmapQueue.front());
 			m_bitmapQueue.pop();
 		}
+		if (m_useAtlas) {
+			BuildAtlas(ess, bitmaps);
+		}
+
+		std::vector<SS2DBitmap*> decode;
+		for (auto p : bitmaps) {
+			if (p->IsRegion()) {
+				continue;	// drawn from its atlas page
+			}
+			if (!p->HasPixels() && LoadFromAssets(ess, p)) {
+				continue;	// decoded for an earlier world
+			}
+			if (ess.m_pRenderTarget && p->HasPixels()) {
+				p->CreateFromPixels(ess.m_pRenderTarget);	// already decoded
+			}
+			else if (m_useAsyncLoading && ess.m_pIWICFactory && !p->HasPixels()) {
+				decode.push_back(p);	// uploaded by CollectBitmaps()
+			}
+			else if (ess.m_pAssets && ess.m_pIWICFactory) {
+				if (DecodePixels(ess, p)) {	// kept for next time
+					UploadBitmap(ess, p);
+				}
+			}
+			else if (ess.m_pRenderTarget && ess.m_pIWICFactory) {
+				p->LoadFromFile(ess.m_pRenderTarget, ess.m_pIWICFactory);
+			}
+			else if (ess.m_pIWICFactory && !p->HasPixels()) {
+				p->LoadPixelsFromFile(ess.m_pIWICFactory);	// for the software backend
+			}
+		}
+		m_loader.Load(ess.m_pIWICFactory, decode, ess.m_pAssets);
+		m_loading += decode.size();
+		if (m_loading == 0) {
+			m_loadedMS = Elapsed(m_timeCreated);
+		}
 	}
 
 	virtual bool SS2DDiscardResources() {
 		for (auto p : m_shapes) {
-			p->SS2DDiscardResources();
+			if (p) {
+				p->SS2DDiscardResources();
+				p->DetachStore();
+			}
 		}
 		m_shapes.clear();
+		m_removedCount = 0;
+		m_broadphase.Clear();
 
+		m_brushDefault->Clear();
+		m_brushLoading->Clear();
 		for (auto b : m_brushes) {
-			b->Clear();
+			b->Clear();	// but keep them for the next SS2DCreateResources()
 		}
-		m_brushes.clear();
+		m_commands.ResetResources();
+		m_pStatsFormat = NULL;	// borrowed from SS2DEssentials::m_pTextFormats
+		m_atlas.DiscardResources();
 		return true;
 	}
 
 	void SS2DOnResize(const SS2DEssentials& ess) {
 		m_resizeHappened = true;
+		m_redrawAll = true;
 	}
 
-	SS2DBrush* NewResourceBrush(COLORREF cr, FLOAT alpha = 1.0) {
+	// Everyone asking for the same colour and alpha shares one brush.
+	// Shapes in random colours (particles, say) can keep fewer bits per channel so
+	// there are only so many brushes however many shapes there are. 3 bits is 512 colours.
+	SS2DBrush* NewResourceBrush(COLORREF cr, FLOAT alpha = 1.0, UINT bits = 8) {
+		if (bits < 8) {
+			cr = RGB(Quantise(GetRValue(cr), bits), Quantise(GetGValue(cr), bits), Quantise(GetBValue(cr), bits));
+			alpha = (FLOAT)Quantise((BYTE)(alpha * 255.0f + 0.5f), bits) / 255.0f;
+		}
+
+		uint64_t key = BrushKey(cr, alpha);
+		auto it = m_brushIndex.find(key);
+		if (it != m_brushIndex.end()) {
+			it->second->AddRef();
+			return it->second;
+		}
+
 		SS2DBrush* p = new SS2DBrush(cr, alpha);
+		m_brushIndex[key] = p;
 		QueueResourceBrush(p);
 		return p;
 	}
 
+	// Hand back a NewResourceBrush(). The last one out deletes the brush.
+	void ReleaseResourceBrush(SS2DBrush* p) {
+		if (p->Release() > 0) {
+			return;
+		}
+		m_brushIndex.erase(BrushKey(p->GetColor(), p->GetAlpha()));
+		m_brushes.erase(p);
+		m_brushQueue.erase(p);
+		m_commands.ForgetBrush(p);	// its id mustn't go to whatever's next at this address
+		delete p;
+	}
+
+	size_t SS2DGetBrushCount() const { return m_brushes.size() + m_brushQueue.size(); }
+
 	SS2DBitmap* NewResourceBitmap(LPCWSTR filePath) {
 		SS2DBitmap* p = new SS2DBitmap(filePath);
 		QueueResourceBitmap(p);
@@ -147,41 +262,146 @@ public:
 
 	void AddShape(Shape* p, const SS2DEssentials& ess, bool active = true) {
 		InitShape(p, ess);
+		if (m_useShapeStore) {
+			p->AttachStore(&m_store, active, true);
+		}
 		p->SetActive(active);
+		p->SetWorldIndex(m_shapes.size());
 		m_shapes.push_back(p);
 	}
 
 	void RemoveAllShapes() {
 		for (auto it = m_shapes.begin(); it != m_shapes.end(); ++it) {
-			(*it)->SS2DDiscardResources();
+			if (*it) {
+				(*it)->SS2DDiscardResources();
+				(*it)->DetachStore();
+				(*it)->SetWorldIndex(Shape::NoIndex);
+			}
 		}
 		m_shapes.clear();
+		m_removedCount = 0;
+		m_broadphase.Clear();
 	}
 
+	// O(1). The shape's slot is left empty until CompactShapes() so loops over the shapes
+	// aren't upset by removals part way through.
 	void RemoveShape(Shape* p, bool del = false) {
-		for (auto it = m_shapes.begin(); it != m_shapes.end(); ++it) {
-			if (*it == p) {
-				p->SS2DDiscardResources();
-				m_shapes.erase(it);
+		if (!p) {
+			return;
+		}
+
+		size_t index = p->GetWorldIndex();
+		if ((index < m_shapes.size()) && (m_shapes[index] == p)) {
+			p->SS2DDiscardResources();
+			p->DetachStore();
+			BroadphaseRemove(p);
+			m_shapes[index] = NULL;
+			m_removedCount++;
+			p->SetWorldIndex(Shape::NoIndex);
+			if (del) {
+				Shape::Destroy(p);
+			}
+			return;
+		}
+
+		// Might not have made it into the engine yet
+		for (auto it = m_shapesQueue.begin(); it != m_shapesQueue.end(); ++it) {
+			if (it->first == p) {
+				m_shapesQueue.erase(it);
 				if (del) {
-					delete p;
+					Shape::Destroy(p);
 				}
 				return;
 			}
 		}
 	}
 
+	// Pooled versions of the New functions for shapes that are created and removed all the time
+	// (bullets, snow, extra balls). Remove them with Despawn() or RemoveShape(p, true).
+	MovingRectangle* SpawnMovingRectangle(FLOAT x, FLOAT y, FLOAT width, FLOAT height, FLOAT speed, int dir, SS2DBrush* brush, LPARAM userdata = 0, bool active = true) {
+		MovingRectangle* p = m_poolRectangles.Allocate(x, y, width, height, speed, dir, brush, userdata);
+		QueueShape(p, active);
+		return p;
+	}
+
+	MovingCircle* SpawnMovingCircle(FLOAT x, FLOAT y, FLOAT radius, FLOAT speed, int dir, SS2DBrush* brush, LPARAM userdata = 0, bool active = true) {
+		MovingCircle* p = m_poolCircles.Allocate(x, y, radius, speed, dir, brush, userdata);
+		QueueShape(p, active);
+		return p;
+	}
+
+	MovingBitmap* SpawnMovingBitmap(SS2DBitmap* bitmap, FLOAT x, FLOAT y, FLOAT width, FLOAT height, FLOAT speed, int dir, FLOAT opacity = 1.0F, LPARAM userdata = 0, bool active = true) {
+		MovingBitmap* p = m_poolBitmaps.Allocate(bitmap, x, y, width, height, speed, dir, opacity, userdata);
+		QueueShape(p, active);
+		return p;
+	}
+
+	void Despawn(Shape* p) {
+		RemoveShape(p, true);
+	}
+
+	// Reserve pool slots up front (e.g. in SS2DInit()) so spawning doesn't allocate mid game
+	void SS2DPrewarmPools(size_t rectangles, size_t circles, size_t bitmaps = 0) {
+		m_poolRectangles.Prewarm(rectangles);
+		m_poolCircles.Prewarm(circles);
+		m_poolBitmaps.Prewarm(bitmaps);
+	}
+
+	const SS2DSlabPool<MovingRectangle>& GetRectanglePool() const { return m_poolRectangles; }
+	const SS2DSlabPool<MovingCircle>& GetCirclePool() const { return m_poolCircles; }
+	const SS2DSlabPool<MovingBitmap>& GetBitmapPool() const { return m_poolBitmaps; }
+
+	// Handles are safe to keep across frames where a Shape* isn't. Resolve() returns NULL
+	// once the shape has been deleted or despawned. Any shape can have one, children included.
+	SS2DHandle GetHandle(Shape* p) {
+		if (p->GetHandle() == SS2DHandleTable::InvalidHandle) {
+			p->SetHandle(&m_handles, m_handles.Create(p));
+		}
+		return p->GetHandle();
+	}
+
+	// NULL if the shape has gone or isn't a T
+	template<class T = Shape> T* Resolve(SS2DHandle h) const {
+		return ShapeCast<T>(m_handles.Get(h));
+	}
+
+	bool IsAlive(SS2DHandle h) const { return m_handles.IsValid(h); }
+
 	std::vector<Shape*>::iterator RemoveShape(std::vector<Shape*>::iterator it) {
-		Shape* p = (*it);
-		p->SS2DDiscardResources();
-		return m_shapes.erase(it);
+		RemoveShape(*it);
+		return it + 1;
+	}
+
+	// Close up the gaps left by RemoveShape(). Keeps the drawing order.
+	void CompactShapes() {
+		if (m_removedCount == 0) {
+			return;
+		}
+
+		size_t count = 0;
+		for (auto p : m_shapes) {
+			if (p) {
+				p->SetWorldIndex(count);
+				m_shapes[count++] = p;
+			}
+		}
+		m_shapes.resize(count);
+		m_removedCount = 0;
 	}
 
 	void D2DPreRender(const SS2DEssentials& ess) {
+		CompactShapes();
+		CollectBitmaps(ess);
+
 		if (m_resizeHappened) {
 			for (auto s : m_shapes) {
 				s->SS2DOnResize(ess);
 			}
+			CreateStatsFormat(ess);
+			if (ess.m_pTextFormats) {
+				ess.m_pTextFormats->Trim();	// everyone has the new sizes. Lose the old ones.
+			}
+			m_resizeHappened = false;
 		}
 
 		// Now is the time to add queued shapes to the engine.
@@ -189,14 +409,16 @@ public:
 			AddShape(p.first, ess, p.second);
 		}
 		m_shapesQueue.clear();
+
+		SS2DBroadphaseRefresh();	// pick up the new shapes
 	}
 
 	void QueueShape(Shape* p, bool active = true) {
 		m_shapesQueue.push_back(std::make_pair(p, active));
 	}
 
-	void QueueResourceBrush(SS2DBrush* p) {
-		m_brushQueue.push(p);
+	void QueueResourceBrush(SS2DBrush* p) {	// the world deletes it in DeInit()
+		m_brushQueue.insert(p);
 	}
 
 	void QueueResourceBitmap(SS2DBitmap* p) {
@@ -208,33 +430,142 @@ public:
 	}
 
 	void DeInit() {
+		m_loader.Cancel();
+		m_loading = 0;
 		SS2DDeInit();
 		for (auto c : m_shapes) {
-			delete c;
+			if (c) {
+				Shape::Destroy(c);
+			}
 		}
+
+		for (auto b : m_brushes) {
+			delete b;
+		}
+		for (auto b : m_brushQueue) {
+			delete b;
+		}
+		m_brushes.clear();
+		m_brushQueue.clear();
+		m_brushIndex.clear();
 	}
 
 	virtual void SS2DDeInit() {
 	}
 
 	virtual bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) {
-		for (auto p : m_shapes)
-			if (p->IsActive())
-				p->Move();
+		CompactShapes();	// once per frame, after the game has done its removals
+
+		if (m_useShapeStore) {
+			m_store.MoveActive();	// one sweep over the store moves every active shape and its children
+			for (auto p : m_shapes)
+				if (p->IsActive())
+					p->StoreHasMoved();	// world positions and group refits, one walk of each tree
+		}
+		else {
+			for (auto p : m_shapes)
+				if (p->IsActive())
+					p->Move();
+
+			// Work out every world position once, top down, so the rest of the frame just reads them
+			for (auto p : m_shapes)
+				if (p->IsActive())
+					p->FlattenTransforms();
+		}
+
+		SS2DBroadphaseRefresh();
 		return true;
 	}
 
 	virtual bool D2DRender(const SS2DEssentials& ess) {
-		if (ess.m_ss2dFlags & SS2D_SHOW_STATS) {
-			// draw some stats here!!!
+		SS2DRecordFrame(ess);
+		SS2DSubmitFrame(ess);
+		return true;
+	}
+
+	// The draw pass. With the command list on the shapes draw into m_commands
+	// and nothing reaches the backend until SS2DSubmitFrame().
+	void SS2DRecordFrame(const SS2DEssentials& ess) {
+		SS2DEssentials essDraw = ess;
+		if (m_useCommandList) {
+			essDraw.m_pBackend = &m_commands;
+			m_commands.Reset();
+			m_commands.SetOutput(ess.m_pBackend);	// for layers
 		}
 
-		for (auto p : m_shapes)
-			if (p->IsActive())
-				p->Draw(ess);
+		essDraw.m_pBrushLoading = m_brushLoading;
+		essDraw.m_cull = m_useCulling;
+		essDraw.m_culled = 0;
+		if (m_useCulling) {
+			ess.m_rsFAR.GetUserRect(&essDraw.m_rectCull);
+			ess.m_rsFAR.ReverseScaleAndOffset(&essDraw.m_rectCull);
+		}
 
-		return true;
+		DrawShapes(essDraw);
+		m_culled = essDraw.m_culled;
+	}
+
+	void SS2DSubmitFrame(const SS2DEssentials& ess) {
+		if (SS2DUsingDirtyRects()) {
+			SubmitDirtyRects(ess);
+		}
+		else if (m_useCommandList) {
+			m_commands.Replay(*ess.m_pBackend);
+		}
+
+		if (m_firstFrameMS < 0) {
+			m_firstFrameMS = Elapsed(m_timeCreated);
+		}
+	}
+
+	// This frame's keys and mouse, copied in by whatever runs the world (D2DWindow::SS2DGetInput(),
+	// SS2DHeadless) just before SS2DUpdate(). KeyDown() and KeyPressed() ask it.
+	void SS2DSetInput(const SS2DInput& input) { m_input = input; }
+	const SS2DInput& SS2DGetInput() const { return m_input; }
+
+	// Decode bitmaps on worker threads (SS2DBitmapLoader) rather than in SS2DCreateResources()
+	// so the first frame needn't wait for them. Shapes draw a placeholder until theirs arrives.
+	// Bitmaps that have to be packed into atlas pages are decoded in parallel but still waited for.
+	void SS2DUseAsyncLoading(bool b) { m_useAsyncLoading = b; }
+	bool SS2DUsingAsyncLoading() const { return m_useAsyncLoading; }
+
+	// Time from SS2DCreateResources() to the end of the first frame and to the last bitmap
+	// being ready. -1 until then.
+	double SS2DGetFirstFrameMS() const { return m_firstFrameMS; }
+	double SS2DGetLoadedMS() const { return m_loadedMS; }
+
+	// Pack the world's bitmaps into atlas pages as they're loaded so they can be drawn in one sprite batch.
+	// With a table written by SS2DAtlas::Save() the bitmaps named in it come from its pages instead.
+	// Set this before any bitmaps are added (e.g. in the world constructor).
+	void SS2DUseAtlas(bool b, LPCWSTR tablePath = NULL) {
+		m_useAtlas = b;
+		m_atlasTable = tablePath ? tablePath : L"";
 	}
+	const SS2DAtlas& GetAtlas() const { return m_atlas; }
+
+	// Record the frame as an SS2DCommandList then replay it, or draw straight to the backend (default).
+	// Replaying is what batches draws by brush and bitmap page.
+	void SS2DUseCommandList(bool b) { m_useCommandList = b; }
+	bool SS2DUsingCommandList() const { return m_useCommandList; }
+	const SS2DCommandList& GetCommandList() const { return m_commands; }	// Last frame recorded
+
+	// Don't draw shapes that are wholly outside the user rect. Groups that are skip their children too.
+	void SS2DUseCulling(bool b) { m_useCulling = b; }
+	bool SS2DUsingCulling() const { return m_useCulling; }
+	size_t SS2DGetCulled() const { return m_culled; }	// Last frame
+
+	// Only redraw the parts of the target that changed since the last frame (needs the command list).
+	// The world clears behind what it redraws so the window mustn't clear the target first,
+	// and the target has to keep its contents between frames (D2DWindow's does).
+	// If the changes cover more than fullRedraw of the target it's all redrawn.
+	void SS2DUseDirtyRects(bool b, FLOAT fullRedraw = 0.5f) {
+		m_useDirtyRects = b;
+		m_fullRedraw = fullRedraw;
+		m_redrawAll = true;
+	}
+	bool SS2DUsingDirtyRects() const { return m_useDirtyRects && m_useCommandList; }
+	void SS2DRedrawAll() { m_redrawAll = true; }	// next frame, e.g. after drawing over the world
+	const std::vector<D2D1_RECT_F>& SS2DGetDirtyRects() const { return m_dirty; }	// Last frame. The whole target for a full redraw.
 
 	virtual w32Size& SS2DGetScreenSize() {
 		return m_screenSize;
@@ -246,25 +577,538 @@ public:
 
 	SS2DBrush* GetDefaultBrush() { return m_brushDefault;  }
 
+	// Keep shape positions in a structure-of-arrays store so SS2DUpdate() moves them in one sweep.
+	// Set this before any shapes are added (e.g. in the world constructor).
+	void SS2DUseShapeStore(bool b) { m_useShapeStore = b; }
+	bool SS2DUsingShapeStore() const { return m_useShapeStore; }
+	SS2DShapeStore& GetShapeStore() { return m_store; }
+
+	// Lookahead bounds check for every active world shape in one go. Only the shapes that will be over
+	// an edge of rBounds after their next move come back, with the same result WillHitBounds() would give.
+	// With the shape store on childless shapes are checked in a vectorised pass over the store.
+	int SS2DClassifyBounds(const RectF& rBounds, std::vector<std::pair<Shape*, Shape::moveResult>>& ret) {
+		size_t first = ret.size();
+		if (m_useShapeStore) {
+			m_boundsHits.clear();
+			m_store.ClassifyActive(rBounds.left, rBounds.top, rBounds.right, rBounds.bottom, m_boundsHits);
+			for (auto& hit : m_boundsHits) {
+				Shape* p = (Shape*)hit.user;
+				if (p->IsStoreRoot() && p->GetChildren().empty()) {
+					ret.push_back(std::make_pair(p, ToMoveResult(hit.code)));
+				}
+			}
+		}
+
+		// Anything the store can't answer for
+		RectF r = rBounds;
+		for (auto p : m_shapes) {
+			if (p && p->IsActive() && (!p->IsStoreRoot() || !p->GetChildren().empty())) {
+				Shape::moveResult result = p->WillHitBounds(r);
+				if (result != Shape::moveResult::ok) {
+					ret.push_back(std::make_pair(p, result));
+				}
+			}
+		}
+		return (int)(ret.size() - first);
+	}
+
+	int SS2DClassifyBounds(const w32Size& screenSize, std::vector<std::pair<Shape*, Shape::moveResult>>& ret) {
+		return SS2DClassifyBounds(RectF(0, 0, (FLOAT)screenSize.cx, (FLOAT)screenSize.cy), ret);
+	}
+
+	// The same for just the shapes given, e.g. the ones a game bounces off the edges. Shapes in
+	// the store read the next bounds MoveActive() worked out rather than stepping their position.
+	int SS2DClassifyBounds(const RectF& rBounds, const std::vector<Shape*>& shapes, std::vector<std::pair<Shape*, Shape::moveResult>>& ret) {
+		size_t first = ret.size();
+		RectF r = rBounds;
+		for (auto p : shapes) {
+			if (p && p->IsActive()) {
+				Shape::moveResult result = p->WillHitBounds(r);
+				if (result != Shape::moveResult::ok) {
+					ret.push_back(std::make_pair(p, result));
+				}
+			}
+		}
+		return (int)(ret.size() - first);
+	}
+
+	int SS2DClassifyBounds(const w32Size& screenSize, const std::vector<Shape*>& shapes, std::vector<std::pair<Shape*, Shape::moveResult>>& ret) {
+		return SS2DClassifyBounds(RectF(0, 0, (FLOAT)screenSize.cx, (FLOAT)screenSize.cy), shapes, ret);
+	}
+
+	// Keep a uniform grid of the active shapes so the Query functions below only look at nearby shapes.
+	// The grid holds leaf shapes (groups are represented by their children) and is refreshed after
+	// the shapes move each update. Without it the queries fall back to checking every shape.
+	void SS2DUseBroadphase(bool b, FLOAT cellSize = 128.0f) {
+		m_useBroadphase = b;
+		m_broadphase.SetCellSize(cellSize);
+	}
+
+	void SS2DBroadphaseRefresh() {
+		if (!m_useBroadphase) {
+			return;
+		}
+
+		m_broadphase.BeginRefresh();
+		for (auto p : m_shapes) {
+			if (p && p->IsActive()) {
+				BroadphaseAdd(p);
+			}
+		}
+		m_broadphase.EndRefresh();
+	}
+
+	// Active leaf shapes whose bounds (now or after their next move) overlap r
+	int QueryRect(const RectF& r, std::vector<Shape*>& ret) {
+		if (m_useBroadphase) {
+			return m_broadphase.Query(r, ret);
+		}
+
+		std::vector<Shape*> leaves;
+		for (auto p : m_shapes) {
+			if (p && p->IsActive()) {
+				GetLeaves(p, leaves);
+			}
+		}
+
+		int count = 0;
+		RectF rQuery = r;
+		for (auto p : leaves) {
+			RectF rLeaf;
+			GetSweptBounds(p, &rLeaf);
+			if (rQuery.hitTest(rLeaf)) {
+				ret.push_back(p);
+				count++;
+			}
+		}
+		return count;
+	}
+
+	// Active leaf shapes that the shape could touch this move (not including itself)
+	int QueryShape(Shape* shape, std::vector<Shape*>& ret) {
+		RectF r;
+		GetSweptBounds(shape, &r);
+
+		size_t first = ret.size();
+		QueryRect(r, ret);
+		ret.erase(std::remove(ret.begin() + first, ret.end(), shape), ret.end());
+		return (int)(ret.size() - first);
+	}
+
+	// All pairs of active leaf shapes whose bounds overlap
+	int QueryPairs(std::vector<std::pair<Shape*, Shape*>>& ret) {
+		if (m_useBroadphase) {
+			return m_broadphase.QueryPairs(ret);
+		}
+
+		std::vector<Shape*> leaves;
+		for (auto p : m_shapes) {
+			if (p && p->IsActive()) {
+				GetLeaves(p, leaves);
+			}
+		}
+
+		std::vector<RectF> rects(leaves.size());
+		for (size_t i = 0; i < leaves.size(); i++) {
+			GetSweptBounds(leaves[i], &rects[i]);
+		}
+
+		int count = 0;
+		for (size_t i = 0; i < leaves.size(); i++) {
+			for (size_t j = i + 1; j < leaves.size(); j++) {
+				if (rects[i].hitTest(rects[j])) {
+					ret.push_back(std::make_pair(leaves[i], leaves[j]));
+					count++;
+				}
+			}
+		}
+		return count;
+	}
+
+	// The bounds the shape covers now and after its next move
+	static void GetSweptBounds(Shape* p, RectF* pRect) {
+		Point2F pos = p->GetPos();
+		p->GetBoundingBox(pRect, pos);
+
+		p->MovePos(pos);
+		RectF rNext;
+		p->GetBoundingBox(&rNext, pos);
+		pRect->UnionRect(rNext);
+	}
+
 protected:
-	int KeyDown(int keycode) {
-		return ::GetAsyncKeyState(keycode) & 0x8000;
+	// To the byte, as drawn, so alphas a rounding error apart (or 0.0 and -0.0) share a brush
+	static uint64_t BrushKey(COLORREF cr, FLOAT alpha) {
+		BYTE a = (alpha > 0.0f) ? (BYTE)((std::min)(alpha, 1.0f) * 255.0f + 0.5f) : 0;
+		return ((uint64_t)(cr & 0xffffff) << 8) | a;
+	}
+
+	// Nearest of 2^bits evenly spread levels, 0 and 255 included
+	static BYTE Quantise(BYTE v, UINT bits) {
+		UINT levels = (1u << (std::max)(bits, 1u)) - 1;
+		return (BYTE)(((v * levels + 127) / 255) * 255 / levels);
 	}
 
-	int KeyPressed(int keycode) {
-		return ::GetAsyncKeyState(keycode) & 0x0001;
+	static Shape::moveResult ToMoveResult(SS2DShapeStore::BoundsCode code) {
+		switch (code) {
+		case SS2DShapeStore::BoundsCode::left:		return Shape::moveResult::hitboundsleft;
+		case SS2DShapeStore::BoundsCode::right:		return Shape::moveResult::hitboundsright;
+		case SS2DShapeStore::BoundsCode::top:		return Shape::moveResult::hitboundstop;
+		case SS2DShapeStore::BoundsCode::bottom:	return Shape::moveResult::hitboundsbottom;
+		default:									return Shape::moveResult::ok;
+		}
+	}
+
+	// Prebuilt regions first then pack whatever's left. New pages are added to bitmaps to be loaded.
+	void BuildAtlas(const SS2DEssentials& ess, std::vector<SS2DBitmap*>& bitmaps) {
+		std::vector<SS2DBitmap*> pages;
+		if (!m_atlasTable.empty()) {
+			m_atlas.Load(m_atlasTable, bitmaps, pages);
+		}
+
+		if (ess.m_pIWICFactory) {
+			std::vector<SS2DBitmap*> decode;
+			for (auto p : bitmaps) {
+				if (!p->IsRegion() && !p->HasPixels()) {
+					if (m_useAsyncLoading) {
+						decode.push_back(p);
+					}
+					else {
+						DecodePixels(ess, p);
+					}
+				}
+			}
+			if (!decode.empty()) {	// packing needs them all
+				m_loader.Load(ess.m_pIWICFactory, decode, ess.m_pAssets);
+				m_loader.Wait();
+				decode.clear();
+				m_loader.Collect(decode);
+			}
+			size_t first = m_atlas.GetPageCount();
+			m_atlas.Build(bitmaps);
+			for (size_t n = first; n < m_atlas.GetPageCount(); n++) {
+				pages.push_back(m_atlas.GetPage(n));
+			}
+		}
+
+		bitmaps.insert(bitmaps.end(), pages.begin(), pages.end());
+	}
+
+	void DrawShapes(const SS2DEssentials& ess) {
+		for (auto p : m_shapes)
+			if (p && p->IsActive())
+				p->DrawIfVisible(ess);
+
+		if (ess.m_ss2dFlags & SS2D_SHOW_STATS) {
+			DrawStats(ess);
+		}
+	}
+
+	// Upload whatever the loader has finished since last frame
+	void CollectBitmaps(const SS2DEssentials& ess) {
+		if (m_loading == 0) {
+			return;
+		}
+
+		m_loaded.clear();
+		m_loading = m_loader.Collect(m_loaded);
+		for (auto p : m_loaded) {
+			UploadBitmap(ess, p);
+		}
+		if (m_loading == 0) {
+			m_loadedMS = Elapsed(m_timeCreated);
+		}
+	}
+
+	// From ess.m_pAssets if it has them, the file if not (and then they're added)
+	bool DecodePixels(const SS2DEssentials& ess, SS2DBitmap* p) {
+		if (ess.m_pAssets && ess.m_pAssets->GetPixels(p)) {
+			return true;
+		}
+		if (FAILED(p->LoadPixelsFromFile(ess.m_pIWICFactory))) {
+			return false;
+		}
+		if (ess.m_pAssets) {
+			ess.m_pAssets->AddPixels(p);
+		}
+		return true;
+	}
+
+	// The device bitmap or the pixels from ess.m_pAssets. false if it doesn't have either.
+	bool LoadFromAssets(const SS2DEssentials& ess, SS2DBitmap* p) {
+		if (!ess.m_pAssets || p->GetFilePath().empty()) {
+			return false;
+		}
+		if (ess.m_pRenderTarget) {
+			ID2D1Bitmap* pBitmap = ess.m_pAssets->GetDeviceBitmap(p->GetFilePath(), 0, 0, ess.m_pRenderTarget);
+			if (pBitmap) {
+				p->SetD2DBitmap(pBitmap);	// same render target so no need for the pixels
+				return true;
+			}
+		}
+		if (!ess.m_pAssets->GetPixels(p)) {
+			return false;
+		}
+		UploadBitmap(ess, p);
+		return true;
+	}
+
+	// Decoded pixels to the device (if there is one). ess.m_pAssets gets the result to hand out again.
+	void UploadBitmap(const SS2DEssentials& ess, SS2DBitmap* p) {
+		if (!ess.m_pRenderTarget || !p->HasPixels()) {
+			return;
+		}
+		p->CreateFromPixels(ess.m_pRenderTarget);
+		if (ess.m_pAssets && !p->GetFilePath().empty()) {
+			ess.m_pAssets->SetDeviceBitmap(p->GetFilePath(), 0, 0, ess.m_pRenderTarget, p->GetD2DBitmap());
+		}
+	}
+
+	static double Elapsed(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	void CreateStatsFormat(const SS2DEssentials& ess) {
+		m_pStatsFormat = NULL;
+		if (ess.m_pDWriteFactory && ess.m_pTextFormats) {	// SS2D_SHOW_STATS
+			FLOAT fHeight = StatsHeight;
+			ess.m_rsFAR.ScaleNoOffset(&fHeight);
+			m_pStatsFormat = ess.m_pTextFormats->Get(ess.m_pDWriteFactory, L"Arial", fHeight);
+		}
+	}
+
+	// Last frame's numbers, top left, over everything
+	void DrawStats(const SS2DEssentials& ess) {
+		if (!m_pStatsFormat && ess.m_pRenderTarget) {
+			return;	// Direct2D can't draw text without a format. The software backend can.
+		}
+
+		wchar_t text[128];
+		if (m_useCommandList) {
+			const SS2DCommandList::Stats& stats = m_commands.GetStats();
+			int n = swprintf_s(text, L"%zu draws, %zu calls, %zu batches, %zu culled", stats.m_commands, stats.m_calls, stats.m_batches, m_culled);
+			if (SS2DUsingDirtyRects() && (n > 0)) {
+				n += swprintf_s(text + n, _countof(text) - n, L", %zu dirty", m_dirty.size());
+			}
+			if (m_loading && (n > 0)) {
+				swprintf_s(text + n, _countof(text) - n, L", %zu loading", m_loading);
+			}
+		}
+		else {
+			swprintf_s(text, L"%zu shapes, %zu culled, no command list", m_shapes.size() - m_removedCount, m_culled);
+		}
+
+		Point2F pos(StatsHeight / 2, StatsHeight / 2);
+		FLOAT fWidth = (FLOAT)m_screenSize.cx;
+		FLOAT fHeight = StatsHeight;
+		ess.m_rsFAR.Scale(&pos);
+		ess.m_rsFAR.ScaleNoOffset(&fWidth);
+		ess.m_rsFAR.ScaleNoOffset(&fHeight);
+
+		D2D1_RECT_F r;
+		r.left = pos.x;
+		r.right = pos.x + fWidth;
+		r.top = pos.y;
+		r.bottom = pos.y + fHeight;
+		ess.m_pBackend->DrawString(text, m_pStatsFormat, DWRITE_TEXT_ALIGNMENT_LEADING, r, m_brushDefault);
+	}
+
+	void BroadphaseAdd(Shape* p) {
+		if (p->GetChildren().empty()) {
+			RectF r;
+			GetSweptBounds(p, &r);
+			m_broadphase.Update(p, r);
+		}
+		else {
+			for (auto c : p->GetChildren()) {
+				if (c->IsActive()) {
+					BroadphaseAdd(c);
+				}
+			}
+		}
+	}
+
+	void BroadphaseRemove(Shape* p) {
+		if (m_useBroadphase) {
+			m_broadphase.Remove(p);
+			for (auto c : p->GetChildren()) {
+				BroadphaseRemove(c);
+			}
+		}
+	}
+
+	static void GetLeaves(Shape* p, std::vector<Shape*>& leaves) {
+		if (p->GetChildren().empty()) {
+			leaves.push_back(p);
+		}
+		else {
+			for (auto c : p->GetChildren()) {
+				if (c->IsActive()) {
+					GetLeaves(c, leaves);
+				}
+			}
+		}
 	}
 
 protected:
-	std::vector<Shape*> m_shapes;
-	std::vector<SS2DBrush*> m_brushes;
+	// From this frame's SS2DSetInput() so they hold still for the whole update
+	bool KeyDown(int keycode) const {
+		return m_input.KeyDown((UINT)keycode);
+	}
+
+	bool KeyPressed(int keycode) const {
+		return m_input.KeyPressed((UINT)keycode);
+	}
+
+protected:
+	std::vector<Shape*> m_shapes;		// May have NULL gaps from RemoveShape() until CompactShapes()
+	size_t m_removedCount;
+	std::unordered_set<SS2DBrush*> m_brushes;	// Sets so a brush can go in O(1) (ReleaseResourceBrush())
 	std::vector<std::pair<Shape*, bool>> m_shapesQueue;
 	std::queue<SS2DBitmap*> m_bitmapQueue;
-	std::queue<SS2DBrush*> m_brushQueue;
+	std::unordered_set<SS2DBrush*> m_brushQueue;
+	std::unordered_map<uint64_t, SS2DBrush*> m_brushIndex;	// NewResourceBrush() by BrushKey()
 	w32Size m_screenSize;
 	SS2DBrush* m_brushDefault;	// White brush
 	bool m_resizeHappened;
 
+	SS2DShapeStore m_store;		// Shape positions when m_useShapeStore is set
+	bool m_useShapeStore;
+	std::vector<SS2DShapeStore::BoundsHit> m_boundsHits;	// SS2DClassifyBounds() scratch space
+
+	SS2DSpatialHash m_broadphase;	// Collision queries when m_useBroadphase is set
+	bool m_useBroadphase;
+
+	// Clear and redraw each changed part of the target with the backend clipped to it
+	void SubmitDirtyRects(const SS2DEssentials& ess) {
+		SS2DRenderBackend& backend = *ess.m_pBackend;
+		RectF rTarget;
+		ess.m_rsFAR.GetTargetRect(&rTarget);
+
+		m_dirty.clear();
+		if (!m_redrawAll) {
+			m_commands.GetChanges(m_dirty);
+			FLOAT area = MergeDirtyRects(rTarget);
+			m_redrawAll = area > m_fullRedraw * rTarget.Width() * rTarget.Height();
+		}
+
+		if (m_redrawAll) {
+			m_dirty.assign(1, rTarget);
+			backend.Clear(m_colorBackground);
+			m_commands.Replay(backend);
+			m_redrawAll = false;
+			return;
+		}
+
+		m_commands.ResetStats();
+		for (auto& r : m_dirty) {
+			backend.PushClip(r);
+			backend.Clear(m_colorBackground);
+			m_commands.Replay(backend, r);
+			backend.PopClip();
+		}
+	}
+
+	// Round m_dirty out to whole pixels inside rTarget and merge any that overlap. Too many
+	// and they become one. Returns the area left to redraw.
+	FLOAT MergeDirtyRects(const RectF& rTarget) {
+		size_t n = 0;
+		for (auto r : m_dirty) {
+			r.left = floorf((r.left > rTarget.left) ? r.left : rTarget.left);
+			r.top = floorf((r.top > rTarget.top) ? r.top : rTarget.top);
+			r.right = ceilf((r.right < rTarget.right) ? r.right : rTarget.right);
+			r.bottom = ceilf((r.bottom < rTarget.bottom) ? r.bottom : rTarget.bottom);
+			if ((r.right > r.left) && (r.bottom > r.top)) {
+				m_dirty[n++] = r;
+			}
+		}
+		m_dirty.resize(n);
+
+		if (m_dirty.size() > MaxDirtyRects * 4) {
+			UniteDirtyRects();	// not worth merging one by one
+		}
+
+		for (size_t i = 0; i < m_dirty.size(); ) {
+			bool merged = false;
+			for (size_t j = i + 1; j < m_dirty.size(); j++) {
+				if (SS2DCommandList::Overlaps(m_dirty[i], m_dirty[j])) {
+					Unite(&m_dirty[i], m_dirty[j]);
+					m_dirty[j] = m_dirty.back();
+					m_dirty.pop_back();
+					merged = true;
+					break;
+				}
+			}
+			if (!merged) {
+				i++;		// i no longer overlaps anything after it...
+			}
+			else {
+				i = 0;		// ...but it's grown, so it might overlap one before it now
+			}
+		}
+
+		if (m_dirty.size() > MaxDirtyRects) {
+			UniteDirtyRects();
+		}
+
+		FLOAT area = 0.0f;
+		for (auto& r : m_dirty) {
+			area += (r.right - r.left) * (r.bottom - r.top);
+		}
+		return area;
+	}
+
+	void UniteDirtyRects() {
+		for (size_t i = 1; i < m_dirty.size(); i++) {
+			Unite(&m_dirty[0], m_dirty[i]);
+		}
+		m_dirty.resize(1);
+	}
+
+	static void Unite(D2D1_RECT_F* p, const D2D1_RECT_F& r) {
+		if (r.left < p->left)		p->left = r.left;
+		if (r.top < p->top)			p->top = r.top;
+		if (r.right > p->right)		p->right = r.right;
+		if (r.bottom > p->bottom)	p->bottom = r.bottom;
+	}
+
+	// Spawn*() shapes come from here
+	SS2DSlabPool<MovingRectangle> m_poolRectangles;
+	SS2DSlabPool<MovingCircle> m_poolCircles;
+	SS2DSlabPool<MovingBitmap> m_poolBitmaps;
+
+	SS2DHandleTable m_handles;	// GetHandle() -> Shape*
+
+	SS2DCommandList m_commands;	// This frame's drawing when m_useCommandList is set
+	bool m_useCommandList;
+
+	static constexpr FLOAT StatsHeight = 24.0f;
+	IDWriteTextFormat* m_pStatsFormat;	// SS2D_SHOW_STATS
+
+	SS2DAtlas m_atlas;			// Pages for the bitmaps when m_useAtlas is set
+	std::wstring m_atlasTable;	// Prebuilt by SS2DAtlas::Save()
+	bool m_useAtlas;
+
+	bool m_useCulling;
+	size_t m_culled;	// Last frame
+
+	static constexpr size_t MaxDirtyRects = 16;
+	bool m_useDirtyRects;
+	FLOAT m_fullRedraw;			// Fraction of the target changed that's worth redrawing all of
+	bool m_redrawAll;			// Next frame, regardless
+
+	SS2DBitmapLoader m_loader;	// SS2DUseAsyncLoading()
+	bool m_useAsyncLoading;
+	size_t m_loading;			// Bitmaps with the loader
+	std::vector<SS2DBitmap*> m_loaded;	// CollectBitmaps() scratch space
+	SS2DBrush* m_brushLoading;	// Placeholder
+	Clock::time_point m_timeCreated;	// SS2DCreateResources()
+	double m_firstFrameMS;
+	double m_loadedMS;
+	std::vector<D2D1_RECT_F> m_dirty;
+
+	SS2DInput m_input;			// SS2DSetInput()
+
 public:
 	D2D1::ColorF m_colorBackground;
 };
\ No newline at end of file
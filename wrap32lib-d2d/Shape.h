@@ -4,6 +4,8 @@
 
 #include "SS2DEssentials.h"
 #include "SS2DBrush.h"
+#include "SS2DShapeStore.h"
+#include "SS2DHandles.h"
 #define _USE_MATH_DEFINES	// for M_PI
 #include <math.h>
 
@@ -51,16 +53,37 @@ Vector2F reflect(const Vector2F& direction, const Vector2F& normal) {
 	return direction - normal * (2 * direction.dot(normal));
 }
 
+class Shape;
+
+// Somewhere a shape can be given back to instead of deleted. See SS2DPool.h.
+class SS2DShapePool {
+public:
+	virtual void Free(Shape* p) = 0;
+};
+
+template<class T> class SS2DSlabPool;
+
+// Something that keeps pointers to shapes and has to let go of one before it's deleted.
+// See SS2DBroadphase.h.
+class SS2DShapeIndex {
+public:
+	virtual void Remove(Shape* p) = 0;
+};
+
 ////////////////////////////////////////////////////////////////////////
 // Shape class manages position, direction, speed and holds userdata,
 // active status and an association to a brush.
 // Also has prototype functions for simple HitTesting.
 // Shapes can be organised in a parent -> multiple child heirarchy.
+// Shapes can optionally be attached to an SS2DShapeStore in which case
+// the position lives in the store and the shape is a view over it.
 //
 ////////////////////////////////////////////////////////////////////////
 
 class Shape
 {
+	template<class T> friend class SS2DSlabPool;
+
 public:
 	static double RadToDeg(double rad) {
 		return rad / M_PI * 180;
@@ -70,6 +93,21 @@ public:
 		return deg / 180 * M_PI;
 	}
 
+	static const size_t NoIndex = (size_t)-1;
+
+	// What a shape really is. Each class reports its own type and its base's
+	// through IsType() so ShapeCast<>() can check a cast before making it.
+	enum class type {
+		shape,
+		circle,
+		rectangle,
+		bitmap,
+		text,
+		group
+	};
+
+	static const type Type = type::shape;
+
 	enum class moveResult {
 		ok,
 		hitboundsright,
@@ -80,29 +118,111 @@ public:
 
 	Shape(FLOAT x, FLOAT y, FLOAT speed, int direction, SS2DBrush* brush, LPARAM userdata = 0) :
 		m_pos(x, y), m_fSpeed(speed), m_parent(NULL), m_pBrush(brush), m_userdata(userdata), m_active(true),
-		m_childHasMoved(true)
+		m_childHasMoved(true), m_worldDirty(true),
+		m_store(NULL), m_hStore(SS2DShapeStore::InvalidHandle), m_storeRoot(false),
+		m_pool(NULL), m_handles(NULL), m_handle(SS2DHandleTable::InvalidHandle), m_broadphase(NULL),
+		m_worldIndex(NoIndex), m_childIndex(NoIndex), m_removedChildren(0)
 	{
 		SetDirectionInDeg(direction);
 	}
 
-	~Shape() {
+	virtual ~Shape() {
+		if (m_store) {
+			m_store->Remove(m_hStore);
+		}
+		if (m_handles) {
+			m_handles->Release(m_handle);	// any handles to us now go stale
+		}
+		if (m_broadphase) {
+			m_broadphase->Remove(this);		// so a query this frame can't return us
+		}
 	}
 
+	virtual type GetType() const { return Type; }
+	virtual bool IsType(type t) const { return t == Type; }
+
+	// Use instead of delete. Pooled shapes go back to their pool.
+	static void Destroy(Shape* p) {
+		if (p->m_pool) {
+			p->m_pool->Free(p);
+		}
+		else {
+			delete p;
+		}
+	}
+
+	bool IsPooled() const { return m_pool != NULL; }
+
+	// Handle from SS2DWorld::GetHandle(). InvalidHandle until asked for.
+	SS2DHandle GetHandle() const { return m_handle; }
+	void SetHandle(SS2DHandleTable* handles, SS2DHandle h) {
+		m_handles = handles;
+		m_handle = h;
+	}
+
+	// Where we are in the world's shape list. Maintained by SS2DWorld.
+	size_t GetWorldIndex() const { return m_worldIndex; }
+	void SetWorldIndex(size_t index) { m_worldIndex = index; }
+
+	// World position is cached. It's only worked out again after something
+	// up the parent chain has moved (see InvalidateWorld()).
 	Point2F GetPos(bool includeParent = true) const {
-		Point2F ret = m_pos;
-		if (includeParent && m_parent) {
-			ret += m_parent->GetPos(includeParent);
+		if (!includeParent) {
+			return GetLocalPos();
+		}
+		if (m_worldDirty) {
+			UpdateWorldTransform();
+		}
+		return m_worldPos;
+	}
+
+	// Our step plus all our parents' steps, i.e. how far we really move each frame
+	Vector2F GetWorldStep() const {
+		if (m_worldDirty) {
+			UpdateWorldTransform();
+		}
+		return m_worldStep;
+	}
+
+	// Mark our cached world position (and so all our children's) out of date.
+	// A dirty shape's children are always dirty so we can stop at the first one.
+	void InvalidateWorld() {
+		if (m_worldDirty) {
+			return;
+		}
+		m_worldDirty = true;
+		for (auto c : m_children) {
+			if (c) {
+				c->InvalidateWorld();
+			}
+		}
+	}
+
+	// Bring the cached world positions of this tree up to date, parents first,
+	// so every GetPos() after it is just a load. SS2DWorld does this once a frame.
+	void FlattenTransforms() {
+		if (m_worldDirty) {
+			UpdateWorldTransform();
+		}
+		for (auto c : m_children) {
+			if (c) {
+				c->FlattenTransforms();
+			}
 		}
-		return ret;
 	}
 
 	void SetPos(const Point2F& pos) {
-		m_pos = pos;
+		SetLocalPos(pos);
 		if (m_parent) {
-			m_parent->ChildHasMoved();
+			m_parent->ChildHasMoved(this);
+		}
+	}
+	void OffsetPos(const Point2F& pos) {
+		OffsetLocalPos(pos);
+		if (m_parent) {
+			m_parent->ChildHasMoved(this);
 		}
 	}
-	void OffsetPos(const Point2F& pos) { m_pos += pos; }
 
 	void SetDirectionInDeg(int directionInDeg) {
 		m_direction = ((double)directionInDeg * M_PI) / 180.0;
@@ -123,30 +243,44 @@ public:
 
 	virtual void MovePos(Point2F& pos, float len = 0.0) const
 	{
-		if (len > 0.0) {
-			float movelen = sqrt(m_cacheStep.lengthsq());
-			float fraction = len / movelen;
-			pos.x += m_cacheStep.x * fraction;
-			pos.y += m_cacheStep.y * fraction;
-		}
-		else {
-			pos.x += m_cacheStep.x;
-			pos.y += m_cacheStep.y;
+		if (len <= 0.0) {	// a whole step, parents' steps included
+			Vector2F step = GetWorldStep();
+			pos.x += step.x;
+			pos.y += step.y;
+			return;
 		}
 
+		float movelen = sqrt(m_cacheStep.lengthsq());
+		float fraction = len / movelen;
+		pos.x += m_cacheStep.x * fraction;
+		pos.y += m_cacheStep.y * fraction;
+
 		if (m_parent) {
 			m_parent->MovePos(pos, len);
 		}
 	}
 
 	void Move() { 
-		m_pos.x += m_cacheStep.x; 
-		m_pos.y += m_cacheStep.y;
-		for (auto& c : m_children) {
+		bool moved = (m_cacheStep.x != 0.0f) || (m_cacheStep.y != 0.0f);
+		OffsetLocalPos(Point2F(m_cacheStep.x, m_cacheStep.y));
+		for (auto& c : GetChildren()) {
 			c->Move();
 		}
-		if (m_parent) {
-			m_parent->ChildHasMoved();
+		if (moved && m_parent) {	// stationary children (bricks etc.) don't need their parent to refit
+			m_parent->ChildHasMoved(this);
+		}
+	}
+
+	// SS2DShapeStore::MoveActive() has already moved this tree. Catch up the way Move() and
+	// FlattenTransforms() would have in one walk: world positions are worked out top down and
+	// parents hear about the children that moved.
+	void StoreHasMoved() {
+		UpdateWorldTransform();	// our parent's done already
+		for (auto& c : GetChildren()) {
+			c->StoreHasMoved();
+		}
+		if (m_parent && ((m_cacheStep.x != 0.0f) || (m_cacheStep.y != 0.0f))) {
+			m_parent->ChildHasMoved(this);
 		}
 	}
 
@@ -175,7 +309,7 @@ public:
 	}
 
 	void Offset(const Point2F& pos) {
-		m_pos += pos;
+		OffsetLocalPos(pos);
 	}
 
 	double GetDirection() {
@@ -196,8 +330,11 @@ public:
 
 	void SetActive(bool b) {
 		m_active = b;
+		if (m_storeRoot) {
+			SetStoreMoving(b);	// roots decide whether their whole tree is moved by the store
+		}
 		if (m_parent) {
-			m_parent->ChildHasMoved();
+			m_parent->ChildHasMoved(this);
 		}
 	}
 
@@ -217,13 +354,36 @@ public:
 	COLORREF GetBrushColor() { return m_pBrush ? m_pBrush->GetColor() : 0; }
 
 	virtual void Draw(const SS2DEssentials& ess) {
-		for (auto m : m_children) {
+		for (auto m : GetChildren()) {
 			if (m->IsActive())
-				m->Draw(ess);
+				m->DrawIfVisible(ess);
 		}
 	}
+
+	// Draw() unless culling is on and the shape is wholly outside the cull rect. If the
+	// bounds don't take in the children (anything but a group) they still get their own look.
+	void DrawIfVisible(const SS2DEssentials& ess) {
+		if (!ess.m_cull || InView(ess.m_rectCull)) {
+			Draw(ess);
+			return;
+		}
+
+		ess.m_culled++;
+		if (!BoundsHoldChildren()) {
+			Shape::Draw(ess);
+		}
+	}
+
+	virtual bool InView(const RectF& rView) {
+		RectF r;
+		GetBoundingBox(&r, GetPos());
+		return r.hitTest(rView);
+	}
+
+	// GetBoundingBox() includes the children
+	virtual bool BoundsHoldChildren() const { return false; }
 	virtual void Draw(const SS2DEssentials& ess, Point2F pos) {
-		for (auto m : m_children) {
+		for (auto m : GetChildren()) {
 			if (m->IsActive())
 				m->Draw(ess, pos);
 		}
@@ -231,7 +391,7 @@ public:
 
 	// Lookahead WillHitBounds() for checking collision with screen edges.
 	virtual moveResult WillHitBounds(const w32Size& screenSize) {
-		return WillHitBounds(RectF(0, 0, (FLOAT)screenSize.cx, (FLOAT)screenSize.cy), GetPos());
+		return WillHitBounds(RectF(0, 0, (FLOAT)screenSize.cx, (FLOAT)screenSize.cy));
 	}
 
 	virtual moveResult WillHitBounds(const w32Size& screenSize, const Point2F& pos) {
@@ -239,6 +399,12 @@ public:
 	}
 
 	virtual moveResult WillHitBounds(const RectF& rBounds) {
+		if (m_storeRoot && GetChildren().empty()) {
+			// The store already has our bounds after the next step
+			RectF r;
+			m_store->GetNextBounds(m_hStore, &r.left, &r.top, &r.right, &r.bottom);
+			return ClassifyBounds(r, rBounds);
+		}
 		return WillHitBounds(rBounds, GetPos());
 	}
 
@@ -248,12 +414,11 @@ public:
 		RectF r;
 		GetBoundingBox(&r, posCurr);
 
-		if (r.left < rBounds.left)			return moveResult::hitboundsleft;
-		if (r.right >= rBounds.right)		return moveResult::hitboundsright;
-		if (r.top < rBounds.top)			return moveResult::hitboundstop;
-		if (r.bottom >= rBounds.bottom)		return moveResult::hitboundsbottom;
+		moveResult ret = ClassifyBounds(r, rBounds);
+		if (ret != moveResult::ok)
+			return ret;
 
-		for (auto& c : m_children) {
+		for (auto& c : GetChildren()) {
 			auto ret = c->WillHitBounds(rBounds);
 			if (ret != moveResult::ok)
 				return ret;
@@ -261,6 +426,15 @@ public:
 		return moveResult::ok;
 	}
 
+	// Which edge of rBounds (if any) the box r is over
+	static moveResult ClassifyBounds(const RectF& r, const RectF& rBounds) {
+		if (r.left < rBounds.left)			return moveResult::hitboundsleft;
+		if (r.right >= rBounds.right)		return moveResult::hitboundsright;
+		if (r.top < rBounds.top)			return moveResult::hitboundstop;
+		if (r.bottom >= rBounds.bottom)		return moveResult::hitboundsbottom;
+		return moveResult::ok;
+	}
+
 	// Routine to get the bounding box for simple rect/rect hit testing
 	virtual void GetBoundingBox(RectF*, const Point2F& pos) const {}
 
@@ -285,36 +459,76 @@ public:
 	}
 
 	// Heirarchy support
-	void SetParent(Shape* group) { m_parent = group; }
+	void SetParent(Shape* group) {
+		m_parent = group;
+		InvalidateWorld();
+	}
 	Shape* GetParent() { return m_parent; }
+	size_t GetChildIndex() const { return m_childIndex; }	// Orders children. NoIndex if we're not one.
 
-	void InsertChild(Shape* p) { m_children.insert(m_children.begin(), p); p->SetParent(this); }	// at the beginning
-	void AddChild(Shape* p) { m_children.push_back(p); p->SetParent(this); }						// at the end
+	void InsertChild(Shape* p) {	// at the beginning
+		CompactChildren();
+		m_children.insert(m_children.begin(), p);
+		for (size_t i = 0; i < m_children.size(); i++) {
+			m_children[i]->m_childIndex = i;
+		}
+		p->SetParent(this);
+		AttachChildStore(p);
+		ChildAdded(p);
+	}
+	void AddChild(Shape* p) {		// at the end
+		p->m_childIndex = m_children.size();
+		m_children.push_back(p);
+		p->SetParent(this);
+		AttachChildStore(p);
+		ChildAdded(p);
+	}
+	// O(1). The slot is left empty and closed up the next time the children are looked at.
+	// A child that's kept stays where it is in the world but no longer has a parent.
 	void RemoveChild(Shape* p, bool del = false) {
-		auto it = std::find(m_children.begin(), m_children.end(), p);
-		if (it != m_children.end()) {
+		size_t index = p->m_childIndex;
+		if ((index < m_children.size()) && (m_children[index] == p)) {
+			ChildRemoved(p);
+			p->DetachStore();
+			p->LeaveBroadphase();
+			m_children[index] = NULL;
+			m_removedChildren++;
+			p->m_childIndex = NoIndex;
 			if (del) {
-				delete* it;
+				Destroy(p);
+			}
+			else {
+				Point2F pos = p->GetPos();
+				p->SetParent(NULL);	// it won't hear about our moves any more
+				p->SetPos(pos);
 			}
-			m_children.erase(it);
 		}
 		ChildHasMoved();
 	}
-	const std::vector<Shape*>& GetChildren() { return m_children; }
+	const std::vector<Shape*>& GetChildren() {
+		CompactChildren();
+		return m_children;
+	}
 	void AddChildAndOffset(Shape* p) {
 		AddChild(p);
 		p->OffsetPos(Point2F(-GetPos().x, -GetPos().y));
 	}
 
 	void RemoveAllChildren(bool del = false) {
+		CompactChildren();
 		if (del) {
-			while (!m_children.empty()) {
-				delete m_children.front();
+			for (auto m : m_children) {
+				ChildRemoved(m);
+				Destroy(m);
 			}
+			m_children.clear();
 		}
 		else {
 			for (auto m : m_children) {
 				Point2F p = m->GetPos();
+				m->m_childIndex = NoIndex;
+				ChildRemoved(m);
+				m->DetachStore();
 				m->SetParent(NULL);
 				m->SetPos(p);
 			}
@@ -322,17 +536,158 @@ public:
 		}
 	}
 
-	void ChildHasMoved() {
+	// Called by a child when it moves, resizes or changes active state
+	virtual void ChildHasMoved(Shape* child = NULL) {
 		m_childHasMoved = true;
 	}
 
+	// Shape store support. Attach a root shape (and its children) with root = true.
+	void AttachStore(SS2DShapeStore* store, bool moving, bool root = false) {
+		if (m_store) {
+			return;
+		}
+
+		m_store = store;
+		m_storeRoot = root;
+		m_hStore = m_store->Add(m_pos.x, m_pos.y, m_cacheStep.x, m_cacheStep.y, moving, this);
+		SyncStoreExtent();
+		for (auto c : GetChildren()) {
+			c->AttachStore(store, moving);
+		}
+	}
+
+	void DetachStore() {
+		if (!m_store) {
+			return;
+		}
+
+		for (auto c : GetChildren()) {
+			c->DetachStore();
+		}
+		m_pos = GetLocalPos();	// take the position back from the store
+		m_store->Remove(m_hStore);
+		m_store = NULL;
+		m_hStore = SS2DShapeStore::InvalidHandle;
+		m_storeRoot = false;
+	}
+
+	// Broadphase support. The broadphase tells us when it has us so we can leave it
+	// when we're deleted or taken out of a group.
+	void SetBroadphase(SS2DShapeIndex* p) { m_broadphase = p; }
+
+	void LeaveBroadphase() {
+		if (m_broadphase) {
+			m_broadphase->Remove(this);
+		}
+		for (auto c : GetChildren()) {
+			c->LeaveBroadphase();
+		}
+	}
+
+	bool IsAttachedToStore() const { return m_store != NULL; }
+	bool IsStoreRoot() const { return m_storeRoot; }
+	SS2DShapeStore::Handle GetStoreHandle() const { return m_hStore; }
+
 protected:
+	// Close up the gaps left by RemoveChild(). Keeps the child order.
+	void CompactChildren() {
+		if (m_removedChildren == 0) {
+			return;
+		}
+
+		size_t count = 0;
+		for (auto c : m_children) {
+			if (c) {
+				c->m_childIndex = count;
+				m_children[count++] = c;
+			}
+		}
+		m_children.resize(count);
+		m_removedChildren = 0;
+	}
+
+	// Hooks for groups that index their children
+	virtual void ChildAdded(Shape* p) {}
+	virtual void ChildRemoved(Shape* p) {}
+
 	void UpdateCache() {
 		m_cacheStep = Vector2F((FLOAT)sin(m_direction), (FLOAT)-cos(m_direction)) * m_fSpeed;
+		if (m_store) {
+			m_store->SetStep(m_hStore, m_cacheStep.x, m_cacheStep.y);
+		}
+		InvalidateWorld();	// world step has changed
+	}
+
+	// Parent must be up to date first (GetPos() on it sees to that)
+	void UpdateWorldTransform() const {
+		m_worldPos = GetLocalPos();
+		m_worldStep = m_cacheStep;
+		if (m_parent) {
+			m_worldPos += m_parent->GetPos();
+			m_worldStep = m_worldStep + m_parent->GetWorldStep();
+		}
+		m_worldDirty = false;
+	}
+
+	// Position relative to the parent. Reads and writes go to the store when attached.
+	Point2F GetLocalPos() const {
+		return m_store ? Point2F(m_store->X(m_hStore), m_store->Y(m_hStore)) : m_pos;
+	}
+
+	void SetLocalPos(const Point2F& pos) {
+		if (m_store) {
+			m_store->SetPos(m_hStore, pos.x, pos.y);
+		}
+		else {
+			m_pos = pos;
+		}
+		InvalidateWorld();
+	}
+
+	void OffsetLocalPos(const Point2F& pos) {
+		if (m_store) {
+			m_store->OffsetPos(m_hStore, pos.x, pos.y);
+		}
+		else {
+			m_pos += pos;
+		}
+		InvalidateWorld();
+	}
+
+	// Call when the bounding box size changes so the store and parent stay correct
+	void SizeChanged() {
+		SyncStoreExtent();
+		if (m_parent) {
+			m_parent->ChildHasMoved(this);
+		}
+	}
+
+	void SyncStoreExtent() {
+		if (m_store) {
+			RectF r;
+			GetBoundingBox(&r, Point2F());
+			m_store->SetExtent(m_hStore, r.left, r.top, r.right, r.bottom);
+		}
+	}
+
+	void SetStoreMoving(bool b) {
+		if (m_store) {
+			m_store->SetActive(m_hStore, b);
+			for (auto c : GetChildren()) {
+				c->SetStoreMoving(b);
+			}
+		}
+	}
+
+	void AttachChildStore(Shape* p) {
+		if (m_store) {
+			p->DetachStore();
+			p->AttachStore(m_store, m_store->IsActive(m_hStore));
+		}
 	}
 
 protected:
-	Point2F m_pos;			// Current position
+	Point2F m_pos;			// Current position (not used while attached to a store)
 	double m_direction;		// Held in radians
 
 	FLOAT m_fSpeed;			// Movement speed
@@ -349,6 +704,32 @@ protected:
 
 	// Heirarchy support
 	Shape* m_parent;
-	std::vector<Shape*> m_children;
+	std::vector<Shape*> m_children;	// May have NULL gaps from RemoveChild(). Use GetChildren().
 	bool m_childHasMoved;
+
+	// World transform cache. Filled in lazily by GetPos()/GetWorldStep() or by FlattenTransforms().
+	mutable Point2F m_worldPos;
+	mutable Vector2F m_worldStep;
+	mutable bool m_worldDirty;
+	size_t m_worldIndex;			// In SS2DWorld's shape list
+	size_t m_childIndex;			// In our parent's m_children
+	size_t m_removedChildren;		// NULL gaps in m_children
+
+	// Shape store support
+	SS2DShapeStore* m_store;
+	SS2DShapeStore::Handle m_hStore;
+	bool m_storeRoot;		// Added to the store as a world level shape
+
+	SS2DShapePool* m_pool;	// Where Destroy() sends us. NULL for shapes made with new.
+
+	// Handle support
+	SS2DHandleTable* m_handles;	// Table m_handle came from
+	SS2DHandle m_handle;
+
+	SS2DShapeIndex* m_broadphase;	// Has us until we're deleted or removed
 };
+
+// Checked downcast. NULL if p isn't a T (or is NULL).
+template<class T> T* ShapeCast(Shape* p) {
+	return (p && p->IsType(T::Type)) ? static_cast<T*>(p) : NULL;
+}
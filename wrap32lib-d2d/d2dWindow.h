@@ -13,9 +13,14 @@
 #include "d2dwrite.h"
 #include "SS2Dbitmap.h"
 #include "Shape.h"
+#include "SS2DRenderBackend.h"
+#include "SS2DAssets.h"
+#include "SS2DEventRing.h"
+#include "SS2DInput.h"
 
 #include <string>
 #include <queue>
+#include <vector>
 
 #pragma comment(lib, "d2d1")
 
@@ -23,16 +28,6 @@
 
 #include <map>
 
-class WindowEvent
-{
-public:
-	WindowEvent(UINT msg, WPARAM wParam, LPARAM lParam) : m_msg(msg), m_wParam(wParam), m_lParam(lParam) {}
-
-	UINT m_msg;
-	WPARAM m_wParam;
-	LPARAM m_lParam;
-};
-
 class D2DWindow : public Window, public EventThread
 {
 public:
@@ -40,9 +35,14 @@ public:
 		Window(flags, pParent),
 		m_pDirect2dFactory(NULL),
 		m_dwUpdateRate(dwUpdateRate),
+		m_spilling(false),
 		m_updateTime(0),
 		m_updateCount(0)
-	{}
+	{
+		m_ess.m_pBackend = &m_backend;
+		m_ess.m_pTextFormats = &m_textFormats;
+		m_ess.m_pAssets = &m_assets;
+	}
 
 	~D2DWindow(void) {
 		Stop();
@@ -76,15 +76,21 @@ public:
 		{
 			w32Point mouse = lParam;
 			m_ess.m_rsFAR.ReverseScaleAndOffset(&mouse);
-			m_ptMouse = mouse;
+			m_ptMouse.Set(mouse);	// only the latest matters
 		}
 		break;
 
 		case WM_LBUTTONDOWN:
 		case WM_LBUTTONUP:
-			m_csEvents.Enter();
-			m_events.push(WindowEvent(uMsg, wParam, lParam));
-			m_csEvents.Leave();
+		case WM_RBUTTONDOWN:
+		case WM_RBUTTONUP:
+		case WM_MBUTTONDOWN:
+		case WM_MBUTTONUP:
+		case WM_SYSKEYDOWN:
+		case WM_SYSKEYUP:
+		case WM_CHAR:
+		case WM_KILLFOCUS:
+			QueueEvent(WindowEvent(uMsg, wParam, lParam, GetTickCount64()));
 			break;
 
 		case WM_KEYDOWN:
@@ -100,9 +106,7 @@ public:
 				}
 			}
 		case WM_KEYUP:
-			m_csEvents.Enter();
-			m_events.push(WindowEvent(uMsg, wParam, lParam));
-			m_csEvents.Leave();
+			QueueEvent(WindowEvent(uMsg, wParam, lParam, GetTickCount64()));
 			break;
 		}
 
@@ -110,6 +114,62 @@ public:
 	}
 
 protected:
+	// Window thread. When the ring's full, key and button ups and focus loss can't just be
+	// dropped or a key would stay down for good, so they go in m_eventsSpill. So does anything
+	// after them (to keep the order) until the update thread has taken the lot.
+	void QueueEvent(const WindowEvent& ev) {
+		if (m_spilling.load(std::memory_order_relaxed)) {
+			CSLocker lock(m_csSpill);
+			if (!m_eventsSpill.empty()) {
+				m_eventsSpill.push_back(ev);
+				return;
+			}
+			m_spilling.store(false, std::memory_order_relaxed);	// caught up
+		}
+
+		if (!m_events.Push(ev) && MustDeliver(ev.m_msg)) {
+			CSLocker lock(m_csSpill);
+			m_eventsSpill.push_back(ev);
+			m_spilling.store(true, std::memory_order_release);
+		}
+	}
+
+	// Update thread. Everything QueueEvent() has queued, in order, into m_input and m_eventsUpdate.
+	void TakeEvents() {
+		WindowEvent ev;
+		while (m_events.Pop(ev)) {
+			TakeEvent(ev);
+		}
+		if (m_spilling.load(std::memory_order_acquire)) {
+			while (m_events.Pop(ev)) {	// pushed before the spill started, so they come first
+				TakeEvent(ev);
+			}
+			CSLocker lock(m_csSpill);
+			for (auto& spilled : m_eventsSpill) {
+				TakeEvent(spilled);
+			}
+			m_eventsSpill.clear();
+		}
+	}
+
+	void TakeEvent(const WindowEvent& ev) {
+		m_input.Apply(ev.m_msg, ev.m_wParam, ev.m_lParam);
+		m_eventsUpdate.push(ev);
+	}
+
+	static bool MustDeliver(UINT msg) {
+		switch (msg) {
+		case WM_KEYUP:
+		case WM_SYSKEYUP:
+		case WM_LBUTTONUP:
+		case WM_RBUTTONUP:
+		case WM_MBUTTONUP:
+		case WM_KILLFOCUS:
+			return true;
+		}
+		return false;
+	}
+
 	HRESULT EnsureDeviceResourcesCreated() {
 		HRESULT hr = S_OK;
 
@@ -122,10 +182,11 @@ protected:
 				rc.Height()
 			);
 
-			// Create a Direct2D render target.
+			// Create a Direct2D render target. Its contents are kept from one frame to the
+			// next so a world using dirty rects (SS2DUseDirtyRects()) only redraws what changed.
 			hr = m_pDirect2dFactory->CreateHwndRenderTarget(
 				D2D1::RenderTargetProperties(),
-				D2D1::HwndRenderTargetProperties(*this, size),
+				D2D1::HwndRenderTargetProperties(*this, size, D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS),
 				&m_ess.m_pRenderTarget
 			);
 
@@ -134,6 +195,8 @@ protected:
 			}
 			m_ess.m_pRenderTarget->Resize(D2D1::SizeU(m_size.cx, m_size.cy));
 
+			m_backend.SetRenderTarget(m_ess.m_pRenderTarget);
+
 			// Set rsFAR up first as it may be used in Creation of resources
 			m_ess.m_rsFAR.SetBounds(m_ess.m_pRenderTarget->GetSize());
 
@@ -155,6 +218,7 @@ protected:
 
 		if (FAILED(hr))
 			return HRESULT_CODE(hr);
+		m_backend.SetDWriteFactory(m_ess.m_pDWriteFactory);
 
 		// The factory returns the current system DPI. This is also the value it will use
 		// to create its own windows.
@@ -178,13 +242,14 @@ protected:
 	bool OnUpdateTimer() {
 		ULONGLONG updateStart = GetTickCount64();
 
-		m_csEvents.Enter();
-		if (!SS2DUpdate(updateStart, m_ptMouse, m_events)) {
-			m_csEvents.Leave();
+		// Take what the window thread has queued. Unless the ring overflowed (see QueueEvent()) neither waits for the other.
+		m_input.BeginFrame();
+		m_input.SetMouse(m_ptMouse.Get());
+		TakeEvents();
+		if (!SS2DUpdate(updateStart, m_input.GetMouse(), m_eventsUpdate)) {
 			return true;
 		}
-		m_events = std::queue<WindowEvent>();
-		m_csEvents.Leave();
+		m_eventsUpdate = std::queue<WindowEvent>();
 
 		if (EnsureDeviceResourcesCreated() != S_OK)	return true;
 
@@ -211,6 +276,8 @@ protected:
 
 	void D2DDiscard() {
 		D2DOnDiscardResources();
+		m_backend.SetRenderTarget(NULL);
+		m_assets.DiscardDevice();	// the pixels stay for the next render target
 		SafeRelease(&m_ess.m_pRenderTarget);
 	}
 
@@ -221,6 +288,10 @@ protected:
 
 	virtual bool SS2DUpdate(ULONGLONG tick, const Point2F& ptMouse, std::queue<WindowEvent>& events) { return false;  }	// manipulate your data here - return true to quit
 
+	// This frame's keys and mouse, built from the same messages as the events. Hand it to the world
+	// (SS2DWorld::SS2DSetInput()) before its SS2DUpdate().
+	const SS2DInput& SS2DGetInput() const { return m_input; }
+
 	virtual void D2DPreRender(const SS2DEssentials& ess) {}	// draw the data here
 	virtual void D2DRender() {}	// draw the data here
 
@@ -254,6 +325,8 @@ protected:
 	void ThreadShutdown() override {
 		// Clear the d2d stuff first
 		D2DDiscard();
+		m_backend.SetDWriteFactory(NULL);
+		m_textFormats.Clear();
 		SafeRelease(&m_ess.m_pIWICFactory);
 		SafeRelease(&m_ess.m_pDWriteFactory);
 		SafeRelease(&m_pDirect2dFactory);
@@ -283,6 +356,9 @@ protected:
 protected:
 	// Drawing stuff
 	SS2DEssentials m_ess;
+	SS2DD2DBackend m_backend;	// m_ess.m_pBackend
+	SS2DTextFormats m_textFormats;	// m_ess.m_pTextFormats
+	SS2DAssetCache m_assets;		// m_ess.m_pAssets. Lives as long as the window so survives Stop() / Init().
 	ID2D1Factory* m_pDirect2dFactory;
 	DirectWrite m_dw;
 
@@ -290,11 +366,15 @@ protected:
 	w32Size m_size;			// Track the windo size
 
 	DWORD m_dwUpdateRate;	// in ms
-	Point2F m_ptMouse;		// Track the mouse position
+	SS2DLatestPoint m_ptMouse;	// Track the mouse position. Set by the window thread.
 
 	// Events stuff - keypress, etc.
-	std::queue<WindowEvent> m_events;
-	CriticalSection m_csEvents;		// Ensure threads don't fight over the events queue
+	SS2DEventRing<WindowEvent> m_events;	// Window thread in, update thread out
+	CriticalSection m_csSpill;				// m_eventsSpill
+	std::vector<WindowEvent> m_eventsSpill;	// What wouldn't fit in m_events but can't be dropped (QueueEvent())
+	std::atomic<bool> m_spilling;			// m_eventsSpill is in use. Cleared by the window thread.
+	std::queue<WindowEvent> m_eventsUpdate;	// What SS2DUpdate() gets. Update thread only.
+	SS2DInput m_input;						// SS2DGetInput(). Update thread only.
 
 	// Performance stats
 	ULONGLONG m_updateTime;		// Time spent in update function (ms)
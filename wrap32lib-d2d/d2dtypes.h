@@ -135,7 +135,7 @@ public:
 class SS2DRectScaler
 {
 public:
-	SS2DRectScaler(long cx, long cy) : m_sizeBase(cx, cy), m_fScale(1.0f), m_gridSize(10),
+	SS2DRectScaler(long cx, long cy) : m_sizeBase(cx, cy), m_sizeAvail(D2D1::SizeF(0.0f, 0.0f)), m_fScale(1.0f), m_gridSize(10),
 		m_dpiX(DEFAULT_DPI), m_dpiY(DEFAULT_DPI)
 	{}
 
@@ -147,6 +147,8 @@ public:
 	}
 
 	void SetBounds(const D2D1_SIZE_F& sizeAvail) {
+		m_sizeAvail = sizeAvail;
+
 		// sizeAvail is in actual DPI
 		// We need to work out an X and Y offset and multiplier
 		// such that a box of m_sizeVisible will fit in the m_size as large as possible
@@ -200,6 +202,19 @@ public:
 		Scale(pDest, w32Rect(0, 0, m_sizeBase.cx, m_sizeBase.cy));
 	}
 
+	// All of it, borders included
+	void GetTargetRect(RectF* pDest) const {
+		*pDest = RectF(0.0f, 0.0f, m_sizeAvail.width, m_sizeAvail.height);
+	}
+
+	// Target rect back to base coordinates
+	void ReverseScaleAndOffset(RectF* p) const {
+		p->left = (p->left - m_ptOffset.width) / m_fScale;
+		p->right = (p->right - m_ptOffset.width) / m_fScale;
+		p->top = (p->top - m_ptOffset.height) / m_fScale;
+		p->bottom = (p->bottom - m_ptOffset.height) / m_fScale;
+	}
+
 	void ScaleX(FLOAT* p) const { *p = *p * m_fScale + m_ptOffset.width; }
 	void ScaleY(FLOAT* p) const { *p = *p * m_fScale + m_ptOffset.height; }
 	void ScaleNoOffset(FLOAT* p) const { *p = *p * m_fScale; }
@@ -240,6 +255,7 @@ public:
 
 protected:
 	w32Size m_sizeBase;
+	D2D1_SIZE_F m_sizeAvail;	// SetBounds()
 	FLOAT m_fScale;
 	SizeF m_ptOffset;
 	int m_gridSize;